@@ -0,0 +1,134 @@
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ClassMethodName.h"
+
+// Finds the class and method of every name in a synthetic corpus of a hundred thousand mangled
+// names, as the ABI scan does: with a parser (and so an arena) and a class path per name, and
+// the path copied from a std::list into a std::vector, as it used to; with one parser and path
+// for every name, resetting the arena between names; and with the fast path in front of that:
+namespace {
+
+const std::size_t kNameCount = 100000;
+
+std::string
+mangle(const std::string& identifier) {
+    return std::to_string(identifier.size()) + identifier;
+}
+
+// Mostly methods, of classes in and out of namespaces, with some free functions, constructors and
+// templates, which aren't:
+std::vector<std::string>
+makeCorpus() {
+    const char *const parameters[] = { "v", "i", "fff", "RKS_", "U3AS1Pf" };
+
+    std::vector<std::string> corpus;
+    corpus.reserve(kNameCount);
+
+    for (std::size_t index = 0; index < kNameCount; ++index) {
+        auto class_path = mangle("Shape" + std::to_string(index % 997));
+        if (index % 3 == 0) {
+            class_path = mangle("ns" + std::to_string(index % 7)) + class_path;
+        }
+
+        auto method    = mangle("draw" + std::to_string(index % 31));
+        auto parameter = parameters[index % 5];
+
+        switch (index % 10) {
+        case 0:
+            corpus.push_back("_Z" + method + parameter);
+            break;
+        case 1:
+            corpus.push_back("_ZN" + class_path + "C2E" + parameter);
+            break;
+        case 2:
+            corpus.push_back("_ZN" + class_path + "IfE" + method + "E" + parameter);
+            break;
+        default:
+            corpus.push_back("_ZN" + class_path + method + "E" + parameter);
+            break;
+        }
+    }
+
+    return corpus;
+}
+
+using Result = llair::ClassMethodNameParser::Result;
+
+template<typename Parse>
+std::vector<Result>
+run(const char *what, const std::vector<std::string>& corpus, Parse parse) {
+    std::vector<Result> results;
+    results.reserve(corpus.size());
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (const auto& name : corpus) {
+        results.push_back(parse(name));
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    llvm::outs() << what << ": " << elapsed.count() / 1000 << "ms, "
+                 << elapsed.count() * 1000 / corpus.size() << "ns per name\n";
+
+    return results;
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    auto corpus = makeCorpus();
+
+    llvm::outs() << corpus.size() << " names\n";
+
+    auto before = run(
+        "an arena per name", corpus,
+        [](const std::string& name) -> Result {
+            llair::ClassMethodNameParser          parser;
+            llvm::SmallVector<llvm::StringRef, 8> path;
+
+            auto result = parser.parseWithDemangler(name, path);
+
+            std::list<llvm::StringRef>   path_parts(path.begin(), path.end());
+            std::vector<llvm::StringRef> path_copy(path_parts.begin(), path_parts.end());
+
+            return path_copy.empty() ? llvm::None : result;
+        });
+
+    llair::ClassMethodNameParser          parser;
+    llvm::SmallVector<llvm::StringRef, 8> path;
+
+    auto reused = run(
+        "a reused arena", corpus,
+        [&parser, &path](const std::string& name) -> Result {
+            return parser.parseWithDemangler(name, path);
+        });
+
+    auto fast = run(
+        "the fast path, then a reused arena", corpus,
+        [&parser, &path](const std::string& name) -> Result { return parser.parse(name, path); });
+
+    auto methods = std::count_if(before.begin(), before.end(),
+                                 [](const auto& result) -> bool { return result.hasValue(); });
+
+    llvm::outs() << methods << " methods\n";
+
+    if (reused != before || fast != before) {
+        llvm::errs() << "the results differ\n";
+        return 1;
+    }
+
+    return 0;
+}
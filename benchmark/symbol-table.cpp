@@ -0,0 +1,160 @@
+#include <llair/IR/Class.h>
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Compiler.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Gets the names of many classes, and sorts the classes by name, as the linker does: through the
+// symbol table entry that each class holds, and through a map from each object to its entry, as
+// names were looked up when the context kept that map. The classes are few enough to stay in the
+// caches, and then too many to:
+namespace {
+
+// How many names are got, in all:
+const unsigned kCallCount = 2000000;
+
+std::string
+makeClasses(unsigned count) {
+    std::string text;
+
+    for (unsigned index = 0; index < count; ++index) {
+        auto name = "Shape" + std::to_string(index);
+
+        text += "%struct." + name + " = type { float }\n"
+                "define void @_ZN" + std::to_string(name.size()) + name + "4drawEv(%struct." +
+                name + " addrspace(1)* %self) {\n"
+                "entry:\n"
+                "  ret void\n"
+                "}\n";
+    }
+
+    return text;
+}
+
+using EntryMap = llvm::DenseMap<const llair::Named *, llair::SymbolTableEntry *>;
+
+// As getName() was, out of line: a flag in the object said whether to look it up (the context,
+// which was found through a virtual call, isn't counted):
+LLVM_ATTRIBUTE_NOINLINE llvm::StringRef
+lookUpSymbolTableEntry(const EntryMap& entries, const llair::Named *named) {
+    if (!named->hasName()) {
+        return llvm::StringRef("", 0);
+    }
+
+    return entries.find(named)->second->getKey();
+}
+
+// Reports the fastest of several runs, so that the first doesn't pay for warming the caches:
+template<typename Run>
+void
+measure(const char *what, std::size_t count, Run run) {
+    auto elapsed = std::chrono::nanoseconds::max();
+
+    for (unsigned repetition = 0; repetition < 5; ++repetition) {
+        auto start = std::chrono::steady_clock::now();
+
+        run();
+
+        elapsed = std::min(elapsed, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now() - start));
+    }
+
+    llvm::outs() << what << ": " << llvm::format("%.2f", elapsed.count() / 1e6) << "ms, "
+                 << llvm::format("%.1f", double(elapsed.count()) / count) << "ns each\n";
+}
+
+// Returns false if the two ways find different names:
+bool
+compare(unsigned count) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+    llvm::SMDiagnostic  diagnostic;
+
+    auto llmodule = llvm::parseAssemblyString(makeClasses(count), diagnostic, llcontext);
+
+    if (!llmodule) {
+        diagnostic.print("llair-benchmark-symbol-table", llvm::errs());
+        return false;
+    }
+
+    auto module  = std::make_unique<llair::Module>(std::move(llmodule));
+    auto classes = module->getOrLoadAllClassesFromABI();
+
+    // The map that the context used to keep, of every named object:
+    EntryMap entries;
+    std::for_each(
+        classes.begin(), classes.end(),
+        [&entries](auto klass) -> void {
+            entries.insert({ klass, klass->getSymbolTableEntry() });
+        });
+
+    auto lookUpName = [&entries](const llair::Named *named) -> llvm::StringRef {
+        return lookUpSymbolTableEntry(entries, named);
+    };
+
+    llvm::outs() << classes.size() << " classes:\n";
+
+    const auto rounds = kCallCount / count;
+
+    std::size_t held_size = 0, looked_up_size = 0;
+
+    measure("  getName(), through the entry that it holds", count * rounds, [&]() -> void {
+        for (unsigned round = 0; round < rounds; ++round) {
+            std::for_each(
+                classes.begin(), classes.end(),
+                [&held_size](auto klass) -> void { held_size += klass->getName().size(); });
+        }
+    });
+
+    measure("  getName(), through a map of entries", count * rounds, [&]() -> void {
+        for (unsigned round = 0; round < rounds; ++round) {
+            std::for_each(
+                classes.begin(), classes.end(),
+                [&](auto klass) -> void { looked_up_size += lookUpName(klass).size(); });
+        }
+    });
+
+    auto held_sorted = classes, looked_up_sorted = classes;
+
+    measure("  sorting by name, through the entry that it holds", count, [&]() -> void {
+        held_sorted = classes;
+        std::sort(held_sorted.begin(), held_sorted.end(),
+                  [](auto lhs, auto rhs) -> bool { return lhs->getName() < rhs->getName(); });
+    });
+
+    measure("  sorting by name, through a map of entries", count, [&]() -> void {
+        looked_up_sorted = classes;
+        std::sort(looked_up_sorted.begin(), looked_up_sorted.end(),
+                  [&](auto lhs, auto rhs) -> bool { return lookUpName(lhs) < lookUpName(rhs); });
+    });
+
+    return held_size == looked_up_size && held_sorted == looked_up_sorted;
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    for (unsigned count : { 100, 1000, 20000 }) {
+        if (!compare(count)) {
+            llvm::errs() << "the names differ\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+//-*-C++-*-
+#ifndef LLAIR_BITCODE_ARCHIVE_H
+#define LLAIR_BITCODE_ARCHIVE_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llvm {
+class raw_ostream;
+} // End namespace llvm
+
+namespace llair {
+
+class Interface;
+class LLAIRContext;
+class Module;
+
+// Many modules stored as bitcode, plus an index of the symbols that each one provides, so that
+// a member can be found (and only that member read) without parsing the others:
+//
+//     header:  magic "LLAIRAR\0", version, member count, symbol count, string table size
+//     members: offset, size, name (in the string table)
+//     symbols: name (in the string table), kind, member; sorted by kind, then by name, then by
+//              member
+//     strings
+//     bitcode of each member, 8-byte aligned
+//
+// All integers are little-endian.
+class Archive {
+public:
+
+    enum class SymbolKind : uint32_t {
+        // An externally visible function definition:
+        Function   = 0,
+        // A class from 'llair.class':
+        Class      = 1,
+        // A vertex, fragment or kernel function:
+        EntryPoint = 2,
+        // An interface that a class of the member implements (see getInterfaceSymbol()); unlike
+        // the others, it's indexed for every such member:
+        Interface  = 3
+    };
+
+    // Does the buffer start with the archive magic?
+    static bool isArchive(llvm::MemoryBufferRef);
+
+    // Validates the header and tables; the buffer is kept, and the members refer to it:
+    static llvm::Expected<std::unique_ptr<Archive>> create(std::unique_ptr<llvm::MemoryBuffer>);
+
+    // Maps the file, rather than reading it:
+    static llvm::Expected<std::unique_ptr<Archive>> open(llvm::StringRef path);
+
+    // Writes the modules with writeBitcode(), and indexes the symbols they provide. The interfaces
+    // that are indexed are the ones that the modules declare:
+    static llvm::Error write(llvm::ArrayRef<Module *>, llvm::raw_ostream&);
+
+    // The name that the interface is indexed by: its type's, without the suffix that keeps it
+    // unique within a context, so that it's the same in the context that reads the archive:
+    static std::string getInterfaceSymbol(const Interface *);
+
+    ~Archive();
+
+    unsigned member_size() const { return d_member_count; }
+
+    llvm::StringRef       getMemberName(unsigned) const;
+    llvm::MemoryBufferRef getMemberBuffer(unsigned) const;
+
+    // Loads the member lazily (see getLazyBitcodeModule()); the module refers to the archive's
+    // buffer, so it must not outlive the archive:
+    llvm::Expected<std::unique_ptr<Module>> getMemberModule(unsigned, LLAIRContext&) const;
+
+    // Returns the member that provides the symbol:
+    llvm::Optional<unsigned> lookup(SymbolKind, llvm::StringRef) const;
+
+    // Returns every member that provides the symbol, in archive order:
+    llvm::SmallVector<unsigned, 4> lookupAll(SymbolKind, llvm::StringRef) const;
+
+private:
+
+    Archive(std::unique_ptr<llvm::MemoryBuffer>);
+
+    llvm::Error parse();
+
+    llvm::StringRef getString(uint32_t offset, uint32_t size) const;
+
+    // The index of the first symbol that isn't ordered before the key:
+    unsigned findSymbol(SymbolKind, llvm::StringRef) const;
+    bool     isSymbol(unsigned, SymbolKind, llvm::StringRef) const;
+
+    std::unique_ptr<llvm::MemoryBuffer> d_buffer;
+
+    unsigned    d_member_count = 0, d_symbol_count = 0;
+    const char *d_members = nullptr, *d_symbols = nullptr;
+    llvm::StringRef d_strings;
+};
+
+} // End namespace llair
+
+#endif
@@ -6,6 +6,11 @@
 #include <llvm/Support/MemoryBuffer.h>
 
 #include <memory>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // End namespace llvm
 
 namespace llair {
 
@@ -15,6 +20,25 @@ class Module;
 llvm::Expected<std::unique_ptr<llair::Module>> getBitcodeModule(llvm::MemoryBufferRef bitcode,
                                                                 LLAIRContext &        context);
 
+// Reads the module's metadata, globals and function declarations, and creates its classes,
+// dispatchers and entry points, but leaves function bodies in the bitcode until they are needed
+// (by the Linker, finalizeLibrary(), or Module::materializeAll()). The module owns the buffer:
+llvm::Expected<std::unique_ptr<llair::Module>>
+getLazyBitcodeModule(std::unique_ptr<llvm::MemoryBuffer> bitcode, LLAIRContext &context);
+
+// Reads any function bodies that are still in the bitcode, removes the null metadata operands that
+// removed objects leave behind, and updates the ABI index (see Module::updateABIIndex()) before
+// writing the module:
+llvm::Error writeBitcode(Module &module, llvm::raw_ostream &os);
+
+// Moves modules into another (typically freshly created) context by round-tripping them through
+// bitcode; their classes, dispatchers and entry points are rebuilt from the module metadata. Each
+// module is replaced in place, and the original is destroyed only once its copy has been read, so
+// once every module has moved, their old context holds nothing that is still in use and can be
+// destroyed. On failure, the modules before the one that failed have moved, and the rest haven't:
+llvm::Error recycleModules(std::vector<std::unique_ptr<llair::Module>> &modules,
+                           LLAIRContext &context);
+
 } // End namespace llair
 
 #endif
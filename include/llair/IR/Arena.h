@@ -0,0 +1,42 @@
+//-*-C++-*-
+#ifndef LLAIR_IR_ARENA_H
+#define LLAIR_IR_ARENA_H
+
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/Support/Allocator.h>
+
+#include <cstddef>
+#include <memory>
+
+namespace llair {
+
+// Bump allocator for the immutable member arrays (methods, arguments, outputs) of the classes,
+// dispatchers and entry points of a Module. Each object allocated from it holds a reference, so
+// the memory is released in bulk once the module and every object that outlived it are gone.
+class Arena : public llvm::RefCountedBase<Arena> {
+public:
+    template<typename T>
+    T *allocate(std::size_t n) { return d_allocator.Allocate<T>(n); }
+
+private:
+    llvm::BumpPtrAllocator d_allocator;
+};
+
+// Objects created without a module allocate their arrays from the heap:
+template<typename T>
+T *
+allocateArray(Arena *arena, std::size_t n) {
+    return arena ? arena->allocate<T>(n) : std::allocator<T>().allocate(n);
+}
+
+template<typename T>
+void
+deallocateArray(Arena *arena, T *p, std::size_t n) {
+    if (!arena) {
+        std::allocator<T>().deallocate(p, n);
+    }
+}
+
+} // End namespace llair
+
+#endif
@@ -2,6 +2,7 @@
 #ifndef LLAIR_IR_CLASS
 #define LLAIR_IR_CLASS
 
+#include <llair/IR/Arena.h>
 #include <llair/IR/Named.h>
 
 #include <llvm/ADT/ArrayRef.h>
@@ -97,10 +98,15 @@ private:
 
     Module *d_module = nullptr;
 
+    llvm::IntrusiveRefCntPtr<Arena> d_arena;
+
     llvm::Optional<std::size_t> d_size, d_size_with_kind, d_offset_past_kind;
 
     llvm::TypedTrackingMDRef<llvm::MDTuple> d_md;
 
+    // Index of d_md within the module's 'llair.class' named metadata:
+    llvm::Optional<unsigned> d_module_md_index;
+
     friend struct module_ilist_traits<Class>;
     friend class Module;
 };
@@ -2,13 +2,16 @@
 #ifndef LLAIR_IR_DISPATCHER_H
 #define LLAIR_IR_DISPATCHER_H
 
+#include <llair/IR/Arena.h>
 #include <llair/IR/Interface.h>
 
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/Optional.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ADT/ilist_node.h>
 #include <llvm/IR/TrackingMDRef.h>
+#include <llvm/Support/Error.h>
 
 #include <string>
 
@@ -41,8 +44,12 @@ public:
         Method(Interface *, const Interface::Method *);
         Method(llvm::Metadata *, const Interface::Method *);
 
+        llvm::Expected<llvm::SwitchInst *> getSwitcher();
+
         const Interface::Method *d_interface_method = nullptr;
         llvm::Function          *d_function = nullptr;
+
+        // Found on first use, as the body of a lazily loaded function hasn't been read:
         llvm::SwitchInst        *d_switcher = nullptr;
 
         llvm::TypedTrackingMDRef<llvm::ConstantAsMetadata> d_md;
@@ -69,7 +76,8 @@ public:
 
     const Method *findMethod(llvm::StringRef) const;
 
-    void insertImplementation(uint32_t, const Class *);
+    // Fails, leaving the dispatcher as it was, if a lazily loaded method's body can't be read:
+    llvm::Error insertImplementation(uint32_t, const Class *);
     void removeImplementation(uint32_t);
 
     llvm::Metadata *      metadata() { return d_md.get(); }
@@ -95,6 +103,8 @@ private:
 
     Module *d_module = nullptr;
 
+    llvm::IntrusiveRefCntPtr<Arena> d_arena;
+
     struct Implementation {
         std::string name;
     };
@@ -103,6 +113,9 @@ private:
 
     llvm::TypedTrackingMDRef<llvm::MDTuple> d_md, d_implementations_md;
 
+    // Index of d_md within the module's 'llair.dispatcher' named metadata:
+    llvm::Optional<unsigned> d_module_md_index;
+
     friend struct module_ilist_traits<Dispatcher>;
     friend class Module;
 };
@@ -2,6 +2,8 @@
 #ifndef LLAIR_IR_ENTRYPOINT
 #define LLAIR_IR_ENTRYPOINT
 
+#include <llair/IR/Arena.h>
+
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ADT/ilist_node.h>
@@ -215,15 +217,21 @@ protected:
 
     Module *d_module = nullptr;
 
+    llvm::IntrusiveRefCntPtr<Arena> d_arena;
+
     llvm::TypedTrackingMDRef<llvm::MDNode>          d_md;
     llvm::TypedTrackingMDRef<llvm::ValueAsMetadata> d_function_md;
     llvm::TypedTrackingMDRef<llvm::MDTuple>         d_arguments_md;
 
+    // Index of d_md within the module's named metadata for this kind of entry point:
+    llvm::Optional<unsigned> d_module_md_index;
+
 private:
     void setModule(Module *);
     void updateArgumentMetadata(Argument *);
 
     friend struct module_ilist_traits<EntryPoint>;
+    friend class Module;
 };
 
 class VertexEntryPoint : public EntryPoint {
@@ -20,6 +20,7 @@ class raw_ostream;
 namespace llair {
 
 class LLAIRContext;
+struct InterfaceKeyInfo;
 
 class Interface {
 public:
@@ -47,8 +48,6 @@ public:
     static Interface *get(LLAIRContext&, llvm::StructType *, llvm::ArrayRef<llvm::StringRef>, llvm::ArrayRef<llvm::StringRef>, llvm::ArrayRef<llvm::FunctionType *>);
     static Interface *get(llvm::Metadata *);
 
-    ~Interface();
-
     LLAIRContext& getContext() const { return d_context; }
 
     llvm::StructType *getType() const { return d_type; }
@@ -76,6 +75,9 @@ private:
 
     Interface(LLAIRContext&, llvm::StructType *, llvm::ArrayRef<llvm::StringRef>, llvm::ArrayRef<llvm::StringRef>, llvm::ArrayRef<llvm::FunctionType *>);
 
+    // Interfaces are owned by their context:
+    ~Interface();
+
     LLAIRContext& d_context;
 
     llvm::StructType *d_type = nullptr;
@@ -84,6 +86,12 @@ private:
     Method *    d_methods      = nullptr;
 
     llvm::MDTuple *d_md = nullptr;
+
+    // Hash of the uniquing key, computed once at construction:
+    unsigned d_hash = 0;
+
+    friend struct InterfaceKeyInfo;
+    friend class LLAIRContextImpl;
 };
 
 } // End namespace llair
@@ -4,6 +4,7 @@
 
 #include <llvm/ADT/StringRef.h>
 
+#include <cstddef>
 #include <memory>
 
 namespace llvm {
@@ -15,6 +16,10 @@ namespace llair {
 
 class LLAIRContextImpl;
 
+// Owns the LLAIR state (interfaces, entry points, names, ...) associated with an
+// llvm::LLVMContext. Like llvm::LLVMContext, an LLAIRContext and everything created in it must
+// only be used by one thread at a time, but distinct contexts can be created, used and destroyed
+// concurrently from different threads.
 class LLAIRContext {
 public:
     static LLAIRContext *      Get(llvm::LLVMContext *);
@@ -29,6 +34,29 @@ public:
     const llvm::DataLayout&  getDataLayout() const;
     llvm::StringRef          getTargetTriple() const;
 
+    // LLVM never frees the types, uniqued metadata and constants that are created in an
+    // llvm::LLVMContext, so a long-lived context keeps growing as modules come and go. LLVM doesn't
+    // say how much its context holds, so these figures count only what the live modules reach:
+    // the growth shows as modules_created outpacing modules, not in the other counts. Together
+    // they help decide when to move the live modules to a fresh context (see
+    // llair::recycleModules()):
+    struct Statistics {
+        // Live modules, and what is reachable from them:
+        std::size_t modules        = 0;
+        std::size_t types          = 0;
+        std::size_t metadata_nodes = 0;
+        std::size_t constants      = 0;
+
+        // Interned for the lifetime of the context:
+        std::size_t interfaces = 0;
+
+        // Modules created in the context so far, including those that are gone:
+        std::size_t modules_created = 0;
+    };
+
+    // Walks every live module; not cheap:
+    Statistics getStatistics() const;
+
 private:
     std::unique_ptr<LLAIRContextImpl> d_impl;
 
@@ -2,9 +2,12 @@
 #ifndef LLAIR_IR_MODULE_H
 #define LLAIR_IR_MODULE_H
 
+#include <llair/IR/Arena.h>
 #include <llair/IR/LLAIRContext.h>
 #include <llair/IR/SymbolTable.h>
 
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ADT/Twine.h>
 #include <llvm/ADT/ilist.h>
@@ -16,6 +19,7 @@
 namespace llvm {
 class LLVMContext;
 class Module;
+class NamedMDNode;
 class ValueSymbolTable;
 class raw_ostream;
 } // End namespace llvm
@@ -73,6 +77,17 @@ public:
     llvm::Module *                getLLModule() { return d_llmodule.get(); }
     std::unique_ptr<llvm::Module> releaseLLModule();
 
+    // Records which functions are class methods in 'llair.abi_index', so that the ABI needn't be
+    // demangled again when the module is loaded; the index is ignored once the module's functions
+    // change. writeBitcode() calls this:
+    void updateABIIndex();
+
+    // Reads the function bodies that were left in the bitcode by getLazyBitcodeModule():
+    llvm::Error materializeAll();
+
+    // Backs the member arrays of this module's classes, dispatchers and entry points:
+    Arena &getArena() { return *d_arena; }
+
     //
     struct Version {
         int major = 0, minor = 0, patch = 0;
@@ -158,20 +173,50 @@ public:
 
     std::pair<DispatcherSetType::const_iterator, DispatcherSetType::const_iterator> getOrInsertDispatchers(Interface *);
 
-    //
+    // Creates objects for named metadata operands that were added since the last sync (e.g., by
+    // the linker):
     void syncMetadata();
 
+    // Reconciles every named metadata operand with the object lists; use after the named
+    // metadata has been edited directly:
+    void resyncMetadata();
+
+    // Removes the null operands that removed objects leave in the named metadata; call before
+    // serializing the module:
+    void compactMetadata();
+
+    // Also sorts the globals by name, and the operands of the named metadata that lists entry
+    // points, classes and dispatchers by their contents, so that the bitcode doesn't depend on the
+    // order in which they were created (e.g., the order of llair-link's inputs):
+    void canonicalize();
+
+    // Hashes what the module means, rather than how it happens to be laid out: the names of local
+    // values, the order of globals, and the order of entry points, classes and dispatchers don't
+    // matter. Reads the bodies of lazily loaded functions, and fails if they can't be read:
+    llvm::Expected<uint64_t> structuralHash() const;
+
     void print(llvm::raw_ostream&) const;
 
     void dump() const;
 
 private:
 
+    void syncMetadata(bool full);
+    unsigned appendMetadataOperand(llvm::NamedMDNode *, llvm::MDNode *);
+    void     removeMetadataOperand(llvm::NamedMDNode *, llvm::MDNode *, llvm::Optional<unsigned>);
+
     LLAIRContext &                d_context;
     std::unique_ptr<llvm::Module> d_llmodule;
 
+    llvm::IntrusiveRefCntPtr<Arena> d_arena = { new Arena() };
+
     llvm::TypedTrackingMDRef<llvm::MDTuple> d_version_md, d_language_md;
 
+    // Number of operands of each named metadata node that have been reconciled with the object
+    // lists:
+    llvm::StringMap<unsigned> d_synced_metadata_operands;
+    bool                      d_metadata_dirty = false;
+
     EntryPointListType d_entry_points;
 
     ClassListType d_classes;
@@ -183,6 +228,7 @@ private:
     DispatcherMapType d_dispatchers_by_interface;
 
     friend class Dispatcher;
+    friend class EntryPoint;
 };
 
 template<typename T>
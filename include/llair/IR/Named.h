@@ -2,13 +2,10 @@
 #ifndef LLAIR_IR_NAMED_H
 #define LLAIR_IR_NAMED_H
 
+#include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/Allocator.h>
 
-namespace llvm {
-template<typename ValueTy> class StringMapEntry;
-}
-
 namespace llair {
 
 class LLAIRContext;
@@ -22,13 +19,17 @@ public:
 
     virtual ~Named();
 
-    bool hasName() const { return d_has_name; }
+    bool hasName() const { return d_symbol_table_entry != nullptr; }
 
-    void setSymbolTableEntry(SymbolTableEntry *);
-    SymbolTableEntry *getSymbolTableEntry() const;
+    void setSymbolTableEntry(SymbolTableEntry *entry) { d_symbol_table_entry = entry; }
+    SymbolTableEntry *getSymbolTableEntry() const { return d_symbol_table_entry; }
 
     void setName(llvm::StringRef);
-    llvm::StringRef getName() const;
+
+    // Inline, as it's called for every comparison of names (e.g., when classes are sorted):
+    llvm::StringRef getName() const {
+        return d_symbol_table_entry ? d_symbol_table_entry->getKey() : llvm::StringRef("", 0);
+    }
 
     virtual void dump() const = 0;
 
@@ -36,7 +37,7 @@ private:
 
     virtual LLAIRContext& getContext() const = 0;
 
-    bool d_has_name = false;
+    SymbolTableEntry *d_symbol_table_entry = nullptr;
 
 protected:
 
@@ -7,6 +7,7 @@
 #include <llvm/ADT/Hashing.h>
 #include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Error.h>
 
 namespace llvm {
 class Function;
@@ -17,13 +18,22 @@ class Type;
 
 namespace llair {
 
+class Archive;
 class Class;
 class Interface;
 class LLAIRContext;
 class Module;
 
 void linkModules(Module *, const Module *);
-void finalizeInterfaces(Module *, llvm::ArrayRef<Interface *>, std::function<uint32_t(const Class*)>);
+
+// Links the members of the archive that define functions which the module declares, as a static
+// library would be, and the members with classes that implement the interfaces it declares,
+// repeating until no more members are needed. The classes, entry points and functions that are
+// named are linked too, even if nothing refers to them:
+llvm::Error linkArchive(Module *, const Archive &, llvm::ArrayRef<llvm::StringRef> = {});
+
+// Fails if the body of a dispatcher method can't be read:
+llvm::Error finalizeInterfaces(Module *, llvm::ArrayRef<Interface *>, std::function<uint32_t(const Class*)>);
 
 class Linker {
 public:
@@ -8,6 +8,7 @@
 #include <llvm/Support/MemoryBuffer.h>
 
 #include <memory>
+#include <vector>
 
 namespace llair {
 class LLAIRContext;
@@ -15,9 +16,51 @@ class Module;
 
 void setPathToCompileTool(llvm::StringRef path);
 
+// Enables caching of compileBuffer() results in the given directory; it can also be set via the
+// LLAIR_COMPILE_CACHE_PATH environment variable. Entries are keyed by the source, the options,
+// and the path to and version of the tools:
+void setCompileCachePath(llvm::StringRef path);
+
+// Bounds the size of the compile cache, using llvm::parseCachePruningPolicy() syntax (e.g.,
+// "cache_size_bytes=256m:prune_after=168h"); it can also be set via the
+// LLAIR_COMPILE_CACHE_POLICY environment variable. The default bounds the cache to 1GB:
+llvm::Error setCompileCachePolicy(llvm::StringRef policy);
+
+enum class CompileBackend {
+    // The backend set by setCompileBackend(), or via the LLAIR_COMPILE_BACKEND environment
+    // variable ('process' or 'in-process'); Process, if neither is set:
+    Default,
+
+    // Runs `metal` as a child process, and loads the bitcode that it writes:
+    Process,
+
+    // Runs clang in this process, generating code directly into the context's LLVMContext. The
+    // options are the same as Process's, which clang's driver translates; those that it doesn't
+    // know are errors. Only available if LLAIR was built with clang:
+    InProcess
+};
+
+void setCompileBackend(CompileBackend backend);
+
+// Whether LLAIR was built with clang:
+bool isInProcessCompileAvailable();
+
 llvm::Expected<std::unique_ptr<Module>> compileBuffer(llvm::MemoryBufferRef           buffer,
                                                       llvm::ArrayRef<llvm::StringRef> options,
-                                                      LLAIRContext &                  context);
+                                                      LLAIRContext &                  context,
+                                                      CompileBackend backend = CompileBackend::Default);
+
+struct CompileInput {
+    llvm::MemoryBufferRef           buffer;
+    llvm::ArrayRef<llvm::StringRef> options;
+};
+
+// Compiles many buffers, amortizing the compiler's startup cost: inputs with the same options are
+// compiled by a single invocation. The results are in the same order as the inputs; an input that
+// fails to compile is retried on its own, so that the error is reported against it:
+std::vector<llvm::Expected<std::unique_ptr<Module>>>
+compileBuffers(llvm::ArrayRef<CompileInput> inputs, LLAIRContext &context,
+               CompileBackend backend = CompileBackend::Default);
 
 } // End namespace llair
 
@@ -0,0 +1,117 @@
+//-*-C++-*-
+#ifndef LLAIR_COMPILESCHEDULER_H
+#define LLAIR_COMPILESCHEDULER_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace llair {
+class LLAIRContext;
+class Module;
+
+// Runs compileBuffer() for many sources on a fixed number of worker threads, so that up to that
+// many compiler processes run at once. Jobs with a higher priority are started first; jobs with
+// the same priority are started in the order that they were submitted.
+//
+// The compiler runs without touching any LLAIRContext, but each job's output is loaded into the
+// context it was submitted with, on a worker thread. The scheduler serializes the loading (and
+// the callbacks) of the jobs that share a context, but it can't serialize them with the caller:
+// a context must not be used outside of the callbacks while jobs that target it are outstanding.
+class CompileScheduler {
+public:
+
+    using Result   = llvm::Expected<std::unique_ptr<Module>>;
+    using Callback = std::function<void(Result)>;
+    using JobID    = std::uint64_t;
+
+    // Zero means one worker per hardware thread:
+    explicit CompileScheduler(unsigned concurrency = 0);
+
+    // Cancels the jobs that haven't started, and waits for the rest:
+    ~CompileScheduler();
+
+    CompileScheduler(const CompileScheduler&) = delete;
+    CompileScheduler& operator=(const CompileScheduler&) = delete;
+
+    unsigned getConcurrency() const { return d_workers.size(); }
+
+    // The buffer and options are copied. The callback is called exactly once, on a worker thread
+    // (or on the thread that cancels the job):
+    JobID submit(llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> options,
+                 LLAIRContext &context, Callback callback, int priority = 0);
+
+    struct Job {
+        JobID               id;
+        std::future<Result> result;
+    };
+
+    Job submit(llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> options,
+               LLAIRContext &context, int priority = 0);
+
+    // Removes a job that hasn't started; its result is an error with
+    // std::errc::operation_canceled. Returns false if the job has started, or is unknown:
+    bool cancel(JobID id);
+
+    // Waits until every submitted job has finished or been cancelled:
+    void wait();
+
+private:
+
+    struct Work {
+        std::unique_ptr<llvm::MemoryBuffer> buffer;
+        std::vector<std::string>            options;
+        LLAIRContext *                      context;
+        Callback                            callback;
+    };
+
+    // Higher priorities first, then first-in first-out:
+    using QueueKey = std::pair<int, JobID>;
+
+    struct QueueOrder {
+        bool operator()(const QueueKey& lhs, const QueueKey& rhs) const {
+            return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
+        }
+    };
+
+    void run();
+
+    void perform(Work& work);
+
+    // Work items that use the same context are serialized by its mutex, which exists while any
+    // of them is being performed:
+    struct ContextState {
+        std::mutex mutex;
+        unsigned   users = 0;
+    };
+
+    std::mutex& acquireContextMutex(LLAIRContext *context);
+    void        releaseContextMutex(LLAIRContext *context);
+
+    std::mutex                                           d_mutex;
+    std::condition_variable                              d_queued, d_idle;
+    std::map<QueueKey, Work, QueueOrder>                 d_queue;
+    llvm::DenseMap<JobID, int>                           d_priorities;
+    llvm::DenseMap<LLAIRContext *, std::unique_ptr<ContextState>> d_contexts;
+    JobID                                                d_next_id = 0;
+    unsigned                                             d_running = 0;
+    bool                                                 d_stopping = false;
+    std::vector<std::thread>                             d_workers;
+};
+
+} // End namespace llair
+
+#endif
@@ -2,22 +2,95 @@
 #ifndef LLAIR_MAKELIBRARY_H
 #define LLAIR_MAKELIBRARY_H
 
+#include <llvm/ADT/Optional.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/Error.h>
 #include <llvm/Support/MemoryBuffer.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <string>
+
+namespace llvm {
+class raw_ostream;
+} // End namespace llvm
 
 namespace llair {
 class Module;
 
 void setPathToLibraryTool(llvm::StringRef path);
 
+// Enables caching of makeLibrary(const Module&) and makeLibraryWithLLD(const Module&) results in
+// the given directory; it can also be set via the LLAIR_LIBRARY_CACHE_PATH environment variable.
+// Entries are keyed by the module's contents, the FinalizeOptions and the LLVM version (and, for
+// makeLibraryWithLLD(), the path to and version of the tools):
+void setLibraryCachePath(llvm::StringRef path);
+
+// Bounds the size of the library cache, like setCompileCachePolicy(); it can also be set via the
+// LLAIR_LIBRARY_CACHE_POLICY environment variable. The default bounds the cache to 1GB:
+llvm::Error setLibraryCachePolicy(llvm::StringRef policy);
+
+// Bounds the in-memory cache of recently made libraries, which is checked before the directory;
+// zero disables it. The default is 64MB:
+void setLibraryMemoryCacheSize(std::size_t bytes);
+
+struct LibraryCacheStatistics {
+    uint64_t memory_hits = 0;
+    uint64_t disk_hits   = 0;
+    uint64_t misses      = 0;
+};
+
+LibraryCacheStatistics getLibraryCacheStatistics();
+
+// How finalizeLibrary() optimizes the library; lower levels trade the quality of the code for
+// shorter builds. The defaults are what finalizeLibrary() has always done, level 3 at size level 1.
+// Only levels 0 and 1 build several times faster than that: level 0 runs little more than the
+// always-inliner, and level 1 simplifies each function once, without the full inliner; levels 2
+// and 3 take about as long as the default:
+struct FinalizeOptions {
+    // As with clang's -O0 to -O3:
+    unsigned             opt_level  = 3;
+
+    // As with -Os (1) and -Oz (2), at levels 2 and 3 only. The legacy pass manager (LLVM 12 and
+    // earlier) combines them with the level. The new one can't: like clang, it runs -Oz at level
+    // 2, whatever `opt_level` is, and -Os at level 2 only, so that level 3 (and the default) runs
+    // its own pipeline:
+    unsigned             size_level = 1;
+
+    // Override whether the levels enable these passes:
+    llvm::Optional<bool> loop_vectorization;
+    llvm::Optional<bool> slp_vectorization;
+    llvm::Optional<bool> loop_unrolling;
+    llvm::Optional<bool> loop_interleaving;
+
+    // Replaces the levels' pipeline with one in `opt -passes=` syntax, e.g.
+    // "function(sroa,instcombine)":
+    std::string          pipeline;
+
+    // If not null, the time that each pass took is reported to it:
+    llvm::raw_ostream   *time_passes = nullptr;
+
+    // Optimizes what each entry point reaches separately, on a thread and in an LLVMContext of its
+    // own, and then links the results; a function that several entry points call is copied into,
+    // and optimized for, each of them. Zero threads means one per hardware thread:
+    bool                 partition         = false;
+    unsigned             partition_threads = 0;
+};
+
 std::unique_ptr<llvm::Module> finalizeLibrary(const Module&);
 
+// Fails if `pipeline` can't be parsed:
+llvm::Expected<std::unique_ptr<llvm::Module>> finalizeLibrary(const Module&, const FinalizeOptions&);
+
 llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> makeLibrary(const llvm::Module &module);
 llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> makeLibrary(const Module &module);
 
+// Finalizes the module with the options; the options are part of the cache key, but a library
+// whose passes are timed is always made:
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> makeLibrary(const Module &module,
+                                                                const FinalizeOptions &options);
+
 llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> makeLibraryWithLLD(const llvm::Module &module);
 llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> makeLibraryWithLLD(const Module &module);
 
@@ -0,0 +1,101 @@
+//-*-C++-*-
+#ifndef LLAIR_PIPELINE_H
+#define LLAIR_PIPELINE_H
+
+#include <llair/Tools/Compile.h>
+#include <llair/Tools/MakeLibrary.h>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/ThreadPool.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llair {
+class Class;
+
+struct PipelineOptions {
+    // The name of the linked module:
+    std::string                          name = "library";
+
+    // Assigns the kinds passed to finalizeInterfaces(); it's called on a worker thread. By
+    // default, classes are numbered in the order that they're first seen:
+    std::function<uint32_t(const Class*)> class_kinds;
+
+    // How finalizeLibrary() optimizes the linked module; `finalize.time_passes` is written to on a
+    // worker thread:
+    FinalizeOptions                      finalize;
+
+    // Use makeLibraryWithLLD() rather than makeLibrary():
+    bool                                 use_lld = false;
+};
+
+struct PipelineTimings {
+    using Duration = std::chrono::steady_clock::duration;
+
+    // One per source, including time spent looking in the compile cache:
+    std::vector<Duration> compile;
+
+    // Loading the compiled bitcode, and linkModules():
+    Duration              link                = Duration::zero();
+    Duration              finalize_interfaces = Duration::zero();
+    Duration              finalize_library    = Duration::zero();
+    Duration              make_library        = Duration::zero();
+
+    // From submission until the result is delivered:
+    Duration              total               = Duration::zero();
+};
+
+struct PipelineResult {
+    llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> library;
+    PipelineTimings                                     timings;
+};
+
+// Turns sources into a metal library, off the calling thread:
+//
+//     compileBuffer() -> linkModules() -> finalizeInterfaces() -> finalizeLibrary() -> makeLibrary()
+//
+// Each stage is a task that's queued on a shared pool of worker threads once the stages it depends
+// on have finished: the sources of a library are compiled concurrently, and the stages of different
+// libraries overlap, so that the compiler for one library runs while another is being optimized.
+// Each library is built in an LLAIRContext of its own, which is destroyed once it's done.
+class Pipeline {
+public:
+
+    using Callback = std::function<void(PipelineResult)>;
+
+    // Zero means one worker per hardware thread:
+    explicit Pipeline(unsigned concurrency = 0);
+
+    // Waits for the libraries that have been submitted:
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // The sources and options are copied. The callback is called on a worker thread:
+    void submit(llvm::ArrayRef<CompileInput> sources, const PipelineOptions& options,
+                Callback callback);
+
+    std::future<PipelineResult> submit(llvm::ArrayRef<CompileInput> sources,
+                                       const PipelineOptions& options = PipelineOptions());
+
+    // Waits until every submitted library has been delivered:
+    void wait();
+
+private:
+
+    llvm::ThreadPool d_pool;
+};
+
+} // End namespace llair
+
+#endif
@@ -4,10 +4,12 @@
 
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Error.h>
 #include <llvm/Support/ErrorOr.h>
 #include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/Program.h>
 
+#include <chrono>
 #include <memory>
 #include <string>
 
@@ -31,12 +33,41 @@ struct Program {
 
     std::unique_ptr<llvm::raw_fd_ostream> input;
     int                                   output;
+
+    // The program's standard error, or -1 if it's inherited:
+    int                                   error;
+
+    std::string                           path;
 };
 
-llvm::ErrorOr<Program> openProgram(const std::string& path, llvm::ArrayRef<std::string> args);
+// If `directory` isn't empty, the program runs with it as its working directory. The program
+// must be passed to closeProgram():
+llvm::ErrorOr<Program> openProgram(const std::string& path, llvm::ArrayRef<std::string> args,
+                                   llvm::StringRef directory = "", bool capture_error = false);
 
-llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
-runProgram(const std::string& path, llvm::ArrayRef<std::string> args, llvm::MemoryBufferRef input);
+// Closes the program's streams and waits for it to exit. Fails unless it exited with status 0;
+// the error includes its standard error, if that was captured:
+llvm::Error closeProgram(Program& program);
+
+struct ProgramOptions {
+    // If not empty, the program runs with this as its working directory:
+    llvm::StringRef           directory;
+
+    // If not null, the program's standard error is collected here; otherwise, it's written to
+    // llvm::errs() if the program succeeds:
+    std::string *             diagnostics = nullptr;
+
+    // If not zero, the program is killed once it has run for this long, and runProgram() fails
+    // with std::errc::timed_out:
+    std::chrono::milliseconds timeout = std::chrono::milliseconds::zero();
+};
+
+// Writes `input` to the program while reading its output, so that a program that produces output
+// before it has consumed all of its input can't deadlock with the caller. The program is reaped;
+// unless it exits with status 0, the result is an error that includes its standard error:
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+runProgram(const std::string& path, llvm::ArrayRef<std::string> args, llvm::MemoryBufferRef input,
+           const ProgramOptions& options = ProgramOptions());
 
 } // End namespace llair
 
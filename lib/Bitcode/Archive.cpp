@@ -0,0 +1,452 @@
+#include <llair/Bitcode/Archive.h>
+#include <llair/Bitcode/Bitcode.h>
+#include <llair/IR/Class.h>
+#include <llair/IR/EntryPoint.h>
+#include <llair/IR/Interface.h>
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+namespace llair {
+
+namespace {
+
+const char     kMagic[]        = { 'L', 'L', 'A', 'I', 'R', 'A', 'R', '\0' };
+const uint32_t kVersion        = 1;
+
+const std::size_t kHeaderSize  = sizeof(kMagic) + 4 * sizeof(uint32_t);
+const std::size_t kMemberSize  = 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+const std::size_t kSymbolSize  = 4 * sizeof(uint32_t);
+const std::size_t kAlignment   = 8;
+
+uint32_t
+read32(const char *p) {
+    return llvm::support::endian::read32le(p);
+}
+
+uint64_t
+read64(const char *p) {
+    return llvm::support::endian::read64le(p);
+}
+
+void
+write32(llvm::raw_ostream& os, uint32_t value) {
+    char bytes[sizeof(uint32_t)];
+    llvm::support::endian::write32le(bytes, value);
+    os.write(bytes, sizeof(bytes));
+}
+
+void
+write64(llvm::raw_ostream& os, uint64_t value) {
+    char bytes[sizeof(uint64_t)];
+    llvm::support::endian::write64le(bytes, value);
+    os.write(bytes, sizeof(bytes));
+}
+
+llvm::Error
+makeMalformedError(llvm::StringRef identifier, const char *what) {
+    return llvm::createStringError(std::errc::illegal_byte_sequence, "malformed archive '%s': %s",
+                                   identifier.str().c_str(), what);
+}
+
+struct Symbol {
+    Archive::SymbolKind kind;
+    std::string         name;
+    uint32_t            member;
+};
+
+// Collects the symbols that the module provides, among them the interfaces that its classes
+// implement:
+void
+getSymbols(const Module& module, uint32_t member, llvm::ArrayRef<Interface *> interfaces,
+           std::vector<Symbol>& symbols) {
+    std::for_each(
+        module.getLLModule()->begin(), module.getLLModule()->end(),
+        [member, &symbols](const auto& function) -> void {
+            if (function.isDeclaration() || function.hasLocalLinkage()) {
+                return;
+            }
+
+            symbols.push_back({ Archive::SymbolKind::Function, function.getName().str(), member });
+        });
+
+    std::for_each(
+        module.class_begin(), module.class_end(),
+        [member, interfaces, &symbols](const auto& klass) -> void {
+            symbols.push_back({ Archive::SymbolKind::Class, klass.getName().str(), member });
+
+            std::for_each(
+                interfaces.begin(), interfaces.end(),
+                [member, &symbols, &klass](auto interface) -> void {
+                    auto name = Archive::getInterfaceSymbol(interface);
+
+                    if (name.empty() || !klass.doesImplement(interface)) {
+                        return;
+                    }
+
+                    symbols.push_back({ Archive::SymbolKind::Interface, name, member });
+                });
+        });
+
+    std::for_each(
+        module.entry_point_begin(), module.entry_point_end(),
+        [member, &symbols](const auto& entry_point) -> void {
+            symbols.push_back({ Archive::SymbolKind::EntryPoint, entry_point.getName().str(), member });
+        });
+}
+
+} // namespace
+
+bool
+Archive::isArchive(llvm::MemoryBufferRef buffer) {
+    return buffer.getBuffer().startswith(llvm::StringRef(kMagic, sizeof(kMagic)));
+}
+
+llvm::Expected<std::unique_ptr<Archive>>
+Archive::create(std::unique_ptr<llvm::MemoryBuffer> buffer) {
+    std::unique_ptr<Archive> archive(new Archive(std::move(buffer)));
+
+    if (auto error = archive->parse()) {
+        return error;
+    }
+
+    return archive;
+}
+
+llvm::Expected<std::unique_ptr<Archive>>
+Archive::open(llvm::StringRef path) {
+    // Large files are mapped; the members needn't be null-terminated:
+#if LLVM_VERSION_MAJOR >= 13
+    auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText=*/false,
+                                              /*RequiresNullTerminator=*/false);
+#else
+    auto buffer = llvm::MemoryBuffer::getFile(path, /*FileSize=*/-1,
+                                              /*RequiresNullTerminator=*/false);
+#endif
+
+    if (!buffer) {
+        return llvm::createStringError(buffer.getError(), "unable to open '%s'",
+                                       path.str().c_str());
+    }
+
+    return create(std::move(*buffer));
+}
+
+llvm::Error
+Archive::write(llvm::ArrayRef<Module *> modules, llvm::raw_ostream& os) {
+    std::vector<llvm::SmallVector<char, 0>> bitcodes(modules.size());
+    std::vector<Symbol>                     symbols;
+
+    // Interfaces are found by their declarations, and any member may declare them:
+    std::vector<Interface *>          interfaces;
+    llvm::SmallPtrSet<Interface *, 8> found_interfaces;
+
+    std::for_each(
+        modules.begin(), modules.end(),
+        [&interfaces, &found_interfaces](auto module) -> void {
+            auto module_interfaces = module->getAllInterfacesFromABI();
+
+            std::copy_if(
+                module_interfaces.begin(), module_interfaces.end(),
+                std::back_inserter(interfaces),
+                [&found_interfaces](auto interface) -> bool {
+                    return found_interfaces.insert(interface).second;
+                });
+        });
+
+    for (uint32_t member = 0, n = modules.size(); member < n; ++member) {
+        auto module = modules[member];
+
+        llvm::raw_svector_ostream bitcode_os(bitcodes[member]);
+
+        if (auto error = writeBitcode(*module, bitcode_os)) {
+            return error;
+        }
+
+        getSymbols(*module, member, interfaces, symbols);
+    }
+
+    // The reader finds a symbol by binary search; where members provide the same symbol, the first
+    // one wins, as it would for a static library. An interface keeps every member that implements
+    // it, once:
+    std::stable_sort(
+        symbols.begin(), symbols.end(),
+        [](const auto& lhs, const auto& rhs) -> bool {
+            return std::tie(lhs.kind, lhs.name) < std::tie(rhs.kind, rhs.name);
+        });
+
+    symbols.erase(
+        std::unique(
+            symbols.begin(), symbols.end(),
+            [](const auto& lhs, const auto& rhs) -> bool {
+                return lhs.kind == rhs.kind && lhs.name == rhs.name &&
+                       (lhs.kind != Archive::SymbolKind::Interface || lhs.member == rhs.member);
+            }),
+        symbols.end());
+
+    // Lay out the string table:
+    std::string           strings;
+    std::vector<uint32_t> member_name_offsets, symbol_name_offsets;
+
+    std::for_each(
+        modules.begin(), modules.end(),
+        [&strings, &member_name_offsets](auto module) -> void {
+            member_name_offsets.push_back(strings.size());
+            strings += module->getLLModule()->getModuleIdentifier();
+        });
+
+    std::for_each(
+        symbols.begin(), symbols.end(),
+        [&strings, &symbol_name_offsets](const auto& symbol) -> void {
+            symbol_name_offsets.push_back(strings.size());
+            strings += symbol.name;
+        });
+
+    auto align = [](uint64_t offset) -> uint64_t {
+        return (offset + kAlignment - 1) & ~uint64_t(kAlignment - 1);
+    };
+
+    uint64_t offset = align(kHeaderSize + modules.size() * kMemberSize +
+                            symbols.size() * kSymbolSize + strings.size());
+
+    // Header:
+    os.write(kMagic, sizeof(kMagic));
+    write32(os, kVersion);
+    write32(os, modules.size());
+    write32(os, symbols.size());
+    write32(os, strings.size());
+
+    // Members:
+    std::vector<uint64_t> member_offsets;
+
+    for (std::size_t member = 0, n = modules.size(); member < n; ++member) {
+        auto name = modules[member]->getLLModule()->getModuleIdentifier();
+
+        member_offsets.push_back(offset);
+
+        write64(os, offset);
+        write64(os, bitcodes[member].size());
+        write32(os, member_name_offsets[member]);
+        write32(os, name.size());
+
+        offset = align(offset + bitcodes[member].size());
+    }
+
+    // Symbols:
+    for (std::size_t index = 0, n = symbols.size(); index < n; ++index) {
+        const auto& symbol = symbols[index];
+
+        write32(os, symbol_name_offsets[index]);
+        write32(os, symbol.name.size());
+        write32(os, static_cast<uint32_t>(symbol.kind));
+        write32(os, symbol.member);
+    }
+
+    os << strings;
+
+    // Bitcode:
+    uint64_t position = kHeaderSize + modules.size() * kMemberSize +
+                        symbols.size() * kSymbolSize + strings.size();
+
+    static const char padding[kAlignment] = {};
+
+    for (std::size_t member = 0, n = modules.size(); member < n; ++member) {
+        os.write(padding, member_offsets[member] - position);
+        os.write(bitcodes[member].data(), bitcodes[member].size());
+
+        position = member_offsets[member] + bitcodes[member].size();
+    }
+
+    return llvm::Error::success();
+}
+
+std::string
+Archive::getInterfaceSymbol(const Interface *interface) {
+    auto type = interface->getType();
+
+    if (!type->hasName()) {
+        return {};
+    }
+
+    // A type whose name is taken is renamed with a '.' and a number:
+    auto name = type->getName();
+
+    while (true) {
+        auto [ prefix, suffix ] = name.rsplit('.');
+
+        if (suffix.empty() || prefix == name ||
+            !std::all_of(suffix.begin(), suffix.end(), [](char c) -> bool { return llvm::isDigit(c); })) {
+            break;
+        }
+
+        name = prefix;
+    }
+
+    return name.str();
+}
+
+Archive::Archive(std::unique_ptr<llvm::MemoryBuffer> buffer)
+    : d_buffer(std::move(buffer)) {
+}
+
+Archive::~Archive() {
+}
+
+llvm::Error
+Archive::parse() {
+    auto data       = d_buffer->getBuffer();
+    auto identifier = d_buffer->getBufferIdentifier();
+
+    if (data.size() < kHeaderSize || !isArchive(d_buffer->getMemBufferRef())) {
+        return makeMalformedError(identifier, "bad magic");
+    }
+
+    auto header = data.data() + sizeof(kMagic);
+
+    if (read32(header) != kVersion) {
+        return makeMalformedError(identifier, "unsupported version");
+    }
+
+    d_member_count = read32(header + 4);
+    d_symbol_count = read32(header + 8);
+
+    uint64_t strings_size = read32(header + 12);
+
+    uint64_t members_offset = kHeaderSize;
+    uint64_t symbols_offset = members_offset + uint64_t(d_member_count) * kMemberSize;
+    uint64_t strings_offset = symbols_offset + uint64_t(d_symbol_count) * kSymbolSize;
+
+    if (strings_offset + strings_size > data.size()) {
+        return makeMalformedError(identifier, "truncated tables");
+    }
+
+    d_members = data.data() + members_offset;
+    d_symbols = data.data() + symbols_offset;
+    d_strings = data.substr(strings_offset, strings_size);
+
+    // Check every reference once, so that the accessors needn't:
+    for (unsigned member = 0; member < d_member_count; ++member) {
+        auto entry = d_members + member * kMemberSize;
+
+        auto offset = read64(entry), size = read64(entry + 8);
+
+        if (offset > data.size() || size > data.size() - offset) {
+            return makeMalformedError(identifier, "member out of range");
+        }
+
+        if (uint64_t(read32(entry + 16)) + read32(entry + 20) > d_strings.size()) {
+            return makeMalformedError(identifier, "member name out of range");
+        }
+    }
+
+    for (unsigned symbol = 0; symbol < d_symbol_count; ++symbol) {
+        auto entry = d_symbols + symbol * kSymbolSize;
+
+        if (uint64_t(read32(entry)) + read32(entry + 4) > d_strings.size()) {
+            return makeMalformedError(identifier, "symbol name out of range");
+        }
+
+        if (read32(entry + 12) >= d_member_count) {
+            return makeMalformedError(identifier, "symbol member out of range");
+        }
+    }
+
+    return llvm::Error::success();
+}
+
+llvm::StringRef
+Archive::getString(uint32_t offset, uint32_t size) const {
+    return d_strings.substr(offset, size);
+}
+
+llvm::StringRef
+Archive::getMemberName(unsigned member) const {
+    auto entry = d_members + member * kMemberSize;
+    return getString(read32(entry + 16), read32(entry + 20));
+}
+
+llvm::MemoryBufferRef
+Archive::getMemberBuffer(unsigned member) const {
+    auto entry = d_members + member * kMemberSize;
+    return llvm::MemoryBufferRef(d_buffer->getBuffer().substr(read64(entry), read64(entry + 8)),
+                                 getMemberName(member));
+}
+
+llvm::Expected<std::unique_ptr<Module>>
+Archive::getMemberModule(unsigned member, LLAIRContext& context) const {
+    return getLazyBitcodeModule(
+        llvm::MemoryBuffer::getMemBuffer(getMemberBuffer(member), false), context);
+}
+
+unsigned
+Archive::findSymbol(SymbolKind kind, llvm::StringRef name) const {
+    auto key = std::make_tuple(static_cast<uint32_t>(kind), name);
+
+    auto symbol = [this](unsigned index) -> std::tuple<uint32_t, llvm::StringRef> {
+        auto entry = d_symbols + index * kSymbolSize;
+        return std::make_tuple(read32(entry + 8), getString(read32(entry), read32(entry + 4)));
+    };
+
+    unsigned first = 0, count = d_symbol_count;
+
+    while (count > 0) {
+        auto step = count / 2;
+
+        if (symbol(first + step) < key) {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else {
+            count = step;
+        }
+    }
+
+    return first;
+}
+
+bool
+Archive::isSymbol(unsigned index, SymbolKind kind, llvm::StringRef name) const {
+    if (index >= d_symbol_count) {
+        return false;
+    }
+
+    auto entry = d_symbols + index * kSymbolSize;
+    return read32(entry + 8) == static_cast<uint32_t>(kind) &&
+           getString(read32(entry), read32(entry + 4)) == name;
+}
+
+llvm::Optional<unsigned>
+Archive::lookup(SymbolKind kind, llvm::StringRef name) const {
+    auto index = findSymbol(kind, name);
+
+    if (!isSymbol(index, kind, name)) {
+        return {};
+    }
+
+    return read32(d_symbols + index * kSymbolSize + 12);
+}
+
+llvm::SmallVector<unsigned, 4>
+Archive::lookupAll(SymbolKind kind, llvm::StringRef name) const {
+    llvm::SmallVector<unsigned, 4> members;
+
+    for (auto index = findSymbol(kind, name); isSymbol(index, kind, name); ++index) {
+        members.push_back(read32(d_symbols + index * kSymbolSize + 12));
+    }
+
+    return members;
+}
+
+} // End namespace llair
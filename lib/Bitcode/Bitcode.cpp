@@ -2,7 +2,10 @@
 #include <llair/IR/LLAIRContext.h>
 #include <llair/IR/Module.h>
 
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Support/raw_ostream.h>
 
 namespace llair {
 
@@ -26,4 +29,69 @@ getBitcodeModule(llvm::MemoryBufferRef bitcode, LLAIRContext &context) {
     return module;
 }
 
+llvm::Expected<std::unique_ptr<llair::Module>>
+getLazyBitcodeModule(std::unique_ptr<llvm::MemoryBuffer> bitcode, LLAIRContext &context) {
+
+    auto llmodule = llvm::getOwningLazyBitcodeModule(std::move(bitcode), context.getLLContext());
+
+    if (!llmodule) {
+        return llmodule.takeError();
+    }
+
+    auto module = std::make_unique<llair::Module>(std::move(*llmodule));
+
+    return module;
+}
+
+llvm::Error
+writeBitcode(Module &module, llvm::raw_ostream &os) {
+    if (auto error = module.materializeAll()) {
+        return error;
+    }
+
+    module.compactMetadata();
+    module.updateABIIndex();
+
+#if LLVM_VERSION_MAJOR >= 8
+    llvm::WriteBitcodeToFile(*module.getLLModule(), os);
+#else
+    llvm::WriteBitcodeToFile(module.getLLModule(), os);
+#endif
+
+    return llvm::Error::success();
+}
+
+llvm::Error
+recycleModules(std::vector<std::unique_ptr<llair::Module>> &modules, LLAIRContext &context) {
+    llvm::SmallVector<char, 0> buffer;
+
+    for (auto &module : modules) {
+        if (!module) {
+            continue;
+        }
+
+        auto identifier = module->getLLModule()->getModuleIdentifier();
+
+        buffer.clear();
+        llvm::raw_svector_ostream os(buffer);
+
+        if (auto error = writeBitcode(*module, os)) {
+            return error;
+        }
+
+        auto recycled = getBitcodeModule(
+            llvm::MemoryBufferRef(llvm::StringRef(buffer.data(), buffer.size()), identifier),
+            context);
+
+        if (!recycled) {
+            return recycled.takeError();
+        }
+
+        // At most two copies of one module are alive at a time:
+        module = std::move(*recycled);
+    }
+
+    return llvm::Error::success();
+}
+
 } // End namespace llair
@@ -29,6 +29,10 @@ module_ilist_traits<llair::Class>::removeNodeFromList(llair::Class *klass) {
 Class::Class(llvm::StructType *type, llvm::ArrayRef<llvm::StringRef> names, llvm::ArrayRef<llvm::Function *> functions, llvm::StringRef name, Module *module)
     : d_type(type)
     , d_method_count(std::min(names.size(), functions.size())) {
+    if (module) {
+        d_arena = &module->getArena();
+    }
+
     auto& ll_context = d_type->getContext();
 
     d_type_with_kind = llvm::StructType::get(
@@ -39,7 +43,7 @@ Class::Class(llvm::StructType *type, llvm::ArrayRef<llvm::StringRef> names, llvm
 
     updateLayout();
 
-    d_methods = std::allocator<Method>().allocate(d_method_count);
+    d_methods = allocateArray<Method>(d_arena.get(), d_method_count);
 
     auto p_method = d_methods;
     auto it_name = names.begin();
@@ -82,6 +86,7 @@ Class::Class(llvm::StructType *type, llvm::ArrayRef<llvm::StringRef> names, llvm
 
 Class::Class(llvm::Metadata *md, Module *module) {
     if (module) {
+        d_arena = &module->getArena();
         module->getClassList().push_back(this);
     }
     assert(d_module == module);
@@ -106,7 +111,7 @@ Class::Class(llvm::Metadata *md, Module *module) {
     auto methods_md = llvm::cast<llvm::MDTuple>(d_md->getOperand(2).get());
 
     d_method_count = methods_md->getNumOperands();
-    d_methods = std::allocator<Method>().allocate(d_method_count);
+    d_methods = allocateArray<Method>(d_arena.get(), d_method_count);
 
     auto p_method = d_methods;
     auto it_methods_md = methods_md->op_begin();
@@ -124,7 +129,7 @@ Class::~Class() {
         d_methods, d_methods + d_method_count,
         [](auto &method) -> void { method.~Method(); });
 
-    std::allocator<Method>().deallocate(d_methods, d_method_count);
+    deallocateArray(d_arena.get(), d_methods, d_method_count);
 }
 
 void
@@ -140,24 +145,20 @@ Class::setModule(Module *module) {
             auto class_md = d_module->getLLModule()->getNamedMetadata("llair.class");
 
             if (class_md) {
-                auto it =
-                    std::find(class_md->op_begin(), class_md->op_end(), d_md.get());
-                if (it != class_md->op_end()) {
-                    class_md->setOperand(std::distance(class_md->op_begin(), it),
-                                         nullptr);
-                }
+                d_module->removeMetadataOperand(class_md, d_md.get(), d_module_md_index);
             }
         }
     }
 
     d_module = module;
+    d_module_md_index.reset();
 
     if (d_module) {
         setSymbolTable(&d_module->getClassSymbolTable());
 
         if (d_module->getLLModule() && d_md) {
-            auto dispatchers_md = d_module->getLLModule()->getOrInsertNamedMetadata("llair.class");
-            dispatchers_md->addOperand(d_md.get());
+            auto class_md = d_module->getLLModule()->getOrInsertNamedMetadata("llair.class");
+            d_module_md_index = d_module->appendMetadataOperand(class_md, d_md.get());
         }
     }
 }
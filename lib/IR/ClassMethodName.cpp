@@ -0,0 +1,231 @@
+#include <llair/Demangle/ItaniumDemangle.h>
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/Allocator.h>
+
+#include <algorithm>
+#include <cassert>
+
+#include "ClassMethodName.h"
+
+namespace llair {
+
+namespace {
+
+class DefaultAllocator {
+    llvm::BumpPtrAllocator Alloc;
+
+public:
+    void reset() { Alloc.Reset(); }
+
+    template <typename T, typename... Args> T *makeNode(Args &&... args) {
+        return new (Alloc.Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    void *allocateNodeArray(size_t sz) {
+        return Alloc.Allocate(sizeof(llair::itanium_demangle::Node *) * sz,
+                              alignof(llair::itanium_demangle::Node));
+    }
+};
+
+} // namespace
+
+class ClassMethodNameParser::Demangler
+    : public llair::itanium_demangle::ManglingParser<DefaultAllocator> {
+public:
+
+    Demangler()
+        : llair::itanium_demangle::ManglingParser<DefaultAllocator>(nullptr, nullptr) {
+    }
+};
+
+FastParseResult
+parseClassPathAndMethodNameFast(llvm::StringRef name, llvm::SmallVectorImpl<llvm::StringRef> &path,
+                                std::pair<llvm::StringRef, llvm::StringRef> &result) {
+    path.clear();
+
+    llvm::StringRef rest = name;
+
+    if (!rest.consume_front("_Z") && !rest.consume_front("__Z")) {
+        return FastParseResult::kNotMethod;
+    }
+
+    if (rest.empty() || (rest.front() >= '1' && rest.front() <= '9') || rest.front() == 'G' || rest.front() == 'T') {
+        return FastParseResult::kNotMethod;
+    }
+
+    if (!rest.consume_front("N")) {
+        return FastParseResult::kUnknown;
+    }
+
+    rest.consume_front("r");
+    rest.consume_front("V");
+    rest.consume_front("K");
+
+    if (!rest.consume_front("O")) {
+        rest.consume_front("R");
+    }
+
+    while (!rest.consume_front("E")) {
+        if (rest.empty() || rest.front() < '1' || rest.front() > '9') {
+            return FastParseResult::kUnknown;
+        }
+
+        std::size_t length = 0;
+        if (rest.consumeInteger(10, length) || length == 0 || length > rest.size()) {
+            return FastParseResult::kUnknown;
+        }
+
+        auto identifier = rest.take_front(length);
+        if (identifier.startswith("_GLOBAL__N")) {
+            return FastParseResult::kUnknown;
+        }
+
+        path.push_back(identifier);
+        rest = rest.drop_front(length);
+    }
+
+    if (path.size() < 2) {
+        return FastParseResult::kUnknown;
+    }
+
+    if (rest.empty() || rest.front() == '.') {
+        return FastParseResult::kNotMethod;
+    }
+
+    if (rest.find_if_not([](char c) -> bool { return llvm::isAlnum(c) || c == '_'; }) != llvm::StringRef::npos) {
+        return FastParseResult::kUnknown;
+    }
+
+    auto method_identifier = path.pop_back_val();
+
+    result.first = llvm::StringRef(
+        path.front().begin(),
+        std::distance(path.front().begin(), path.back().end()));
+    result.second = llvm::StringRef(
+        method_identifier.begin(),
+        std::distance(method_identifier.begin(), name.end()));
+
+    return FastParseResult::kMethod;
+}
+
+ClassMethodNameParser::ClassMethodNameParser()
+    : d_demangler(std::make_unique<Demangler>()) {
+}
+
+ClassMethodNameParser::~ClassMethodNameParser() {
+}
+
+ClassMethodNameParser::Result
+ClassMethodNameParser::parse(llvm::StringRef name, llvm::SmallVectorImpl<llvm::StringRef> &path) {
+    std::pair<llvm::StringRef, llvm::StringRef> fast_result;
+    Result result;
+
+    switch (parseClassPathAndMethodNameFast(name, path, fast_result)) {
+    case FastParseResult::kMethod:
+        result = fast_result;
+        break;
+    case FastParseResult::kNotMethod:
+        break;
+    case FastParseResult::kUnknown:
+        return parseWithDemangler(name, path);
+    }
+
+#if defined(EXPENSIVE_CHECKS)
+    {
+        llvm::SmallVector<llvm::StringRef, 8> full_path;
+        auto full_result = parseWithDemangler(name, full_path);
+
+        // The fast path does not parse the parameters, so it may accept a name
+        // that the full demangler rejects, but never the reverse:
+        assert(!full_result || (result && *result == *full_result && path == full_path));
+    }
+#endif
+
+    return result;
+}
+
+ClassMethodNameParser::Result
+ClassMethodNameParser::parseWithDemangler(llvm::StringRef name,
+                                          llvm::SmallVectorImpl<llvm::StringRef> &path) {
+    using namespace llair::itanium_demangle;
+
+    path.clear();
+
+    d_demangler->reset(name.begin(), name.end());
+    auto ast = d_demangler->parse();
+
+    if (!ast) {
+        return llvm::None;
+    }
+
+    if (ast->getKind() != Node::KFunctionEncoding) {
+        return llvm::None;
+    }
+
+    auto function_encoding = static_cast<FunctionEncoding *>(ast);
+
+    if (function_encoding->getName()->getKind() != Node::KNestedName) {
+        return llvm::None;
+    }
+
+    auto nested_name = static_cast<const NestedName *>(function_encoding->getName());
+
+    // The names are spans of `name`; a node whose base name isn't (a constructor, a destructor or
+    // an ABI tag, whose name is found elsewhere) can't be described that way:
+    auto is_in_name = [name](StringView identifier) -> bool {
+        return !identifier.empty() && identifier.begin() >= name.begin() &&
+               identifier.end() <= name.end();
+    };
+
+    if (!is_in_name(nested_name->Name->getBaseName())) {
+        return llvm::None;
+    }
+
+    // Class name:
+    for (auto node = nested_name->Qual; node;) {
+        StringView identifier;
+
+        switch (node->getKind()) {
+        case Node::KNestedName: {
+            auto nested_name = static_cast<const NestedName *>(node);
+
+            node       = nested_name->Qual;
+            identifier = nested_name->Name->getBaseName();
+        } break;
+        case Node::KNameType: {
+            auto name_type = static_cast<const NameType *>(node);
+
+            node       = nullptr;
+            identifier = name_type->getName();
+        } break;
+        default:
+            // Template arguments, substitutions and the like aren't part of a span of `name`:
+            path.clear();
+            return llvm::None;
+        }
+
+        if (!is_in_name(identifier)) {
+            path.clear();
+            return llvm::None;
+        }
+
+        path.push_back(llvm::StringRef(identifier.begin(),
+                                       std::distance(identifier.begin(), identifier.end())));
+    }
+
+    std::reverse(path.begin(), path.end());
+
+    llvm::StringRef qualified_name(
+        path.front().begin(),
+        std::distance(path.front().begin(), path.back().end()));
+
+    // Mangled method name:
+    llvm::StringRef method_name(
+        nested_name->Name->getBaseName().begin(),
+        std::distance(nested_name->Name->getBaseName().begin(), name.end()));
+
+    return std::make_pair(qualified_name, method_name);
+}
+
+} // End namespace llair
@@ -0,0 +1,55 @@
+//-*-C++-*-
+#ifndef LLAIR_IR_CLASSMETHODNAME_H
+#define LLAIR_IR_CLASSMETHODNAME_H
+
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <memory>
+#include <utility>
+
+namespace llair {
+
+enum class FastParseResult { kMethod, kNotMethod, kUnknown };
+
+// Recognizes the shapes that ClassMethodNameParser::parseWithDemangler() reports as methods in the
+// common case, `_ZN[<CV-qualifiers>][<ref-qualifier>]<source-name>+E<parameters>`, without building
+// an AST. Returns `kNotMethod` only for names that the full demangler cannot report as a method
+// either, and `kUnknown` for anything it does not handle: substitutions, template arguments and
+// parameters, constructors, operators, ABI tags and anonymous namespaces. The parameters are not
+// parsed, only checked for mangling characters.
+FastParseResult
+parseClassPathAndMethodNameFast(llvm::StringRef name, llvm::SmallVectorImpl<llvm::StringRef> &path,
+                                std::pair<llvm::StringRef, llvm::StringRef> &result);
+
+// Finds the qualified class name and the mangled method name of a member function's name. The
+// components of the class path are stored in `path`, outermost first; both the parser, whose arena
+// is reset for each name, and `path` are meant to be reused across names:
+class ClassMethodNameParser {
+public:
+
+    using Result = llvm::Optional<std::pair<llvm::StringRef, llvm::StringRef>>;
+
+    ClassMethodNameParser();
+    ~ClassMethodNameParser();
+
+    // Tries the fast path, falling back to the full demangler when it cannot decide. When built
+    // with EXPENSIVE_CHECKS, the decisions of the fast path are checked against the full demangler:
+    Result parse(llvm::StringRef, llvm::SmallVectorImpl<llvm::StringRef> &path);
+
+    // Only uses the full demangler. The names are spans of the mangled name, so a name that the
+    // demangler makes up (a constructor's or destructor's, an anonymous namespace's), or whose
+    // class path has template arguments or substitutions, isn't reported as a method:
+    Result parseWithDemangler(llvm::StringRef, llvm::SmallVectorImpl<llvm::StringRef> &path);
+
+private:
+
+    class Demangler;
+
+    std::unique_ptr<Demangler> d_demangler;
+};
+
+} // End namespace llair
+
+#endif
@@ -3,6 +3,7 @@
 #include <llair/IR/Interface.h>
 #include <llair/IR/Module.h>
 
+#include <llvm/Config/llvm-config.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
@@ -28,9 +29,13 @@ module_ilist_traits<llair::Dispatcher>::removeNodeFromList(llair::Dispatcher *di
 
 Dispatcher::Dispatcher(Interface *interface, Module *module)
 : d_interface(interface) {
+    if (module) {
+        d_arena = &module->getArena();
+    }
+
     auto method_count = method_size();
 
-    d_methods = std::allocator<Method>().allocate(method_count);
+    d_methods = allocateArray<Method>(d_arena.get(), method_count);
 
     auto p_method = d_methods;
     auto it_interface_method = d_interface->method_begin();
@@ -61,6 +66,7 @@ Dispatcher::Dispatcher(Interface *interface, Module *module)
 
 Dispatcher::Dispatcher(llvm::Metadata *md, Module *module) {
     if (module) {
+        d_arena = &module->getArena();
         module->getDispatcherList().push_back(this);
     }
     assert(d_module == module);
@@ -75,7 +81,7 @@ Dispatcher::Dispatcher(llvm::Metadata *md, Module *module) {
 
     auto methods_md = llvm::cast<llvm::MDTuple>(d_md->getOperand(1).get());
 
-    d_methods = std::allocator<Method>().allocate(method_count);
+    d_methods = allocateArray<Method>(d_arena.get(), method_count);
 
     auto p_method = d_methods;
     auto it_interface_method = d_interface->method_begin();
@@ -106,7 +112,7 @@ Dispatcher::~Dispatcher() {
         d_methods, d_methods + method_count,
         [](auto &method) -> void { method.~Method(); });
 
-    std::allocator<Method>().deallocate(d_methods, method_count);
+    deallocateArray(d_arena.get(), d_methods, method_count);
 }
 
 void
@@ -130,17 +136,13 @@ Dispatcher::setModule(Module *module) {
             auto dispatchers_md = d_module->getLLModule()->getNamedMetadata("llair.dispatcher");
 
             if (dispatchers_md) {
-                auto it =
-                    std::find(dispatchers_md->op_begin(), dispatchers_md->op_end(), d_md.get());
-                if (it != dispatchers_md->op_end()) {
-                    dispatchers_md->setOperand(std::distance(dispatchers_md->op_begin(), it),
-                                               nullptr);
-                }
+                d_module->removeMetadataOperand(dispatchers_md, d_md.get(), d_module_md_index);
             }
         }
     }
 
     d_module = module;
+    d_module_md_index.reset();
 
     if (d_module) {
         auto method_count = method_size();
@@ -153,7 +155,7 @@ Dispatcher::setModule(Module *module) {
 
         if (d_module->getLLModule() && d_md) {
             auto dispatchers_md = d_module->getLLModule()->getOrInsertNamedMetadata("llair.dispatcher");
-            dispatchers_md->addOperand(d_md.get());
+            d_module_md_index = d_module->appendMetadataOperand(dispatchers_md, d_md.get());
         }
     }
 }
@@ -162,11 +164,27 @@ void
 Dispatcher::updateImplementationsMetadata() {
     auto& ll_context = d_interface->getContext().getLLContext();
 
-    std::vector<llvm::Metadata *> mds;
-    mds.reserve(d_implementations.size());
+    // The map's order depends on the hashes of the kinds, so sort them to keep the metadata
+    // deterministic:
+    std::vector<std::pair<uint32_t, const Implementation *>> implementations;
+    implementations.reserve(d_implementations.size());
 
     std::transform(
         d_implementations.begin(), d_implementations.end(),
+        std::back_inserter(implementations),
+        [](const auto& tmp) -> std::pair<uint32_t, const Implementation *> {
+            return { tmp.first, &tmp.second };
+        });
+
+    std::sort(
+        implementations.begin(), implementations.end(),
+        [](const auto& lhs, const auto& rhs) -> bool { return lhs.first < rhs.first; });
+
+    std::vector<llvm::Metadata *> mds;
+    mds.reserve(implementations.size());
+
+    std::transform(
+        implementations.begin(), implementations.end(),
         std::back_inserter(mds),
         [&ll_context](const auto& tmp) -> llvm::Metadata * {
             auto [ kind, implementation ] = tmp;
@@ -174,7 +192,7 @@ Dispatcher::updateImplementationsMetadata() {
             return llvm::MDTuple::get(ll_context,
                 { llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(
                         ll_context, llvm::APInt(32, kind, true))),
-                  llvm::MDString::get(ll_context, implementation.name) });
+                  llvm::MDString::get(ll_context, implementation->name) });
         });
 
     d_implementations_md.reset(llvm::MDTuple::get(ll_context, mds));
@@ -220,10 +238,17 @@ Dispatcher::findMethod(llvm::StringRef name) const {
     return tmp.first;
 }
 
-void
+llvm::Error
 Dispatcher::insertImplementation(uint32_t kind, const Class *klass) {
     assert(klass->doesImplement(d_interface));
 
+    // Read the methods' bodies before changing anything:
+    for (auto it_method = d_methods, end = d_methods + method_size(); it_method != end; ++it_method) {
+        if (auto switcher = it_method->getSwitcher(); !switcher) {
+            return switcher.takeError();
+        }
+    }
+
     auto it_implementation = d_implementations.find(kind);
     assert(it_implementation == d_implementations.end());
     it_implementation = d_implementations.insert({ kind, { klass->getName().str() } }).first;
@@ -249,13 +274,15 @@ Dispatcher::insertImplementation(uint32_t kind, const Class *klass) {
 
                 llvm::BasicBlock *block = nullptr;
 
-                if (it_method->d_switcher->getDefaultDest()->empty()) {
-                    block = it_method->d_switcher->getDefaultDest();
+                auto switcher = llvm::cantFail(it_method->getSwitcher());
+
+                if (switcher->getDefaultDest()->empty()) {
+                    block = switcher->getDefaultDest();
                 }
                 else {
                     block = llvm::BasicBlock::Create(ll_context, "", it_method->d_function);
 
-                    it_method->d_switcher->addCase(
+                    switcher->addCase(
                         llvm::ConstantInt::get(
                             llvm::Type::getInt32Ty(ll_context), kind, false), block);
                 }
@@ -288,7 +315,7 @@ Dispatcher::insertImplementation(uint32_t kind, const Class *klass) {
 
                 // `that`:
                 auto that = builder->CreateStructGEP(
-                    nullptr,
+                    type_with_kind,
                     builder->CreatePointerCast(
                         it_method->d_function->arg_begin(),
                         llvm::PointerType::get(type_with_kind, 1)), 1);
@@ -319,6 +346,8 @@ Dispatcher::insertImplementation(uint32_t kind, const Class *klass) {
             ++it_klass_method;
         }
     }
+
+    return llvm::Error::success();
 }
 
 void
@@ -362,9 +391,15 @@ Dispatcher::Method::Method(Interface *interface, const Interface::Method *interf
 
     auto abstract_that = d_function->arg_begin();
 
-    auto kind = builder->CreateLoad(
+    // The function isn't in a module yet, so the load's alignment can't come from a data layout:
+    auto kind = builder->CreateAlignedLoad(
         llvm::Type::getInt32Ty(ll_context),
-        builder->CreateStructGEP(nullptr, abstract_that, 0));
+        builder->CreateStructGEP(interface->getType(), abstract_that, 0),
+#if LLVM_VERSION_MAJOR >= 10
+        llvm::MaybeAlign(4));
+#else
+        4);
+#endif
 
     d_switcher = builder->CreateSwitch(kind,
         llvm::BasicBlock::Create(ll_context, "", d_function));
@@ -377,8 +412,6 @@ Dispatcher::Method::Method(llvm::Metadata *md, const Interface::Method *interfac
     d_md.reset(llvm::cast<llvm::ConstantAsMetadata>(md));
 
     d_function = llvm::mdconst::extract<llvm::Function>(d_md.get());
-
-    d_switcher = llvm::cast<llvm::SwitchInst>(d_function->getEntryBlock().getTerminator());
 }
 
 Dispatcher::Method::~Method() {
@@ -393,6 +426,19 @@ Dispatcher::Method::~Method() {
     delete d_function;
 }
 
+llvm::Expected<llvm::SwitchInst *>
+Dispatcher::Method::getSwitcher() {
+    if (!d_switcher) {
+        if (auto error = d_function->materialize()) {
+            return std::move(error);
+        }
+
+        d_switcher = llvm::cast<llvm::SwitchInst>(d_function->getEntryBlock().getTerminator());
+    }
+
+    return d_switcher;
+}
+
 llvm::Function *
 Dispatcher::Method::getFunction() const {
     return llvm::mdconst::extract<llvm::Function>(d_md.get());
@@ -92,12 +92,13 @@ EntryPoint::EntryPoint(EntryPoint::EntryPointKind kind, llvm::Function *function
     d_function_md.reset(llvm::ValueAsMetadata::get(function));
 
     if (module) {
+        d_arena = &module->getArena();
         module->getEntryPointList().push_back(this);
     }
 
     d_argument_count = function->arg_size();
 
-    d_arguments = std::allocator<Argument>().allocate(d_argument_count);
+    d_arguments = allocateArray<Argument>(d_arena.get(), d_argument_count);
 
     std::accumulate(function->arg_begin(), function->arg_end(),
                     d_arguments, [=](auto argument, auto &function_argument) -> auto {
@@ -124,6 +125,7 @@ EntryPoint::EntryPoint(EntryPoint::EntryPointKind kind, llvm::MDNode *md, Module
     d_function_md.reset(llvm::cast<llvm::ValueAsMetadata>(md->getOperand(0).get()));
 
     if (module) {
+        d_arena = &module->getArena();
         module->getEntryPointList().push_back(this);
     }
 
@@ -131,7 +133,7 @@ EntryPoint::EntryPoint(EntryPoint::EntryPointKind kind, llvm::MDNode *md, Module
 
     d_argument_count = function->arg_size();
 
-    d_arguments = std::allocator<Argument>().allocate(d_argument_count);
+    d_arguments = allocateArray<Argument>(d_arena.get(), d_argument_count);
 
     d_md.reset(md);
 
@@ -193,7 +195,7 @@ EntryPoint::~EntryPoint() {
     std::for_each(d_arguments, d_arguments + d_argument_count,
                   [](auto &argument) -> void { argument.~Argument(); });
 
-    std::allocator<Argument>().deallocate(d_arguments, d_argument_count);
+    deallocateArray(d_arena.get(), d_arguments, d_argument_count);
 }
 
 void
@@ -220,17 +222,13 @@ EntryPoint::setModule(Module *module) {
             }
 
             if (entry_points_md) {
-                auto it =
-                    std::find(entry_points_md->op_begin(), entry_points_md->op_end(), d_md.get());
-                if (it != entry_points_md->op_end()) {
-                    entry_points_md->setOperand(std::distance(entry_points_md->op_begin(), it),
-                                                nullptr);
-                }
+                d_module->removeMetadataOperand(entry_points_md, d_md.get(), d_module_md_index);
             }
         }
     }
 
     d_module = module;
+    d_module_md_index.reset();
 
     if (d_module) {
         if (function) {
@@ -254,7 +252,7 @@ EntryPoint::setModule(Module *module) {
             }
 
             if (entry_points_md) {
-                entry_points_md->addOperand(d_md.get());
+                d_module_md_index = d_module->appendMetadataOperand(entry_points_md, d_md.get());
             }
         }
     }
@@ -900,7 +898,7 @@ VertexEntryPoint::VertexEntryPoint(llvm::Function *function, unsigned output_cou
     : EntryPoint(EntryPoint::Vertex, function, module) {
     d_output_count = output_count;
 
-    d_outputs = std::allocator<Output>().allocate(d_output_count);
+    d_outputs = allocateArray<Output>(d_arena.get(), d_output_count);
 
     std::accumulate(d_outputs, d_outputs + d_output_count,
                     d_outputs, [=](auto output, auto &) -> auto {
@@ -932,7 +930,7 @@ VertexEntryPoint::VertexEntryPoint(llvm::MDNode *md, Module *module)
 
     d_output_count = d_outputs_md->getNumOperands();
 
-    d_outputs = std::allocator<Output>().allocate(d_output_count);
+    d_outputs = allocateArray<Output>(d_arena.get(), d_output_count);
 
     std::accumulate(d_outputs_md->op_begin(), d_outputs_md->op_end(),
                     d_outputs, [=](auto output, auto &operand) -> auto {
@@ -946,7 +944,7 @@ VertexEntryPoint::~VertexEntryPoint() {
         std::for_each(d_outputs, d_outputs + d_output_count,
                       [](auto &output) -> void { output.~Output(); });
 
-        std::allocator<Output>().deallocate(d_outputs, d_output_count);
+        deallocateArray(d_arena.get(), d_outputs, d_output_count);
     }
 }
 
@@ -1222,7 +1220,7 @@ FragmentEntryPoint::FragmentEntryPoint(llvm::Function *function, bool early_frag
     , d_early_fragment_tests_enabled(early_fragment_tests_enabled) {
     d_output_count = output_count;
 
-    d_outputs = std::allocator<Output>().allocate(d_output_count);
+    d_outputs = allocateArray<Output>(d_arena.get(), d_output_count);
 
     std::accumulate(d_outputs, d_outputs + d_output_count,
                     d_outputs, [=](auto output, auto &) -> auto {
@@ -1274,7 +1272,7 @@ FragmentEntryPoint::FragmentEntryPoint(llvm::MDNode *md, Module *module)
 
     d_output_count = d_outputs_md->getNumOperands();
 
-    d_outputs = std::allocator<Output>().allocate(d_output_count);
+    d_outputs = allocateArray<Output>(d_arena.get(), d_output_count);
 
     std::accumulate(d_outputs_md->op_begin(), d_outputs_md->op_end(),
                     d_outputs, [=](auto output, auto &operand) -> auto {
@@ -1288,7 +1286,7 @@ FragmentEntryPoint::~FragmentEntryPoint() {
         std::for_each(d_outputs, d_outputs + d_output_count,
                       [](auto &output) -> void { output.~Output(); });
 
-        std::allocator<Output>().deallocate(d_outputs, d_output_count);
+        deallocateArray(d_arena.get(), d_outputs, d_output_count);
     }
 }
 
@@ -15,7 +15,7 @@ Interface::Interface(LLAIRContext& context, llvm::StructType *type, llvm::ArrayR
     : d_context(context)
     , d_type(type)
     , d_method_count(std::min(std::min(names.size(), qualifiedNames.size()), types.size())) {
-    d_methods = std::allocator<Method>().allocate(d_method_count);
+    d_methods = LLAIRContextImpl::Get(context).getAllocator().Allocate<Method>(d_method_count);
 
     auto p_method = d_methods;
     auto it_name = names.begin();
@@ -26,11 +26,17 @@ Interface::Interface(LLAIRContext& context, llvm::StructType *type, llvm::ArrayR
         new (p_method) Method(*it_name, *it_qualifiedName, *it_type);
     }
 
-    std::sort(
+    // Interface::get() sorts the methods by name:
+    assert(std::is_sorted(
         d_methods, d_methods + d_method_count,
         [](const auto &lhs, const auto &rhs) -> auto {
             return lhs.getName() < rhs.getName();
-        });
+        }));
+
+    d_hash = InterfaceKeyInfo::getHashValue(
+        InterfaceKeyInfo::KeyTy(type, names.take_front(d_method_count),
+                                qualifiedNames.take_front(d_method_count),
+                                types.take_front(d_method_count)));
 
     std::vector<llvm::Metadata *> method_mds;
     method_mds.reserve(d_method_count);
@@ -55,23 +61,48 @@ Interface::~Interface() {
     std::for_each(
         d_methods, d_methods + d_method_count,
         [](auto &method) -> void { method.~Method(); });
-
-    std::allocator<Method>().deallocate(d_methods, d_method_count);
 }
 
 Interface *
 Interface::get(LLAIRContext& context, llvm::StructType *type, llvm::ArrayRef<llvm::StringRef> names, llvm::ArrayRef<llvm::StringRef> qualifiedNames, llvm::ArrayRef<llvm::FunctionType *> types) {
     auto& context_impl = LLAIRContextImpl::Get(context);
 
+    // The uniquing key has the methods sorted by name:
+    auto method_count = std::min(std::min(names.size(), qualifiedNames.size()), types.size());
+
+    std::vector<std::size_t> order(method_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(
+        order.begin(), order.end(),
+        [names](auto lhs, auto rhs) -> bool {
+            return names[lhs] < names[rhs];
+        });
+
+    std::vector<llvm::StringRef> sorted_names, sorted_qualifiedNames;
+    std::vector<llvm::FunctionType *> sorted_types;
+    sorted_names.reserve(method_count);
+    sorted_qualifiedNames.reserve(method_count);
+    sorted_types.reserve(method_count);
+
+    std::for_each(
+        order.begin(), order.end(),
+        [&](auto index) -> void {
+            sorted_names.push_back(names[index]);
+            sorted_qualifiedNames.push_back(qualifiedNames[index]);
+            sorted_types.push_back(types[index]);
+        });
+
     auto it = context_impl.interfaces().find_as(
-        InterfaceKeyInfo::KeyTy(type, names, qualifiedNames, types));
+        InterfaceKeyInfo::KeyTy(type, sorted_names, sorted_qualifiedNames, sorted_types));
 
     if (it != context_impl.interfaces().end()) {
         return *it;
     }
 
-    auto interface = new Interface(context, type, names, qualifiedNames, types);
+    auto interface = new (context_impl.getAllocator().Allocate<Interface>())
+        Interface(context, type, sorted_names, sorted_qualifiedNames, sorted_types);
     context_impl.interfaces().insert(interface);
+    context_impl.interfaces_by_metadata().insert({ interface->d_md, interface });
     return interface;
 }
 
@@ -81,6 +112,13 @@ Interface::get(llvm::Metadata *md) {
 
     auto context = LLAIRContext::Get(&md_tuple->getContext());
 
+    auto& context_impl = LLAIRContextImpl::Get(*context);
+
+    auto it = context_impl.interfaces_by_metadata().find(md_tuple);
+    if (it != context_impl.interfaces_by_metadata().end()) {
+        return it->second;
+    }
+
     auto type = llvm::cast<llvm::StructType>(
         llvm::mdconst::extract<llvm::ConstantPointerNull>(md_tuple->getOperand(0).get())->
             getType()->
@@ -111,7 +149,9 @@ Interface::get(llvm::Metadata *md) {
                             getElementType()));
         });
 
-    return Interface::get(*context, type, names, qualifiedNames, types);
+    auto interface = Interface::get(*context, type, names, qualifiedNames, types);
+    context_impl.interfaces_by_metadata().insert({ md_tuple, interface });
+    return interface;
 }
 
 const Interface::Method *
@@ -1,10 +1,20 @@
 #include <llair/IR/LLAIRContext.h>
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/RWMutex.h>
 
 #include "LLAIRContextImpl.h"
 
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 
 namespace llair {
 
@@ -15,16 +25,88 @@ LLAIRContextImpl::LLAIRContextImpl(llvm::LLVMContext &llcontext)
     , d_target_triple("air64-apple-macosx14.0.0") {
 }
 
-LLAIRContextImpl::~LLAIRContextImpl() {}
+LLAIRContextImpl::~LLAIRContextImpl() {
+    // Interfaces are allocated from d_allocator, which releases their memory:
+    std::for_each(
+        d_interfaces.begin(), d_interfaces.end(),
+        [](auto interface) -> void { interface->~Interface(); });
+}
 
 // Interface:
 namespace {
 namespace contexts {
 
-std::map<llvm::LLVMContext *, LLAIRContext *> &
-llvm_to_llair() {
-    static std::map<llvm::LLVMContext *, LLAIRContext *> s_llvm_to_llair;
-    return s_llvm_to_llair;
+// Contexts are registered and unregistered rarely, but looked up by every Module::Get(),
+// EntryPoint::Get(), etc.; lookups take a shared lock, and each thread caches its most recent
+// result. Registering a context doesn't invalidate anything, since only found contexts are cached;
+// unregistering one bumps the epoch of the slot that its pointer hashes to, which invalidates only
+// the caches of that pointer (and of the few others that share its slot):
+const std::size_t kEpochSlotCount = 64;
+
+struct Registry {
+    llvm::sys::SmartRWMutex<true>                       mutex;
+    llvm::DenseMap<llvm::LLVMContext *, LLAIRContext *> llvm_to_llair;
+    std::atomic<uint64_t>                               epochs[kEpochSlotCount] = {};
+};
+
+Registry &
+registry() {
+    static Registry s_registry;
+    return s_registry;
+}
+
+std::atomic<uint64_t> &
+epoch(Registry& registry, llvm::LLVMContext *llcontext) {
+    auto hash = llvm::DenseMapInfo<llvm::LLVMContext *>::getHashValue(llcontext);
+    return registry.epochs[hash % kEpochSlotCount];
+}
+
+struct Cache {
+    llvm::LLVMContext *llcontext = nullptr;
+    LLAIRContext *     context   = nullptr;
+    uint64_t           epoch     = 0;
+};
+
+thread_local Cache t_cache;
+
+LLAIRContext *
+find(llvm::LLVMContext *llcontext) {
+    auto& registry = contexts::registry();
+    auto& epoch    = contexts::epoch(registry, llcontext);
+
+    if (t_cache.llcontext == llcontext && t_cache.epoch == epoch.load(std::memory_order_acquire)) {
+        return t_cache.context;
+    }
+
+    LLAIRContext *context = nullptr;
+    uint64_t      current_epoch = 0;
+
+  { llvm::sys::SmartScopedReader<true> lock(registry.mutex);
+    current_epoch = epoch.load(std::memory_order_relaxed);
+    context = registry.llvm_to_llair.lookup(llcontext); }
+
+    if (context) {
+        t_cache = { llcontext, context, current_epoch };
+    }
+
+    return context;
+}
+
+void
+insert(llvm::LLVMContext *llcontext, LLAIRContext *context) {
+    auto& registry = contexts::registry();
+
+    llvm::sys::SmartScopedWriter<true> lock(registry.mutex);
+    registry.llvm_to_llair.insert(std::make_pair(llcontext, context));
+}
+
+void
+erase(llvm::LLVMContext *llcontext) {
+    auto& registry = contexts::registry();
+
+    llvm::sys::SmartScopedWriter<true> lock(registry.mutex);
+    registry.llvm_to_llair.erase(llcontext);
+    contexts::epoch(registry, llcontext).fetch_add(1, std::memory_order_release);
 }
 
 } // End namespace contexts
@@ -32,23 +114,21 @@ llvm_to_llair() {
 
 const LLAIRContext *
 LLAIRContext::Get(const llvm::LLVMContext *llcontext) {
-    auto it = contexts::llvm_to_llair().find(const_cast<llvm::LLVMContext *>(llcontext));
-    return it != contexts::llvm_to_llair().end() ? it->second : nullptr;
+    return contexts::find(const_cast<llvm::LLVMContext *>(llcontext));
 }
 
 LLAIRContext *
 LLAIRContext::Get(llvm::LLVMContext *llcontext) {
-    auto it = contexts::llvm_to_llair().find(llcontext);
-    return it != contexts::llvm_to_llair().end() ? it->second : nullptr;
+    return contexts::find(llcontext);
 }
 
 LLAIRContext::LLAIRContext(llvm::LLVMContext &llcontext)
     : d_impl(new LLAIRContextImpl(llcontext)) {
-    contexts::llvm_to_llair().insert(std::make_pair(&llcontext, this));
+    contexts::insert(&llcontext, this);
 }
 
 LLAIRContext::~LLAIRContext() {
-    contexts::llvm_to_llair().erase(&d_impl->getLLContext());
+    contexts::erase(&d_impl->getLLContext());
 }
 
 const llvm::LLVMContext &
@@ -71,4 +151,149 @@ LLAIRContext::getTargetTriple() const {
     return d_impl->getTargetTriple();
 }
 
+namespace {
+
+// Collects the types, metadata nodes and constants reachable from a module (llvm::TypeFinder
+// doesn't cope with the null named metadata operands that removed objects leave behind):
+struct ReachableValues {
+    llvm::DenseSet<const llvm::Type *>     types;
+    llvm::DenseSet<const llvm::MDNode *>   metadata_nodes;
+    llvm::DenseSet<const llvm::Constant *> constants;
+
+    void visit(const llvm::Type *type) {
+        if (!types.insert(type).second) {
+            return;
+        }
+
+        std::for_each(
+            type->subtype_begin(), type->subtype_end(),
+            [this](auto subtype) -> void { visit(subtype); });
+    }
+
+    void visit(const llvm::Metadata *md) {
+        if (auto value_md = llvm::dyn_cast_or_null<llvm::ValueAsMetadata>(md)) {
+            visit(value_md->getValue());
+            return;
+        }
+
+        auto node = llvm::dyn_cast_or_null<llvm::MDNode>(md);
+        if (!node || !metadata_nodes.insert(node).second) {
+            return;
+        }
+
+        std::for_each(
+            node->op_begin(), node->op_end(),
+            [this](const auto &operand) -> void { visit(operand.get()); });
+    }
+
+    void visit(const llvm::Value *value) {
+        if (!value) {
+            return;
+        }
+
+        visit(value->getType());
+
+        auto constant = llvm::dyn_cast<llvm::Constant>(value);
+
+        // Global values belong to their module, rather than to the context:
+        if (!constant || llvm::isa<llvm::GlobalValue>(constant) ||
+            !constants.insert(constant).second) {
+            return;
+        }
+
+        std::for_each(
+            constant->op_begin(), constant->op_end(),
+            [this](const auto &operand) -> void { visit(operand.get()); });
+    }
+
+    void visit(const llvm::GlobalObject &global_object) {
+        visit(global_object.getValueType());
+
+        llvm::SmallVector<std::pair<unsigned, llvm::MDNode *>, 4> attachments;
+        global_object.getAllMetadata(attachments);
+
+        std::for_each(
+            attachments.begin(), attachments.end(),
+            [this](const auto &attachment) -> void { visit(attachment.second); });
+    }
+
+    void visit(const llvm::Module &module) {
+        std::for_each(
+            module.named_metadata_begin(), module.named_metadata_end(),
+            [this](const auto &named_md) -> void {
+                std::for_each(
+                    named_md.op_begin(), named_md.op_end(),
+                    [this](auto operand) -> void { visit(operand); });
+            });
+
+        std::for_each(
+            module.global_begin(), module.global_end(),
+            [this](const auto &global) -> void {
+                visit(global);
+
+                if (global.hasInitializer()) {
+                    visit(global.getInitializer());
+                }
+            });
+
+        std::for_each(
+            module.begin(), module.end(),
+            [this](const auto &function) -> void {
+                visit(function);
+
+                for (const auto &instruction : llvm::instructions(function)) {
+                    visit(instruction.getType());
+
+                    std::for_each(
+                        instruction.op_begin(), instruction.op_end(),
+                        [this](const auto &operand) -> void {
+                            if (auto md = llvm::dyn_cast<llvm::MetadataAsValue>(operand.get())) {
+                                visit(md->getMetadata());
+                            }
+                            else {
+                                visit(operand.get());
+                            }
+                        });
+
+                    llvm::SmallVector<std::pair<unsigned, llvm::MDNode *>, 4> attachments;
+                    instruction.getAllMetadata(attachments);
+
+                    std::for_each(
+                        attachments.begin(), attachments.end(),
+                        [this](const auto &attachment) -> void { visit(attachment.second); });
+                }
+            });
+    }
+};
+
+} // End anonymous namespace
+
+LLAIRContext::Statistics
+LLAIRContext::getStatistics() const {
+    Statistics statistics;
+
+    ReachableValues values;
+
+    std::for_each(
+        d_impl->modules().begin(), d_impl->modules().end(),
+        [&](const auto &entry) -> void {
+            auto llmodule = entry.second->getLLModule();
+            if (!llmodule) {
+                return;
+            }
+
+            ++statistics.modules;
+
+            values.visit(*llmodule);
+        });
+
+    statistics.types           = values.types.size();
+    statistics.metadata_nodes  = values.metadata_nodes.size();
+    statistics.constants       = values.constants.size();
+    statistics.interfaces      = d_impl->interfaces().size();
+    statistics.modules_created = d_impl->modules_created();
+
+    return statistics;
+}
+
 } // End namespace llair
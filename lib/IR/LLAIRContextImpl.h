@@ -5,19 +5,21 @@
 #include <llair/IR/Interface.h>
 #include <llair/IR/LLAIRContext.h>
 #include <llair/IR/Module.h>
-#include <llair/IR/Named.h>
 
 #include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/DenseSet.h>
 #include <llvm/ADT/Hashing.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/IR/DataLayout.h>
+#include <llvm/Support/Allocator.h>
 
 #include <numeric>
 
 namespace llvm {
 class Function;
 class LLVMContext;
+class MDNode;
 class Module;
 } // namespace llvm
 
@@ -79,26 +81,7 @@ struct InterfaceKeyInfo {
     }
 
     static unsigned getHashValue(const Interface *interface) {
-        return llvm::hash_combine(
-            interface->getType(),
-            std::accumulate(
-                interface->method_begin(), interface->method_end(),
-                llvm::hash_code(),
-                [](auto current, const auto& method) -> llvm::hash_code {
-                    return llvm::hash_combine(current, method.getName());
-                }),
-            std::accumulate(
-                interface->method_begin(), interface->method_end(),
-                llvm::hash_code(),
-                [](auto current, const auto& method) -> llvm::hash_code {
-                    return llvm::hash_combine(current, method.getQualifiedName());
-                }),
-            std::accumulate(
-                interface->method_begin(), interface->method_end(),
-                llvm::hash_code(),
-                [](auto current, const auto& method) -> llvm::hash_code {
-                    return llvm::hash_combine(current, method.getType());
-                }));
+        return interface->d_hash;
     }
 
     static bool isEqual(const KeyTy& lhs, const Interface* rhs) {
@@ -153,11 +136,8 @@ public:
     const llvm::DataLayout&  getDataLayout() const { return d_data_layout; }
     llvm::StringRef          getTargetTriple() const { return d_target_triple; }
 
-    //
-    using NameMap = llvm::DenseMap<const Named *, SymbolTableEntry *>;
-
-    NameMap&                 names()       { return d_names; }
-    const NameMap&           names() const { return d_names; }
+    // Backs interfaces and their method arrays, which live as long as the context:
+    llvm::BumpPtrAllocator&  getAllocator() { return d_allocator; }
 
     //
     using ModuleMapType = llvm::DenseMap<llvm::Module *, Module *>;
@@ -165,6 +145,9 @@ public:
     ModuleMapType&           modules()       { return d_modules; }
     const ModuleMapType&     modules() const { return d_modules; }
 
+    std::size_t&             modules_created()       { return d_modules_created; }
+    std::size_t              modules_created() const { return d_modules_created; }
+
     //
     using EntryPointMapType = llvm::DenseMap<llvm::Function *, EntryPoint *>;
 
@@ -177,15 +160,24 @@ public:
     InterfaceSetType&        interfaces()       { return d_interfaces; }
     const InterfaceSetType&  interfaces() const { return d_interfaces; }
 
+    //
+    using InterfaceMetadataMapType = llvm::DenseMap<const llvm::MDNode *, Interface *>;
+
+    InterfaceMetadataMapType&       interfaces_by_metadata()       { return d_interfaces_by_metadata; }
+    const InterfaceMetadataMapType& interfaces_by_metadata() const { return d_interfaces_by_metadata; }
+
 private:
     llvm::LLVMContext& d_llcontext;
     llvm::DataLayout   d_data_layout;
     std::string        d_target_triple;
 
-    NameMap            d_names;
+    llvm::BumpPtrAllocator d_allocator;
+
     ModuleMapType      d_modules;
+    std::size_t        d_modules_created = 0;
     EntryPointMapType  d_entry_points;
     InterfaceSetType   d_interfaces;
+    InterfaceMetadataMapType d_interfaces_by_metadata;
 };
 
 } // namespace llair
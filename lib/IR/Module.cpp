@@ -1,134 +1,198 @@
 #include <algorithm>
 #include <cstdint>
 #include <iostream>
-#include <list>
 #include <vector>
 
-#include <llair/Demangle/ItaniumDemangle.h>
 #include <llair/IR/Class.h>
 #include <llair/IR/Dispatcher.h>
 #include <llair/IR/EntryPoint.h>
 #include <llair/IR/Module.h>
 
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/MapVector.h>
 #include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
-#include <llvm/Support/Allocator.h>
 #include <llvm/Support/Debug.h>
+#include <llvm/Support/Parallel.h>
+#include <llvm/Support/xxhash.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include "ClassMethodName.h"
 #include "LLAIRContextImpl.h"
 #include "Metadata.h"
+#include "StructuralHash.h"
 
 namespace llair {
 
 namespace {
 
-class DefaultAllocator {
-    llvm::BumpPtrAllocator Alloc;
+struct ClassMethodName {
+    std::size_t     index = 0;
+    llvm::StringRef class_name, method_name;
+};
 
-public:
-    void reset() { Alloc.Reset(); }
+// Demangles `names`, which is a snapshot of function names taken by the caller.
+// Demangling only reads the names, so it is spread over the available threads,
+// in chunks that each reuse one demangler arena; the result follows the order
+// of `names`, omitting those that do not name a class method, so that the
+// caller can create objects deterministically.
+std::vector<ClassMethodName>
+demangleClassMethodNames(llvm::ArrayRef<llvm::StringRef> names) {
+    static const std::size_t s_chunk_size = 1024;
 
-    template <typename T, typename... Args> T *makeNode(Args &&... args) {
-        return new (Alloc.Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
-    }
+    std::vector<llvm::Optional<std::pair<llvm::StringRef, llvm::StringRef>>> parse_results(names.size());
 
-    void *allocateNodeArray(size_t sz) {
-        return Alloc.Allocate(sizeof(llair::itanium_demangle::Node *) * sz,
-                              alignof(llair::itanium_demangle::Node));
+    std::vector<std::size_t> chunks;
+    chunks.reserve(names.size() / s_chunk_size + 1);
+
+    for (std::size_t chunk = 0, n = names.size(); chunk < n; chunk += s_chunk_size) {
+        chunks.push_back(chunk);
     }
-};
 
-using Demangler = llair::itanium_demangle::ManglingParser<DefaultAllocator>;
+    llvm::parallelForEach(
+        chunks.begin(), chunks.end(),
+        [&names, &parse_results](auto chunk) -> void {
+            ClassMethodNameParser                 parser;
+            llvm::SmallVector<llvm::StringRef, 8> path;
 
-llvm::Optional<std::tuple<llvm::StringRef, std::vector<llvm::StringRef>, llvm::StringRef>>
-parseClassPathAndMethodName(const llvm::Function *function) {
-    using namespace llair::itanium_demangle;
+            for (std::size_t index = chunk, n = std::min(chunk + s_chunk_size, names.size()); index < n; ++index) {
+                parse_results[index] = parser.parse(names[index], path);
+            }
+        });
 
-    auto name = function->getName();
+    std::vector<ClassMethodName> result;
+    result.reserve(names.size());
 
-    Demangler parser(name.begin(), name.end());
-    auto      ast = parser.parse();
+    for (std::size_t index = 0, n = names.size(); index < n; ++index) {
+        const auto& parse_result = parse_results[index];
+        if (!parse_result) {
+            continue;
+        }
+
+        result.push_back({ index, parse_result->first, parse_result->second });
+    }
+
+    return result;
+}
+
+llvm::Optional<llvm::StructType *>
+getSelfType(const llvm::Function *function) {
+    auto first_param_type = function->getFunctionType()->getParamType(0);
 
-    if (!ast) {
+    auto pointer_type = llvm::dyn_cast<llvm::PointerType>(first_param_type);
+    if (!pointer_type) {
         return llvm::None;
     }
 
-    if (ast->getKind() != Node::KFunctionEncoding) {
+    auto self_type = llvm::dyn_cast<llvm::StructType>(pointer_type->getElementType());
+    if (!self_type) {
         return llvm::None;
     }
 
-    auto function_encoding = static_cast<FunctionEncoding *>(ast);
+    return self_type;
+}
+
+const char *const kABIIndexName = "llair.abi_index";
+
+// Identifies the functions that the ABI index describes:
+uint64_t
+hashFunctionNames(const llvm::Module& module) {
+    llvm::SmallString<0> names;
+
+    std::for_each(
+        module.begin(), module.end(),
+        [&names](const auto& function) -> void {
+            names += function.getName();
+            names.push_back('\0');
+        });
+
+    return llvm::xxHash64(names);
+}
 
-    if (function_encoding->getName()->getKind() != Node::KNestedName) {
+// 'llair.abi_index' has a single operand, `!{i64 hash, (fn, i32 class_begin, i32 class_length,
+// i32 method_begin)*}`, which lists every function whose name is a class method, with the
+// offsets of the class and method names within the function name (see
+// demangleClassMethodNames()). It can be trusted if the hash of the module's function names
+// still matches:
+using ABIIndex = llvm::StringMap<std::pair<llvm::StringRef, llvm::StringRef>>;
+
+llvm::Optional<ABIIndex>
+readABIIndex(const llvm::Module& module) {
+    auto named_md = module.getNamedMetadata(kABIIndexName);
+    if (!named_md || named_md->getNumOperands() != 1) {
         return llvm::None;
     }
 
-    auto nested_name = static_cast<const NestedName *>(function_encoding->getName());
+    auto md = llvm::dyn_cast_or_null<llvm::MDTuple>(named_md->getOperand(0));
+    if (!md || md->getNumOperands() == 0 || (md->getNumOperands() - 1) % 4 != 0) {
+        return llvm::None;
+    }
 
-    // Class name:
-    std::list<llvm::StringRef> path_parts;
-    std::size_t path_length = 0;
+    auto hash = llvm::mdconst::dyn_extract_or_null<llvm::ConstantInt>(md->getOperand(0));
+    if (!hash || hash->getValue().getActiveBits() > 64 ||
+        hash->getZExtValue() != hashFunctionNames(module)) {
+        return llvm::None;
+    }
 
-    for (auto node = nested_name->Qual; node;) {
-        StringView identifier;
+    // Unlike readMDInt(), doesn't assume that the operand is well-formed:
+    auto readOffset = [](const llvm::MDOperand& operand) -> llvm::Optional<unsigned> {
+        auto value = llvm::mdconst::dyn_extract_or_null<llvm::ConstantInt>(operand);
+        if (!value || !value->getValue().isIntN(32)) {
+            return llvm::None;
+        }
 
-        switch (node->getKind()) {
-        case Node::KNestedName: {
-            auto nested_name = static_cast<const NestedName *>(node);
+        return value->getZExtValue();
+    };
 
-            node       = nested_name->Qual;
-            identifier = nested_name->Name->getBaseName();
-        } break;
-        case Node::KNameType: {
-            auto name_type = static_cast<const NameType *>(node);
+    ABIIndex index;
 
-            node       = nullptr;
-            identifier = name_type->getName();
-        } break;
-        default:
-            node = nullptr;
-            break;
-        }
+    for (unsigned i = 1, n = md->getNumOperands(); i < n; i += 4) {
+        auto function     = llvm::mdconst::dyn_extract_or_null<llvm::Function>(md->getOperand(i));
+        auto class_begin  = readOffset(md->getOperand(i + 1));
+        auto class_length = readOffset(md->getOperand(i + 2));
+        auto method_begin = readOffset(md->getOperand(i + 3));
 
-        path_parts.push_front(llvm::StringRef(identifier.begin(),
-                                              std::distance(identifier.begin(), identifier.end())));
-        ++path_length;
-    }
+        if (!function || !class_begin || !class_length || !method_begin) {
+            return llvm::None;
+        }
 
-    llvm::StringRef qualified_name(
-        path_parts.front().begin(),
-        std::distance(path_parts.front().begin(), path_parts.back().end()));
+        auto name = function->getName();
 
-    std::vector<llvm::StringRef> path;
-    path.reserve(path_length);
-    std::copy(path_parts.begin(), path_parts.end(),
-              std::back_inserter(path));
+        if (*class_begin + *class_length > name.size() || *method_begin >= name.size()) {
+            return llvm::None;
+        }
 
-    // Mangled method name:
-    llvm::StringRef method_name(
-        nested_name->Name->getBaseName().begin(),
-        std::distance(nested_name->Name->getBaseName().begin(), name.end()));
+        index.insert({ name, { name.substr(*class_begin, *class_length),
+                               name.substr(*method_begin) } });
+    }
 
-    return std::make_tuple(qualified_name, path, method_name);
+    return index;
 }
 
-llvm::Optional<llvm::StructType *>
-getSelfType(const llvm::Function *function) {
-    auto first_param_type = function->getFunctionType()->getParamType(0);
+// Looks the names up in the module's ABI index, if it can be trusted, rather than demangling them:
+std::vector<ClassMethodName>
+getClassMethodNames(const llvm::Module& module, llvm::ArrayRef<llvm::StringRef> names) {
+    auto index = readABIIndex(module);
 
-    auto pointer_type = llvm::dyn_cast<llvm::PointerType>(first_param_type);
-    if (!pointer_type) {
-        return llvm::None;
+    if (!index) {
+        return demangleClassMethodNames(names);
     }
 
-    auto self_type = llvm::dyn_cast<llvm::StructType>(pointer_type->getElementType());
-    if (!self_type) {
-        return llvm::None;
+    std::vector<ClassMethodName> result;
+
+    for (std::size_t i = 0, n = names.size(); i < n; ++i) {
+        auto it = index->find(names[i]);
+        if (it == index->end()) {
+            continue;
+        }
+
+        result.push_back({ i, it->second.first, it->second.second });
     }
 
-    return self_type;
+    return result;
 }
 
 } // namespace
@@ -174,6 +238,7 @@ Module::Module(llvm::StringRef id, LLAIRContext &context)
     : d_context(context)
     , d_llmodule(new llvm::Module(id, context.getLLContext())) {
     LLAIRContextImpl::Get(d_context).modules().insert(std::make_pair(d_llmodule.get(), this));
+    ++LLAIRContextImpl::Get(d_context).modules_created();
 
     d_llmodule->setDataLayout(context.getDataLayout());
     d_llmodule->setTargetTriple(context.getTargetTriple());
@@ -187,6 +252,7 @@ Module::Module(std::unique_ptr<llvm::Module> &&module)
     : d_context(*LLAIRContext::Get(&module->getContext()))
     , d_llmodule(std::move(module)) {
     LLAIRContextImpl::Get(d_context).modules().insert(std::make_pair(d_llmodule.get(), this));
+    ++LLAIRContextImpl::Get(d_context).modules_created();
 
     auto version_named_md = d_llmodule->getOrInsertNamedMetadata("air.version");
     if (version_named_md->getNumOperands() > 0) {
@@ -208,8 +274,55 @@ Module::~Module() {
     LLAIRContextImpl::Get(d_context).modules().erase(d_llmodule.get());
 }
 
+void
+Module::updateABIIndex() {
+    if (auto named_md = d_llmodule->getNamedMetadata(kABIIndexName); named_md) {
+        d_llmodule->eraseNamedMetadata(named_md);
+    }
+
+    std::vector<llvm::Function *> functions;
+    std::vector<llvm::StringRef>  names;
+
+    std::for_each(
+        d_llmodule->begin(), d_llmodule->end(),
+        [&functions, &names](auto &function) -> void {
+            functions.push_back(&function);
+            names.push_back(function.getName());
+        });
+
+    auto class_method_names = demangleClassMethodNames(names);
+
+    auto &ll_context = getLLContext();
+
+    std::vector<llvm::Metadata *> operands;
+    operands.reserve(1 + class_method_names.size() * 4);
+
+    operands.push_back(llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(
+        llvm::Type::getInt64Ty(ll_context), hashFunctionNames(*d_llmodule))));
+
+    std::for_each(
+        class_method_names.begin(), class_method_names.end(),
+        [&ll_context, &functions, &names, &operands](const auto &class_method_name) -> void {
+            auto name = names[class_method_name.index];
+
+            operands.push_back(llvm::ConstantAsMetadata::get(functions[class_method_name.index]));
+            operands.push_back(writeMDInt(ll_context, class_method_name.class_name.begin() - name.begin()));
+            operands.push_back(writeMDInt(ll_context, class_method_name.class_name.size()));
+            operands.push_back(writeMDInt(ll_context, class_method_name.method_name.begin() - name.begin()));
+        });
+
+    d_llmodule->getOrInsertNamedMetadata(kABIIndexName)->addOperand(
+        llvm::MDTuple::get(ll_context, operands));
+}
+
+llvm::Error
+Module::materializeAll() {
+    return d_llmodule->materializeAll();
+}
+
 std::unique_ptr<llvm::Module>
 Module::releaseLLModule() {
+    LLAIRContextImpl::Get(d_context).modules().erase(d_llmodule.get());
     return std::move(d_llmodule);
 }
 
@@ -304,24 +417,33 @@ struct InterfaceSpec {
 
 std::vector<Interface *>
 Module::getAllInterfacesFromABI() const {
-    llvm::StringMap<InterfaceSpec> interface_specs;
+    std::vector<const llvm::Function *> functions;
+    std::vector<llvm::StringRef> names;
 
     std::for_each(
         getLLModule()->begin(), getLLModule()->end(),
-        [this, &interface_specs](auto &function) -> void {
+        [&functions, &names](const auto &function) -> void {
             if (!function.isDeclarationForLinker()) {
                 return;
             }
 
-            auto names = parseClassPathAndMethodName(&function);
-            if (!names) {
-                return;
-            }
+            functions.push_back(&function);
+            names.push_back(function.getName());
+        });
+
+    auto class_method_names = getClassMethodNames(*getLLModule(), names);
+
+    llvm::MapVector<llvm::StringRef, InterfaceSpec> interface_specs;
+
+    std::for_each(
+        class_method_names.begin(), class_method_names.end(),
+        [&functions, &interface_specs](const auto &class_method_name) -> void {
+            auto function = functions[class_method_name.index];
 
-            auto interface_name  = std::get<0>(*names);
-            auto method_name = std::get<2>(*names);
+            auto interface_name = class_method_name.class_name;
+            auto method_name    = class_method_name.method_name;
 
-            auto type = getSelfType(&function);
+            auto type = getSelfType(function);
             if (!type) {
                 return;
             }
@@ -334,8 +456,8 @@ Module::getAllInterfacesFromABI() const {
             assert(interface_spec.type == *type);
 
             interface_spec.method_names.push_back(method_name);
-            interface_spec.method_qualified_names.push_back(function.getName());
-            interface_spec.method_types.push_back(function.getFunctionType());
+            interface_spec.method_qualified_names.push_back(function->getName());
+            interface_spec.method_types.push_back(function->getFunctionType());
         });
 
     std::vector<Interface *> interfaces;
@@ -345,7 +467,7 @@ Module::getAllInterfacesFromABI() const {
         interface_specs.begin(), interface_specs.end(),
         std::back_inserter(interfaces),
         [this](const auto& entry) -> Interface * {
-            const auto& interface_spec = entry.getValue();
+            const auto& interface_spec = entry.second;
 
             return Interface::get(getContext(), interface_spec.type, interface_spec.method_names, interface_spec.method_qualified_names, interface_spec.method_types);
         });
@@ -380,28 +502,37 @@ Module::getOrLoadClassFromABI(llvm::StringRef name) {
         return klass;
     }
 
-    ClassSpec class_spec;
+    std::vector<llvm::Function *> functions;
+    std::vector<llvm::StringRef> names;
 
     std::for_each(
         getLLModule()->begin(), getLLModule()->end(),
-        [this, name, &class_spec](auto &function) -> void {
+        [&functions, &names](auto &function) -> void {
             if (!function.isStrongDefinitionForLinker()) {
                 return;
             }
 
-            auto names = parseClassPathAndMethodName(&function);
-            if (!names) {
-                return;
-            }
+            functions.push_back(&function);
+            names.push_back(function.getName());
+        });
 
-            auto class_name  = std::get<0>(*names);
-            auto method_name = std::get<2>(*names);
+    auto class_method_names = getClassMethodNames(*getLLModule(), names);
+
+    ClassSpec class_spec;
+
+    std::for_each(
+        class_method_names.begin(), class_method_names.end(),
+        [name, &functions, &class_spec](const auto &class_method_name) -> void {
+            auto function = functions[class_method_name.index];
+
+            auto class_name  = class_method_name.class_name;
+            auto method_name = class_method_name.method_name;
 
             if (class_name != name) {
                 return;
             }
 
-            auto type = getSelfType(&function);
+            auto type = getSelfType(function);
             if (!type) {
                 return;
             }
@@ -412,7 +543,7 @@ Module::getOrLoadClassFromABI(llvm::StringRef name) {
             assert(class_spec.type == *type);
 
             class_spec.method_names.push_back(method_name);
-            class_spec.method_functions.push_back(&function);
+            class_spec.method_functions.push_back(function);
         });
 
     if (!class_spec.valid()) {
@@ -424,33 +555,45 @@ Module::getOrLoadClassFromABI(llvm::StringRef name) {
 
 std::vector<Class *>
 Module::getOrLoadAllClassesFromABI() {
-    std::vector<Class *> classes;
-
-    llvm::StringMap<ClassSpec> class_specs;
+    std::vector<llvm::Function *> functions;
+    std::vector<llvm::StringRef> names;
 
     std::for_each(
         getLLModule()->begin(), getLLModule()->end(),
-        [this, &classes, &class_specs](auto &function) -> void {
+        [&functions, &names](auto &function) -> void {
             if (!function.isStrongDefinitionForLinker()) {
                 return;
             }
 
-            auto names = parseClassPathAndMethodName(&function);
-            if (!names) {
-                return;
-            }
+            functions.push_back(&function);
+            names.push_back(function.getName());
+        });
+
+    auto class_method_names = getClassMethodNames(*getLLModule(), names);
+
+    std::vector<Class *> classes;
+    llvm::SmallPtrSet<Class *, 8> loaded_classes;
+
+    llvm::MapVector<llvm::StringRef, ClassSpec> class_specs;
+
+    std::for_each(
+        class_method_names.begin(), class_method_names.end(),
+        [this, &functions, &classes, &loaded_classes, &class_specs](const auto &class_method_name) -> void {
+            auto function = functions[class_method_name.index];
 
-            auto class_name  = std::get<0>(*names);
+            auto class_name = class_method_name.class_name;
 
             auto klass = getClass(class_name);
             if (klass) {
-                classes.push_back(klass);
+                if (loaded_classes.insert(klass).second) {
+                    classes.push_back(klass);
+                }
                 return;
             }
 
-            auto method_name = std::get<2>(*names);
+            auto method_name = class_method_name.method_name;
 
-            auto type = getSelfType(&function);
+            auto type = getSelfType(function);
             if (!type) {
                 return;
             }
@@ -463,14 +606,14 @@ Module::getOrLoadAllClassesFromABI() {
             assert(class_spec.type == *type);
 
             class_spec.method_names.push_back(method_name);
-            class_spec.method_functions.push_back(&function);
+            class_spec.method_functions.push_back(function);
         });
 
     std::for_each(
         class_specs.begin(), class_specs.end(),
         [this, &classes](const auto& entry) -> void {
-            auto name = entry.getKey();
-            const auto& class_spec = entry.getValue();
+            auto name = entry.first;
+            const auto& class_spec = entry.second;
 
             auto named = d_class_symbol_table.lookup(name);
             if (named) {
@@ -515,222 +658,287 @@ Module::getOrInsertDispatchers(Interface *interface) {
 
 namespace {
 
-template <typename Input1, typename Input2, typename BinaryFunction1, typename BinaryFunction2,
-          typename Compare>
-void
-for_each_symmetric_difference(Input1 first1, Input1 last1, Input2 first2, Input2 last2,
-                              BinaryFunction1 fn1, BinaryFunction2 fn2, Compare comp) {
-    while (first1 != last1) {
-        if (first2 == last2) {
-            std::for_each(first1, last1, fn1);
-            return;
-        }
+// Named metadata that Module::syncMetadata() reconciles with the object lists:
+const char *const kSyncedMetadataNames[] = {
+    "air.vertex", "air.fragment", "air.kernel", "llair.class", "llair.dispatcher"
+};
 
-        if (comp(*first1, *first2)) {
-            fn1(*first1++);
-        }
-        else {
-            if (comp(*first2, *first1)) {
-                fn2(*first2);
-            }
-            else {
-                ++first1;
-            }
-            ++first2;
-        }
+} // namespace
+
+void
+Module::syncMetadata() {
+    if (d_metadata_dirty) {
+        syncMetadata(true);
+        return;
     }
-    std::for_each(first2, last2, fn2);
+
+    // Operands are only ever appended or nulled out in place; anything else means the named
+    // metadata was edited behind our back:
+    auto shrunk = std::any_of(
+        std::begin(kSyncedMetadataNames), std::end(kSyncedMetadataNames),
+        [this](auto name) -> bool {
+            auto md = d_llmodule->getNamedMetadata(name);
+            auto it = d_synced_metadata_operands.find(name);
+
+            return it != d_synced_metadata_operands.end() &&
+                   it->second > (md ? md->getNumOperands() : 0);
+        });
+
+    syncMetadata(shrunk);
 }
 
-} // namespace
+void
+Module::resyncMetadata() {
+    syncMetadata(true);
+}
 
 void
-Module::syncMetadata() {
-    // Entry points:
-    {
-        auto module = this;
-
-        std::vector<EntryPoint *> entry_points;
-        std::transform(d_entry_points.begin(), d_entry_points.end(),
-                       std::back_inserter(entry_points),
-                       [](auto &entry_point) -> EntryPoint * { return &entry_point; });
-        std::sort(entry_points.begin(), entry_points.end(),
-                  [](auto lhs, auto rhs) -> bool { return lhs->metadata() < rhs->metadata(); });
-
-        // Vertex:
-        {
-            auto md = d_llmodule->getNamedMetadata("air.vertex");
-
-            if (md) {
-                std::vector<llvm::MDNode *> mds;
-                std::copy(md->op_begin(), md->op_end(), std::back_inserter(mds));
-                std::sort(mds.begin(), mds.end());
-
-                std::vector<EntryPoint *> vertex_entry_points;
-                std::copy_if(entry_points.begin(), entry_points.end(),
-                             std::back_inserter(vertex_entry_points), [](auto entry_point) -> bool {
-                                 return entry_point->getKind() ==
-                                        EntryPoint::EntryPointKind::Vertex;
-                             });
-
-                struct Compare {
-                    bool operator()(llvm::MDNode *lhs, EntryPoint *rhs) const {
-                        return lhs < rhs->metadata();
-                    }
-                    bool operator()(EntryPoint *lhs, llvm::MDNode *rhs) const {
-                        return lhs->metadata() < rhs;
-                    }
-                };
-
-                for_each_symmetric_difference(
-                    mds.begin(), mds.end(), vertex_entry_points.begin(), vertex_entry_points.end(),
-                    [&](llvm::MDNode *md) -> void {
-                        auto entry_point = new VertexEntryPoint(md, module);
-                    },
-                    [](EntryPoint *entry_point) -> void {}, Compare());
-            }
+Module::syncMetadata(bool full) {
+    // When doing a full sync, operands that already have an object are skipped, but their
+    // operand indices are refreshed:
+    llvm::DenseMap<const llvm::Metadata *, llvm::Optional<unsigned> *> known;
+
+    if (full) {
+        std::for_each(
+            d_entry_points.begin(), d_entry_points.end(),
+            [&known](auto &entry_point) -> void {
+                known.insert({ entry_point.metadata(), &entry_point.d_module_md_index });
+            });
+        std::for_each(
+            d_classes.begin(), d_classes.end(),
+            [&known](auto &klass) -> void {
+                known.insert({ klass.metadata(), &klass.d_module_md_index });
+            });
+        std::for_each(
+            d_dispatchers.begin(), d_dispatchers.end(),
+            [&known](auto &dispatcher) -> void {
+                known.insert({ dispatcher.metadata(), &dispatcher.d_module_md_index });
+            });
+    }
+
+    auto sync = [this, full, &known](llvm::StringRef name, auto create) -> void {
+        auto  md     = d_llmodule->getNamedMetadata(name);
+        auto &synced = d_synced_metadata_operands[name];
+
+        if (!md) {
+            synced = 0;
+            return;
         }
 
-        // Fragment:
-        {
-            auto md = d_llmodule->getNamedMetadata("air.fragment");
-
-            if (md) {
-                std::vector<llvm::MDNode *> mds;
-                std::copy(md->op_begin(), md->op_end(), std::back_inserter(mds));
-                std::sort(mds.begin(), mds.end());
-
-                std::vector<EntryPoint *> fragment_entry_points;
-                std::copy_if(
-                    entry_points.begin(), entry_points.end(),
-                    std::back_inserter(fragment_entry_points), [](auto entry_point) -> bool {
-                        return entry_point->getKind() == EntryPoint::EntryPointKind::Fragment;
-                    });
-
-                struct Compare {
-                    bool operator()(llvm::MDNode *lhs, EntryPoint *rhs) const {
-                        return lhs < rhs->metadata();
-                    }
-                    bool operator()(EntryPoint *lhs, llvm::MDNode *rhs) const {
-                        return lhs->metadata() < rhs;
-                    }
-                };
-
-                for_each_symmetric_difference(mds.begin(), mds.end(), fragment_entry_points.begin(),
-                                              fragment_entry_points.end(),
-                                              [&](llvm::MDNode *md) -> void {
-                                                  auto entry_point =
-                                                      new FragmentEntryPoint(md, module);
-                                              },
-                                              [](EntryPoint *entry_point) -> void {}, Compare());
+        for (unsigned i = full ? 0 : synced, n = md->getNumOperands(); i < n; ++i) {
+            auto operand = md->getOperand(i);
+
+            // Removed objects leave a null operand behind:
+            if (!operand) {
+                continue;
             }
-        }
 
-        // Compute:
-        {
-            auto md = d_llmodule->getNamedMetadata("air.kernel");
-
-            if (md) {
-                std::vector<llvm::MDNode *> mds;
-                std::copy(md->op_begin(), md->op_end(), std::back_inserter(mds));
-                std::sort(mds.begin(), mds.end());
-
-                std::vector<EntryPoint *> compute_entry_points;
-                std::copy_if(
-                    entry_points.begin(), entry_points.end(),
-                    std::back_inserter(compute_entry_points), [](auto entry_point) -> bool {
-                        return entry_point->getKind() == EntryPoint::EntryPointKind::Compute;
-                    });
-
-                struct Compare {
-                    bool operator()(llvm::MDNode *lhs, EntryPoint *rhs) const {
-                        return lhs < rhs->metadata();
-                    }
-                    bool operator()(EntryPoint *lhs, llvm::MDNode *rhs) const {
-                        return lhs->metadata() < rhs;
+            if (full) {
+                auto [it, inserted] = known.insert({ operand, nullptr });
+
+                if (!inserted) {
+                    // Duplicate operands are left alone:
+                    if (it->second) {
+                        *it->second = i;
+                        it->second  = nullptr;
                     }
-                };
-
-                for_each_symmetric_difference(mds.begin(), mds.end(), compute_entry_points.begin(),
-                                              compute_entry_points.end(),
-                                              [&](llvm::MDNode *md) -> void {
-                                                  auto entry_point =
-                                                      new ComputeEntryPoint(md, module);
-                                              },
-                                              [](EntryPoint *entry_point) -> void {}, Compare());
+                    continue;
+                }
             }
+
+            create(operand)->d_module_md_index = i;
         }
+
+        synced = md->getNumOperands();
+    };
+
+    sync("air.vertex", [this](llvm::MDNode *md) -> EntryPoint * {
+        return new VertexEntryPoint(md, this);
+    });
+    sync("air.fragment", [this](llvm::MDNode *md) -> EntryPoint * {
+        return new FragmentEntryPoint(md, this);
+    });
+    sync("air.kernel", [this](llvm::MDNode *md) -> EntryPoint * {
+        return new ComputeEntryPoint(md, this);
+    });
+    sync("llair.class", [this](llvm::MDNode *md) -> Class * {
+        return Class::Create(md, this);
+    });
+    sync("llair.dispatcher", [this](llvm::MDNode *md) -> Dispatcher * {
+        return Dispatcher::Create(md, this);
+    });
+
+    d_metadata_dirty = false;
+}
+
+unsigned
+Module::appendMetadataOperand(llvm::NamedMDNode *md, llvm::MDNode *operand) {
+    auto it = d_synced_metadata_operands.find(md->getName());
+    auto synced = it != d_synced_metadata_operands.end() ? it->second : 0;
+
+    auto index = md->getNumOperands();
+    md->addOperand(operand);
+
+    // If everything before the new operand was already reconciled, so is the new operand;
+    // otherwise the next sync can't tell it apart from the pending ones:
+    if (synced == index) {
+        d_synced_metadata_operands[md->getName()] = index + 1;
+    }
+    else {
+        d_metadata_dirty = true;
     }
 
-    // Classes:
-    {
-        std::vector<Class *> classes;
-        std::transform(
-            d_classes.begin(), d_classes.end(),
-            std::back_inserter(classes),
-            [](auto &klass) -> Class * { return &klass; });
-        std::sort(
-            classes.begin(), classes.end(),
-            [](auto lhs, auto rhs) -> bool { return lhs->metadata() < rhs->metadata(); });
-
-        auto md = d_llmodule->getNamedMetadata("llair.class");
-
-        if (md) {
-            struct Compare {
-                bool operator()(llvm::Metadata *lhs, Class *rhs) const {
-                    return lhs < rhs->metadata();
-                }
-                bool operator()(Class *lhs, llvm::Metadata *rhs) const {
-                    return lhs->metadata() < rhs;
-                }
-            };
+    return index;
+}
 
-            for_each_symmetric_difference(
-                md->op_begin(), md->op_end(),
-                classes.begin(), classes.end(),
-                [&](llvm::Metadata *md) -> void {
-                    Class::Create(md, this);
-                },
-                [](Class *) -> void {
-                },
-                Compare());
+void
+Module::removeMetadataOperand(llvm::NamedMDNode *md, llvm::MDNode *operand,
+                              llvm::Optional<unsigned> index) {
+    // The recorded index goes stale if the named metadata is edited directly:
+    if (!index || *index >= md->getNumOperands() || md->getOperand(*index) != operand) {
+        auto it = std::find(md->op_begin(), md->op_end(), operand);
+        if (it == md->op_end()) {
+            return;
         }
+
+        index = std::distance(md->op_begin(), it);
     }
 
-    // Dispatchers:
-    {
-        std::vector<Dispatcher *> dispatchers;
-        std::transform(
-            d_dispatchers.begin(), d_dispatchers.end(),
-            std::back_inserter(dispatchers),
-            [](auto &dispatcher) -> Dispatcher * { return &dispatcher; });
-        std::sort(
-            dispatchers.begin(), dispatchers.end(),
-            [](auto lhs, auto rhs) -> bool { return lhs->metadata() < rhs->metadata(); });
-
-        auto md = d_llmodule->getNamedMetadata("llair.dispatcher");
-
-        if (md) {
-            struct Compare {
-                bool operator()(llvm::Metadata *lhs, Dispatcher *rhs) const {
-                    return lhs < rhs->metadata();
+    md->setOperand(*index, nullptr);
+}
+
+void
+Module::compactMetadata() {
+    llvm::DenseMap<const llvm::Metadata *, unsigned> indices;
+
+    std::for_each(
+        std::begin(kSyncedMetadataNames), std::end(kSyncedMetadataNames),
+        [this, &indices](auto name) -> void {
+            auto md = d_llmodule->getNamedMetadata(name);
+
+            if (!md) {
+                return;
+            }
+
+            auto it = d_synced_metadata_operands.find(name);
+            auto synced = it != d_synced_metadata_operands.end() ? it->second : 0;
+
+            llvm::SmallVector<llvm::MDNode *, 16> operands;
+            operands.reserve(md->getNumOperands());
+
+            unsigned compacted_synced = 0;
+
+            for (unsigned i = 0, n = md->getNumOperands(); i < n; ++i) {
+                auto operand = md->getOperand(i);
+
+                if (!operand) {
+                    continue;
                 }
-                bool operator()(Dispatcher *lhs, llvm::Metadata *rhs) const {
-                    return lhs->metadata() < rhs;
+
+                if (i < synced) {
+                    ++compacted_synced;
                 }
-            };
 
-            for_each_symmetric_difference(
-                md->op_begin(), md->op_end(),
-                dispatchers.begin(), dispatchers.end(),
-                [&](llvm::Metadata *md) -> void {
-                    Dispatcher::Create(md, this);
-                },
-                [](Dispatcher *) -> void {
-                },
-                Compare());
+                indices.insert({ operand, operands.size() });
+                operands.push_back(operand);
+            }
+
+            if (operands.size() == md->getNumOperands()) {
+                return;
+            }
+
+            md->clearOperands();
+            std::for_each(
+                operands.begin(), operands.end(),
+                [md](auto operand) -> void { md->addOperand(operand); });
+
+            if (it != d_synced_metadata_operands.end()) {
+                it->second = compacted_synced;
+            }
+        });
+
+    auto remap = [&indices](const llvm::Metadata *md, llvm::Optional<unsigned> &index) -> void {
+        auto it = indices.find(md);
+        if (it != indices.end()) {
+            index = it->second;
+        }
+        else {
+            index.reset();
         }
+    };
+
+    std::for_each(
+        d_entry_points.begin(), d_entry_points.end(),
+        [&remap](auto &entry_point) -> void {
+            remap(entry_point.metadata(), entry_point.d_module_md_index);
+        });
+    std::for_each(
+        d_classes.begin(), d_classes.end(),
+        [&remap](auto &klass) -> void { remap(klass.metadata(), klass.d_module_md_index); });
+    std::for_each(
+        d_dispatchers.begin(), d_dispatchers.end(),
+        [&remap](auto &dispatcher) -> void {
+            remap(dispatcher.metadata(), dispatcher.d_module_md_index);
+        });
+}
+
+void
+Module::canonicalize() {
+    auto by_name = [](const auto& lhs, const auto& rhs) -> bool {
+        return lhs.getName() < rhs.getName();
+    };
+
+    // Symbol tables aren't affected by the order of the lists:
+    d_llmodule->getGlobalList().sort(by_name);
+    d_llmodule->getFunctionList().sort(by_name);
+    d_llmodule->getAliasList().sort(by_name);
+
+    StructuralHasher hasher;
+
+    std::for_each(
+        std::begin(kSyncedMetadataNames), std::end(kSyncedMetadataNames),
+        [this, &hasher](auto name) -> void {
+            auto md = d_llmodule->getNamedMetadata(name);
+
+            if (!md) {
+                return;
+            }
+
+            std::vector<std::pair<uint64_t, llvm::MDNode *>> operands;
+            operands.reserve(md->getNumOperands());
+
+            std::for_each(
+                md->op_begin(), md->op_end(),
+                [&hasher, &operands](auto operand) -> void {
+                    if (operand) {
+                        operands.push_back({ hasher.hash(operand), operand });
+                    }
+                });
+
+            std::stable_sort(
+                operands.begin(), operands.end(),
+                [](const auto& lhs, const auto& rhs) -> bool { return lhs.first < rhs.first; });
+
+            md->clearOperands();
+            std::for_each(
+                operands.begin(), operands.end(),
+                [md](const auto& operand) -> void { md->addOperand(operand.second); });
+        });
+
+    // Refreshes the objects' operand indices:
+    resyncMetadata();
+}
+
+llvm::Expected<uint64_t>
+Module::structuralHash() const {
+    if (auto error = d_llmodule->materializeAll()) {
+        return std::move(error);
     }
+
+    llvm::SmallVector<llvm::StringRef, 8> unordered_names(std::begin(kSyncedMetadataNames),
+                                                          std::end(kSyncedMetadataNames));
+
+    return StructuralHasher(unordered_names).hash(*d_llmodule);
 }
 
 void
@@ -3,11 +3,14 @@
 #include <llair/IR/Named.h>
 #include <llair/IR/SymbolTable.h>
 
-#include "LLAIRContextImpl.h"
-
 namespace llair {
 
 Named::~Named() {
+    if (d_symbol_table && hasName()) {
+        d_symbol_table->removeSymbolTableEntry(getSymbolTableEntry());
+    }
+
+    destroySymbolTableEntry();
 }
 
 void
@@ -24,39 +27,9 @@ Named::setSymbolTable(SymbolTable *symbol_table) {
     setName(name);
 }
 
-void
-Named::setSymbolTableEntry(SymbolTableEntry *symbol_table_entry) {
-    auto& context_impl = LLAIRContextImpl::Get(getContext());
-
-    if (!symbol_table_entry) {
-        if (d_has_name) {
-            context_impl.names().erase(this);
-            d_has_name = false;
-        }
-
-        return;
-    }
-
-    d_has_name = true;
-    context_impl.names()[this] = symbol_table_entry;
-}
-
-SymbolTableEntry *
-Named::getSymbolTableEntry() const {
-    if (!d_has_name) {
-        return nullptr;
-    }
-
-    auto& context_impl = LLAIRContextImpl::Get(getContext());
-    auto it = context_impl.names().find(this);
-    assert(it != context_impl.names().end());
-
-    return it->second;
-}
-
 void
 Named::setName(llvm::StringRef name) {
-    if (!d_has_name && name.empty()) {
+    if (!hasName() && name.empty()) {
         return;
     }
 
@@ -77,7 +50,7 @@ Named::setName(llvm::StringRef name) {
         return;
     }
 
-    if (d_has_name) {
+    if (hasName()) {
         d_symbol_table->removeSymbolTableEntry(getSymbolTableEntry());
         destroySymbolTableEntry();
 
@@ -89,15 +62,6 @@ Named::setName(llvm::StringRef name) {
     setSymbolTableEntry(d_symbol_table->createSymbolTableEntry(name, this));
 }
 
-llvm::StringRef
-Named::getName() const {
-    if (!d_has_name) {
-        return llvm::StringRef("", 0);
-    }
-
-    return getSymbolTableEntry()->getKey();
-}
-
 void
 Named::destroySymbolTableEntry() {
     if (auto symbol_table_entry = getSymbolTableEntry()) {
@@ -0,0 +1,582 @@
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "StructuralHash.h"
+
+namespace llair {
+
+// Collects the parts of one thing that's hashed; strings are length-prefixed, so that ("ab", "c")
+// and ("a", "bc") differ:
+class StructuralHasher::Buffer {
+public:
+
+    Buffer& add(uint64_t value) {
+        char bytes[sizeof(uint64_t)];
+        llvm::support::endian::write64le(bytes, value);
+        d_data.append(bytes, bytes + sizeof(bytes));
+        return *this;
+    }
+
+    Buffer& add(llvm::StringRef value) {
+        add(uint64_t(value.size()));
+        d_data.append(value.begin(), value.end());
+        return *this;
+    }
+
+    Buffer& add(char tag) {
+        d_data.push_back(tag);
+        return *this;
+    }
+
+    uint64_t hash() const {
+        return llvm::xxHash64(d_data);
+    }
+
+private:
+
+    llvm::SmallString<256> d_data;
+};
+
+namespace {
+
+std::string
+toHexString(const llvm::APInt& value) {
+#if LLVM_VERSION_MAJOR >= 13
+    return llvm::toString(value, 16, false);
+#else
+    return value.toString(16, false);
+#endif
+}
+
+// Most of what an instruction's (or a constant expression's) operands don't say is kept in the
+// value's subclass data: a call's tail call kind and calling convention, an atomic operation, its
+// ordering and alignment, a comparison's predicate, and so on. Hashing it all means that nothing is
+// missed when LLVM adds to it. It's protected, but a member pointer named through a subclass can
+// read it:
+struct SubclassDataAccess : llvm::Value {
+    using llvm::Value::getSubclassDataFromValue;
+};
+
+uint64_t
+getSubclassData(const llvm::Value& value) {
+    return (value.*(&SubclassDataAccess::getSubclassDataFromValue))();
+}
+
+llvm::Optional<llvm::SyncScope::ID>
+getSyncScopeID(const llvm::Instruction& instruction) {
+    if (auto load = llvm::dyn_cast<llvm::LoadInst>(&instruction)) {
+        return load->getSyncScopeID();
+    }
+    if (auto store = llvm::dyn_cast<llvm::StoreInst>(&instruction)) {
+        return store->getSyncScopeID();
+    }
+    if (auto fence = llvm::dyn_cast<llvm::FenceInst>(&instruction)) {
+        return fence->getSyncScopeID();
+    }
+    if (auto cmpxchg = llvm::dyn_cast<llvm::AtomicCmpXchgInst>(&instruction)) {
+        return cmpxchg->getSyncScopeID();
+    }
+    if (auto rmw = llvm::dyn_cast<llvm::AtomicRMWInst>(&instruction)) {
+        return rmw->getSyncScopeID();
+    }
+    return llvm::None;
+}
+
+// Prints a debug info node without its operands, which are hashed separately; what's left are the
+// fields that the node keeps outside of them (a location's line and column, say). Without a module,
+// references print as addresses, which are removed:
+std::string
+getFieldsAsString(const llvm::MDNode& node) {
+    std::string              printed;
+    llvm::raw_string_ostream os(printed);
+    node.print(os);
+    os.flush();
+
+    std::string fields;
+    fields.reserve(printed.size());
+
+    for (std::size_t i = 0, n = printed.size(); i < n; ++i) {
+        if (printed.compare(i, 3, "<0x") == 0) {
+            auto end = printed.find('>', i);
+
+            if (end != std::string::npos) {
+                i = end;
+                continue;
+            }
+        }
+
+        fields.push_back(printed[i]);
+    }
+
+    return fields;
+}
+
+} // namespace
+
+StructuralHasher::StructuralHasher(llvm::ArrayRef<llvm::StringRef> unordered_metadata_names)
+    : d_unordered_metadata_names(unordered_metadata_names) {
+}
+
+uint64_t
+StructuralHasher::hash(const llvm::Module& module) {
+    module.getContext().getMDKindNames(d_metadata_kind_names);
+    module.getContext().getSyncScopeNames(d_sync_scope_names);
+
+    // Internal globals are hashed first, so that references to them can use their contents:
+    d_hashing_internals = true;
+
+    auto hashInternal = [this](const llvm::GlobalValue& global) -> void {
+        if (global.hasLocalLinkage()) {
+            d_internal_hashes[&global] = hashGlobal(global);
+        }
+    };
+
+    std::for_each(module.global_begin(), module.global_end(), hashInternal);
+    std::for_each(module.begin(), module.end(), hashInternal);
+
+    d_hashing_internals = false;
+    d_metadata_hashes.clear();
+
+    // Each global is hashed separately, and the hashes are sorted, so that their order doesn't
+    // matter:
+    std::vector<uint64_t> global_hashes;
+
+    auto hashGlobalValue = [this, &global_hashes](const llvm::GlobalValue& global) -> void {
+        global_hashes.push_back(hashGlobal(global));
+    };
+
+    std::for_each(module.global_begin(), module.global_end(), hashGlobalValue);
+    std::for_each(module.begin(), module.end(), hashGlobalValue);
+
+    std::sort(global_hashes.begin(), global_hashes.end());
+
+    Buffer buffer;
+    buffer.add(module.getTargetTriple()).add(module.getDataLayoutStr());
+
+    buffer.add(uint64_t(global_hashes.size()));
+    std::for_each(
+        global_hashes.begin(), global_hashes.end(),
+        [&buffer](auto global_hash) -> void { buffer.add(global_hash); });
+
+    // Named metadata, by name:
+    std::vector<const llvm::NamedMDNode *> named_mds;
+    std::transform(
+        module.named_metadata_begin(), module.named_metadata_end(),
+        std::back_inserter(named_mds),
+        [](const auto& named_md) -> const llvm::NamedMDNode * { return &named_md; });
+
+    std::sort(
+        named_mds.begin(), named_mds.end(),
+        [](auto lhs, auto rhs) -> bool { return lhs->getName() < rhs->getName(); });
+
+    std::for_each(
+        named_mds.begin(), named_mds.end(),
+        [this, &buffer](auto named_md) -> void {
+            // The ABI index is derived from the functions:
+            if (named_md->getName() == "llair.abi_index") {
+                return;
+            }
+
+            std::vector<uint64_t> operand_hashes;
+
+            std::for_each(
+                named_md->op_begin(), named_md->op_end(),
+                [this, &operand_hashes](auto operand) -> void {
+                    // Removed objects leave null operands behind:
+                    if (operand) {
+                        operand_hashes.push_back(hash(operand));
+                    }
+                });
+
+            auto unordered = std::find(d_unordered_metadata_names.begin(),
+                                       d_unordered_metadata_names.end(),
+                                       named_md->getName()) != d_unordered_metadata_names.end();
+
+            if (unordered) {
+                std::sort(operand_hashes.begin(), operand_hashes.end());
+            }
+
+            buffer.add(named_md->getName()).add(uint64_t(operand_hashes.size()));
+            std::for_each(
+                operand_hashes.begin(), operand_hashes.end(),
+                [&buffer](auto operand_hash) -> void { buffer.add(operand_hash); });
+        });
+
+    return buffer.hash();
+}
+
+uint64_t
+StructuralHasher::hash(const llvm::Metadata *md) {
+    if (!md) {
+        return 0;
+    }
+
+    if (auto it = d_metadata_hashes.find(md); it != d_metadata_hashes.end()) {
+        return it->second;
+    }
+
+    // A cycle refers back to this node by a placeholder:
+    d_metadata_hashes[md] = 1;
+
+    Buffer buffer;
+    buffer.add(uint64_t(md->getMetadataID()));
+
+    if (auto string_md = llvm::dyn_cast<llvm::MDString>(md)) {
+        buffer.add(string_md->getString());
+    }
+    else if (auto value_md = llvm::dyn_cast<llvm::ValueAsMetadata>(md)) {
+        addValue(buffer, value_md->getValue());
+    }
+#if LLVM_VERSION_MAJOR >= 13
+    else if (auto arguments = llvm::dyn_cast<llvm::DIArgList>(md)) {
+        // Its arguments aren't operands, and may be local values:
+        auto values = arguments->getArgs();
+        buffer.add(uint64_t(values.size()));
+
+        std::for_each(
+            values.begin(), values.end(),
+            [this, &buffer](auto value) -> void { addValue(buffer, value->getValue()); });
+    }
+#endif
+    else if (auto node = llvm::dyn_cast<llvm::MDNode>(md)) {
+        if (!llvm::isa<llvm::MDTuple>(node)) {
+            buffer.add(getFieldsAsString(*node));
+        }
+
+        buffer.add(uint64_t(node->isDistinct())).add(uint64_t(node->getNumOperands()));
+
+        std::for_each(
+            node->op_begin(), node->op_end(),
+            [this, &buffer](const auto& operand) -> void { buffer.add(hash(operand.get())); });
+    }
+
+    auto result = buffer.hash();
+    d_metadata_hashes[md] = result;
+
+    return result;
+}
+
+uint64_t
+StructuralHasher::hashGlobal(const llvm::GlobalValue& global) {
+    Buffer buffer;
+
+    // The names of internal globals don't matter:
+    buffer.add(global.hasLocalLinkage() ? llvm::StringRef() : global.getName())
+          .add(uint64_t(global.getLinkage()))
+          .add(uint64_t(global.getAddressSpace()))
+          .add(uint64_t(global.getVisibility()))
+          .add(uint64_t(global.getUnnamedAddr()))
+          .add(uint64_t(global.getDLLStorageClass()))
+          .add(uint64_t(global.getThreadLocalMode()))
+          .add(uint64_t(global.isDSOLocal()));
+    addType(buffer, global.getValueType());
+
+    if (auto object = llvm::dyn_cast<llvm::GlobalObject>(&global)) {
+        buffer.add(object->getSection()).add(uint64_t(object->getAlignment()));
+
+        if (auto comdat = object->getComdat()) {
+            buffer.add('C').add(comdat->getName()).add(uint64_t(comdat->getSelectionKind()));
+        }
+
+        llvm::SmallVector<std::pair<unsigned, llvm::MDNode *>, 4> mds;
+        object->getAllMetadata(mds);
+        addAttachments(buffer, mds);
+    }
+
+    if (auto variable = llvm::dyn_cast<llvm::GlobalVariable>(&global)) {
+        buffer.add('V').add(uint64_t(variable->isConstant()))
+              .add(uint64_t(variable->isExternallyInitialized()))
+              .add(variable->getAttributes().getAsString());
+
+        if (variable->hasInitializer()) {
+            addConstant(buffer, variable->getInitializer());
+        }
+    }
+    else if (auto function = llvm::dyn_cast<llvm::Function>(&global)) {
+        buffer.add('F').add(uint64_t(function->getCallingConv()));
+
+        auto attributes = function->getAttributes();
+        buffer.add(attributes.getAsString(llvm::AttributeList::FunctionIndex))
+              .add(attributes.getAsString(llvm::AttributeList::ReturnIndex));
+
+        for (unsigned i = 0, n = function->arg_size(); i < n; ++i) {
+            buffer.add(attributes.getAsString(llvm::AttributeList::FirstArgIndex + i));
+        }
+
+        buffer.add(function->hasGC() ? llvm::StringRef(function->getGC()) : llvm::StringRef());
+
+        // A function's other constants:
+        auto addOptional = [this, &buffer](bool has, auto get) -> void {
+            buffer.add(uint64_t(has));
+
+            if (has) {
+                addConstant(buffer, get());
+            }
+        };
+
+        addOptional(function->hasPersonalityFn(), [function]() -> llvm::Constant * { return function->getPersonalityFn(); });
+        addOptional(function->hasPrefixData(), [function]() -> llvm::Constant * { return function->getPrefixData(); });
+        addOptional(function->hasPrologueData(), [function]() -> llvm::Constant * { return function->getPrologueData(); });
+
+        if (!function->isDeclaration()) {
+            buffer.add(hashFunctionBody(*function));
+        }
+    }
+
+    return buffer.hash();
+}
+
+uint64_t
+StructuralHasher::hashFunctionBody(const llvm::Function& function) {
+    d_locals.clear();
+
+    unsigned position = 0;
+
+    std::for_each(
+        function.arg_begin(), function.arg_end(),
+        [this, &position](const auto& argument) -> void { d_locals[&argument] = position++; });
+
+    for (const auto& block : function) {
+        d_locals[&block] = position++;
+
+        for (const auto& instruction : block) {
+            d_locals[&instruction] = position++;
+        }
+    }
+
+    Buffer buffer;
+
+    for (const auto& block : function) {
+        buffer.add('B').add(uint64_t(block.size()));
+
+        std::for_each(
+            block.begin(), block.end(),
+            [this, &buffer](const auto& instruction) -> void { addInstruction(buffer, instruction); });
+    }
+
+    d_locals.clear();
+
+    return buffer.hash();
+}
+
+void
+StructuralHasher::addInstruction(Buffer& buffer, const llvm::Instruction& instruction) {
+    buffer.add(uint64_t(instruction.getOpcode()))
+          .add(uint64_t(instruction.getRawSubclassOptionalData()))
+          .add(getSubclassData(instruction));
+    addType(buffer, instruction.getType());
+
+    // What the operands and the subclass data don't say:
+    if (auto alloca = llvm::dyn_cast<llvm::AllocaInst>(&instruction)) {
+        addType(buffer, alloca->getAllocatedType());
+    }
+    else if (auto gep = llvm::dyn_cast<llvm::GetElementPtrInst>(&instruction)) {
+        addType(buffer, gep->getSourceElementType());
+    }
+    else if (auto call = llvm::dyn_cast<llvm::CallBase>(&instruction)) {
+        addType(buffer, call->getFunctionType());
+
+        auto attributes = call->getAttributes();
+        buffer.add(attributes.getAsString(llvm::AttributeList::FunctionIndex))
+              .add(attributes.getAsString(llvm::AttributeList::ReturnIndex));
+
+        for (unsigned i = 0, n = call->arg_size(); i < n; ++i) {
+            buffer.add(attributes.getAsString(llvm::AttributeList::FirstArgIndex + i));
+        }
+
+        // The bundles' inputs are among the operands:
+        for (unsigned i = 0, n = call->getNumOperandBundles(); i < n; ++i) {
+            auto bundle = call->getOperandBundleAt(i);
+            buffer.add(bundle.getTagName()).add(uint64_t(bundle.Inputs.size()));
+        }
+    }
+    else if (auto phi = llvm::dyn_cast<llvm::PHINode>(&instruction)) {
+        std::for_each(
+            phi->block_begin(), phi->block_end(),
+            [this, &buffer](auto block) -> void { addValue(buffer, block); });
+    }
+    else if (auto extract = llvm::dyn_cast<llvm::ExtractValueInst>(&instruction)) {
+        std::for_each(
+            extract->idx_begin(), extract->idx_end(),
+            [&buffer](auto index) -> void { buffer.add(uint64_t(index)); });
+    }
+    else if (auto insert = llvm::dyn_cast<llvm::InsertValueInst>(&instruction)) {
+        std::for_each(
+            insert->idx_begin(), insert->idx_end(),
+            [&buffer](auto index) -> void { buffer.add(uint64_t(index)); });
+    }
+    else if (auto shuffle = llvm::dyn_cast<llvm::ShuffleVectorInst>(&instruction)) {
+        auto mask = shuffle->getShuffleMask();
+
+        std::for_each(
+            mask.begin(), mask.end(),
+            [&buffer](auto element) -> void { buffer.add(uint64_t(element)); });
+    }
+
+    if (auto scope = getSyncScopeID(instruction)) {
+        buffer.add(*scope < d_sync_scope_names.size() ? d_sync_scope_names[*scope]
+                                                      : llvm::StringRef("?"));
+    }
+
+    buffer.add(uint64_t(instruction.getNumOperands()));
+
+    std::for_each(
+        instruction.op_begin(), instruction.op_end(),
+        [this, &buffer](const auto& operand) -> void { addValue(buffer, operand.get()); });
+
+    // Including the debug location:
+    llvm::SmallVector<std::pair<unsigned, llvm::MDNode *>, 4> mds;
+    instruction.getAllMetadata(mds);
+    addAttachments(buffer, mds);
+}
+
+void
+StructuralHasher::addAttachments(Buffer& buffer,
+                                 llvm::ArrayRef<std::pair<unsigned, llvm::MDNode *>> mds) {
+    buffer.add(uint64_t(mds.size()));
+
+    std::for_each(
+        mds.begin(), mds.end(),
+        [this, &buffer](auto tmp) -> void {
+            buffer.add(tmp.first < d_metadata_kind_names.size() ? d_metadata_kind_names[tmp.first]
+                                                                : llvm::StringRef("?"))
+                  .add(hash(tmp.second));
+        });
+}
+
+void
+StructuralHasher::addType(Buffer& buffer, llvm::Type *type) {
+    auto it = d_type_hashes.find(type);
+
+    if (it == d_type_hashes.end()) {
+        std::string              printed;
+        llvm::raw_string_ostream os(printed);
+        type->print(os);
+        os.flush();
+
+        it = d_type_hashes.insert({ type, llvm::xxHash64(printed) }).first;
+    }
+
+    buffer.add(it->second);
+}
+
+void
+StructuralHasher::addConstant(Buffer& buffer, const llvm::Constant *constant) {
+    addType(buffer, constant->getType());
+
+    if (auto global = llvm::dyn_cast<llvm::GlobalValue>(constant)) {
+        if (!global->hasLocalLinkage()) {
+            buffer.add('G').add(global->getName());
+        }
+        else if (d_hashing_internals) {
+            buffer.add('L');
+        }
+        else {
+            buffer.add('L').add(d_internal_hashes.lookup(global));
+        }
+    }
+    else if (auto integer = llvm::dyn_cast<llvm::ConstantInt>(constant)) {
+        buffer.add('I').add(uint64_t(integer->getBitWidth())).add(toHexString(integer->getValue()));
+    }
+    else if (auto fp = llvm::dyn_cast<llvm::ConstantFP>(constant)) {
+        buffer.add('F').add(toHexString(fp->getValueAPF().bitcastToAPInt()));
+    }
+    else if (auto data = llvm::dyn_cast<llvm::ConstantDataSequential>(constant)) {
+        buffer.add('D').add(data->getRawDataValues());
+    }
+    else if (auto expression = llvm::dyn_cast<llvm::ConstantExpr>(constant)) {
+        // As for instructions; a GEP's inbounds and inrange are among its optional data:
+        buffer.add('E').add(uint64_t(expression->getOpcode()))
+              .add(uint64_t(expression->getRawSubclassOptionalData()))
+              .add(getSubclassData(*expression));
+
+        if (expression->isCompare()) {
+            buffer.add(uint64_t(expression->getPredicate()));
+        }
+
+        if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(expression)) {
+            addType(buffer, gep->getSourceElementType());
+        }
+#if LLVM_VERSION_MAJOR < 15
+        else if (expression->hasIndices()) {
+            auto indices = expression->getIndices();
+
+            std::for_each(
+                indices.begin(), indices.end(),
+                [&buffer](auto index) -> void { buffer.add(uint64_t(index)); });
+        }
+#endif
+        else if (expression->getOpcode() == llvm::Instruction::ShuffleVector) {
+            auto mask = expression->getShuffleMask();
+
+            std::for_each(
+                mask.begin(), mask.end(),
+                [&buffer](auto element) -> void { buffer.add(uint64_t(element)); });
+        }
+    }
+    else {
+        // Aggregates, null values, undef and poison:
+        buffer.add('C').add(uint64_t(constant->getValueID()));
+    }
+
+    // Global values have operands of their own (their initializers, say), which aren't part of
+    // the reference:
+    if (llvm::isa<llvm::GlobalValue>(constant)) {
+        return;
+    }
+
+    buffer.add(uint64_t(constant->getNumOperands()));
+
+    std::for_each(
+        constant->op_begin(), constant->op_end(),
+        [this, &buffer](const auto& operand) -> void {
+            addConstant(buffer, llvm::cast<llvm::Constant>(operand.get()));
+        });
+}
+
+void
+StructuralHasher::addValue(Buffer& buffer, const llvm::Value *value) {
+    if (!value) {
+        buffer.add('0');
+        return;
+    }
+
+    if (auto it = d_locals.find(value); it != d_locals.end()) {
+        buffer.add('P').add(uint64_t(it->second));
+        return;
+    }
+
+    if (auto constant = llvm::dyn_cast<llvm::Constant>(value)) {
+        addConstant(buffer, constant);
+        return;
+    }
+
+    if (auto md = llvm::dyn_cast<llvm::MetadataAsValue>(value)) {
+        buffer.add('M').add(hash(md->getMetadata()));
+        return;
+    }
+
+    if (auto assembly = llvm::dyn_cast<llvm::InlineAsm>(value)) {
+        buffer.add('A').add(assembly->getAsmString()).add(assembly->getConstraintString());
+        return;
+    }
+
+    buffer.add('?').add(uint64_t(value->getValueID()));
+}
+
+} // End namespace llair
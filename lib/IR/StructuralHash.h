@@ -0,0 +1,74 @@
+//-*-C++-*-
+#ifndef LLAIR_IR_STRUCTURALHASH_H
+#define LLAIR_IR_STRUCTURALHASH_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
+
+namespace llvm {
+class Constant;
+class Function;
+class GlobalValue;
+class Instruction;
+class MDNode;
+class Metadata;
+class Module;
+class Type;
+class Value;
+} // End namespace llvm
+
+namespace llair {
+
+// Hashes what a module means, rather than how it happens to be laid out in memory: the names of
+// local values are replaced by their positions, internal globals are identified by their contents,
+// and the order of globals (and of the operands of the given named metadata) doesn't matter.
+// Anything else that can change the code, down to metadata attachments and the flags that
+// instructions and constants keep outside of their operands, is part of the hash:
+class StructuralHasher {
+public:
+
+    StructuralHasher(llvm::ArrayRef<llvm::StringRef> unordered_metadata_names = {});
+
+    uint64_t hash(const llvm::Module&);
+    uint64_t hash(const llvm::Metadata*);
+
+private:
+
+    class Buffer;
+
+    uint64_t hashGlobal(const llvm::GlobalValue&);
+    uint64_t hashFunctionBody(const llvm::Function&);
+
+    void addInstruction(Buffer&, const llvm::Instruction&);
+    void addAttachments(Buffer&, llvm::ArrayRef<std::pair<unsigned, llvm::MDNode *>>);
+    void addType(Buffer&, llvm::Type*);
+    void addConstant(Buffer&, const llvm::Constant*);
+    void addValue(Buffer&, const llvm::Value*);
+
+    llvm::ArrayRef<llvm::StringRef> d_unordered_metadata_names;
+
+    // Internal globals are referred to by the hash of their contents, without references to other
+    // internal globals (which could be recursive):
+    llvm::DenseMap<const llvm::GlobalValue *, uint64_t> d_internal_hashes;
+    bool                                                d_hashing_internals = false;
+
+    llvm::DenseMap<const llvm::Metadata *, uint64_t> d_metadata_hashes;
+    llvm::DenseMap<llvm::Type *, uint64_t>           d_type_hashes;
+
+    // The positions of the arguments, blocks and instructions of the function being hashed:
+    llvm::DenseMap<const llvm::Value *, unsigned> d_locals;
+
+    // Metadata kinds and synchronization scopes are numbered in the order that an LLVMContext
+    // registers them, so they are hashed by name:
+    llvm::SmallVector<llvm::StringRef, 32> d_metadata_kind_names;
+    llvm::SmallVector<llvm::StringRef, 4>  d_sync_scope_names;
+};
+
+} // End namespace llair
+
+#endif
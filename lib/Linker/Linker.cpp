@@ -1,3 +1,4 @@
+#include <llair/Bitcode/Archive.h>
 #include <llair/IR/Module.h>
 #include <llair/IR/Class.h>
 #include <llair/IR/Dispatcher.h>
@@ -6,11 +7,14 @@
 #include <llair/Linker/Linker.h>
 #include <llair/IR/Module.h>
 
+#include <llvm/ADT/BitVector.h>
 #include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringMap.h>
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Support/ErrorHandling.h>
 #include <llvm/Support/Regex.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Transforms/Utils/Cloning.h>
@@ -18,6 +22,8 @@
 #include <llvm/Transforms/Utils/ValueMapper.h>
 
 #include <algorithm>
+#include <map>
+#include <vector>
 
 using namespace llvm;
 
@@ -68,29 +74,117 @@ linkModules(llair::Module *dst, const llair::Module *src) {
     dst->syncMetadata();
 }
 
-void
-finalizeInterfaces(Module *module, llvm::ArrayRef<Interface *> interfaces, std::function<uint32_t(const Class*)> getKindForClass) {
-    auto dispatcher_module = std::make_unique<Module>("", module->getContext());
+llvm::Error
+linkArchive(Module *dst, const Archive &archive, llvm::ArrayRef<llvm::StringRef> symbols) {
+    llvm::BitVector         linked(archive.member_size());
+    std::vector<unsigned>   pending;
+
+    auto require = [&linked, &pending](llvm::Optional<unsigned> member) -> bool {
+        if (!member || linked.test(*member)) {
+            return false;
+        }
 
-    llvm::StringMap<llvm::DenseSet<Interface *>> interface_index;
+        linked.set(*member);
+        pending.push_back(*member);
+        return true;
+    };
 
     std::for_each(
-        interfaces.begin(), interfaces.end(),
-        [&interface_index](auto interface) -> void {
-            std::for_each(
-                interface->method_begin(), interface->method_end(),
-                [&interface_index, interface](const auto& method) -> void {
-                    interface_index[method.getName()].insert(interface);
-                });
+        symbols.begin(), symbols.end(),
+        [&archive, &require](auto symbol) -> void {
+            require(archive.lookup(Archive::SymbolKind::Class, symbol)) ||
+            require(archive.lookup(Archive::SymbolKind::EntryPoint, symbol)) ||
+            require(archive.lookup(Archive::SymbolKind::Function, symbol));
         });
 
+    while (true) {
+        std::for_each(
+            dst->getLLModule()->begin(), dst->getLLModule()->end(),
+            [&archive, &require](const auto& function) -> void {
+                if (!function.isDeclaration() || function.isIntrinsic()) {
+                    return;
+                }
+
+                require(archive.lookup(Archive::SymbolKind::Function, function.getName()));
+            });
+
+        // A call through an interface can reach any class that implements it:
+        auto interfaces = dst->getAllInterfacesFromABI();
+
+        std::for_each(
+            interfaces.begin(), interfaces.end(),
+            [&archive, &require](auto interface) -> void {
+                auto members = archive.lookupAll(Archive::SymbolKind::Interface,
+                                                 Archive::getInterfaceSymbol(interface));
+
+                std::for_each(
+                    members.begin(), members.end(),
+                    [&require](auto member) -> void { require(member); });
+            });
+
+        if (pending.empty()) {
+            break;
+        }
+
+        // Link in archive order, so that the result doesn't depend on how the members were found:
+        std::sort(pending.begin(), pending.end());
+
+        for (auto member : pending) {
+            auto module = archive.getMemberModule(member, dst->getContext());
+
+            if (!module) {
+                return module.takeError();
+            }
+
+            linkModules(dst, module->get());
+        }
+
+        pending.clear();
+    }
+
+    return llvm::Error::success();
+}
+
+llvm::Error
+finalizeInterfaces(Module *module, llvm::ArrayRef<Interface *> interfaces, std::function<uint32_t(const Class*)> getKindForClass) {
+    auto dispatcher_module = std::make_unique<Module>("", module->getContext());
+
+    // Interfaces are referred to by their positions in `interfaces`, so that dispatchers are
+    // created in that order, rather than in the order of the interfaces' addresses:
+    llvm::StringMap<llvm::SmallVector<std::size_t, 2>> interface_index;
+
+    for (std::size_t index = 0, n = interfaces.size(); index < n; ++index) {
+        auto interface = interfaces[index];
+
+        std::for_each(
+            interface->method_begin(), interface->method_end(),
+            [&interface_index, interface, index](const auto& method) -> void {
+                auto& indices = interface_index[method.getName()];
+
+                if (std::find(indices.begin(), indices.end(), index) == indices.end()) {
+                    indices.push_back(index);
+                }
+            });
+    }
+
     llvm::DenseMap<llvm::StructType *, Interface *> interfaces_by_type;
 
+    // Kinds are assigned in the order of the module's classes, but the first implementation that a
+    // dispatcher is given becomes its default case; so they're given in the order of their kinds,
+    // rather than in the order in which the classes were linked:
+    struct Implementation {
+        Dispatcher  *dispatcher;
+        uint32_t     kind;
+        const Class *klass;
+    };
+
+    std::vector<Implementation> implementations;
+
     std::for_each(
         module->class_begin(), module->class_end(),
-        [getKindForClass, &dispatcher_module, &interface_index, &interfaces_by_type](const auto& klass) -> void {
+        [interfaces, getKindForClass, &dispatcher_module, &interface_index, &interfaces_by_type, &implementations](const auto& klass) -> void {
             // Find all interfaces that match `klass`:
-            llvm::DenseMap<Interface *, std::size_t> implemented_method_count;
+            std::map<std::size_t, std::size_t> implemented_method_count;
 
             std::for_each(
                 klass.method_begin(), klass.method_end(),
@@ -102,15 +196,16 @@ finalizeInterfaces(Module *module, llvm::ArrayRef<Interface *> interfaces, std::
 
                     std::for_each(
                         it->second.begin(), it->second.end(),
-                        [&implemented_method_count](auto interface) {
-                            implemented_method_count[interface]++;
+                        [&implemented_method_count](auto index) {
+                            implemented_method_count[index]++;
                         });
                 });
 
             std::for_each(
                 implemented_method_count.begin(), implemented_method_count.end(),
-                [getKindForClass, &dispatcher_module, &interfaces_by_type, &klass](auto tmp) {
-                    auto [ interface, implemented_method_count ] = tmp;
+                [interfaces, getKindForClass, &dispatcher_module, &interfaces_by_type, &implementations, &klass](auto tmp) {
+                    auto [ index, implemented_method_count ] = tmp;
+                    auto interface = interfaces[index];
                     if (implemented_method_count != interface->method_size()) {
                         return;
                     }
@@ -119,13 +214,33 @@ finalizeInterfaces(Module *module, llvm::ArrayRef<Interface *> interfaces, std::
                     assert(r_dispatchers.first != r_dispatchers.second);
 
                     auto dispatcher = *r_dispatchers.first;
-                    dispatcher->insertImplementation(getKindForClass(&klass), &klass);
+                    implementations.push_back({ dispatcher, getKindForClass(&klass), &klass });
 
                     interfaces_by_type.insert({ interface->getType(), interface });
                 });
         });
 
+    std::stable_sort(
+        implementations.begin(), implementations.end(),
+        [](const auto& lhs, const auto& rhs) -> bool { return lhs.kind < rhs.kind; });
+
+    llvm::Error error = llvm::Error::success();
+
+    std::for_each(
+        implementations.begin(), implementations.end(),
+        [&error](const auto& implementation) -> void {
+            if (auto insert_error = implementation.dispatcher->insertImplementation(implementation.kind, implementation.klass)) {
+                error = llvm::joinErrors(std::move(error), std::move(insert_error));
+            }
+        });
+
+    if (error) {
+        return error;
+    }
+
     linkModules(module, dispatcher_module.get());
+
+    return llvm::Error::success();
 }
 
 class Linker::TypeMapper : public llvm::ValueMapTypeRemapper {
@@ -397,6 +512,11 @@ Linker::linkModule(const Module *src) {
         if (I.isDeclaration())
             continue;
 
+        // Read the body, if 'src' was loaded lazily; this doesn't change what 'src' holds:
+        if (auto error = const_cast<Function &>(I).materialize()) {
+            llvm::report_fatal_error(std::move(error));
+        }
+
         Function *F = cast<Function>(VMap[&I]);
 
         Function::arg_iterator DestI = F->arg_begin();
@@ -438,13 +558,23 @@ Linker::linkModule(const Module *src) {
                                                      E = M->named_metadata_end();
          I != E; ++I) {
         const NamedMDNode &NMD    = *I;
+
+        // Describes the functions of 'src' alone:
+        if (NMD.getName() == "llair.abi_index")
+            continue;
+
         NamedMDNode *      NewNMD = New->getOrInsertNamedMetadata(NMD.getName());
 
         if (s_once_metadata_names.count(NMD.getName()) > 0 && NewNMD->getNumOperands() > 0)
             continue;
 
-        for (unsigned i = 0, e = NMD.getNumOperands(); i != e; ++i)
+        for (unsigned i = 0, e = NMD.getNumOperands(); i != e; ++i) {
+            // Removed objects leave null operands behind:
+            if (!NMD.getOperand(i))
+                continue;
+
             NewNMD->addOperand(MapMetadata(NMD.getOperand(i), VMap, RF_None, TMap.get()));
+        }
     }
 }
 
@@ -0,0 +1,257 @@
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/Chrono.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+
+#include "CacheImpl.h"
+
+namespace llair {
+
+// CacheKey:
+CacheKey&
+CacheKey::add(llvm::StringRef part) {
+    uint8_t size[8];
+    llvm::support::endian::write64le(size, part.size());
+
+    d_hasher.update(llvm::ArrayRef<uint8_t>(size));
+    d_hasher.update(part);
+
+    return *this;
+}
+
+CacheKey&
+CacheKey::add(llvm::ArrayRef<llvm::StringRef> parts) {
+    add(llvm::utostr(parts.size()));
+
+    std::for_each(
+        parts.begin(), parts.end(),
+        [this](auto part) -> void { add(part); });
+
+    return *this;
+}
+
+std::string
+CacheKey::str() {
+#if LLVM_VERSION_MAJOR >= 15
+    auto hash = d_hasher.final();
+    return llvm::toHex(llvm::ArrayRef<uint8_t>(hash), true);
+#else
+    return llvm::toHex(d_hasher.final(), true);
+#endif
+}
+
+// DiskCache:
+namespace {
+
+// llvm::pruneCache() only considers files with this prefix:
+const char *const kEntryPrefix = "llvmcache-";
+
+llvm::SmallString<256>
+getEntryPath(llvm::StringRef directory, llvm::StringRef key) {
+    llvm::SmallString<256> path(directory);
+    llvm::sys::path::append(path, kEntryPrefix + key);
+    return path;
+}
+
+} // namespace
+
+DiskCache::DiskCache(llvm::StringRef path, llvm::CachePruningPolicy policy)
+    : d_path(path.str())
+    , d_policy(policy) {
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+DiskCache::lookup(llvm::StringRef key) const {
+    auto path = getEntryPath(d_path, key);
+
+    int fd = -1;
+    if (llvm::sys::fs::openFileForRead(path, fd)) {
+        return nullptr;
+    }
+
+    // Pruning evicts the least recently used entries first:
+    llvm::sys::fs::setLastAccessAndModificationTime(fd, std::chrono::system_clock::now());
+
+    // Entries are never modified in place, so the buffer can be a mapping of the file:
+    auto buffer = llvm::MemoryBuffer::getOpenFile(fd, path, -1, false);
+
+    llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+
+    return buffer ? std::move(*buffer) : nullptr;
+}
+
+llvm::Error
+DiskCache::store(llvm::StringRef key, llvm::StringRef data) const {
+    if (auto error = llvm::sys::fs::create_directories(d_path)) {
+        return llvm::errorCodeToError(error);
+    }
+
+    llvm::SmallString<256> temporary_model(d_path);
+    llvm::sys::path::append(temporary_model, "tmp-%%%%%%%%%%%%");
+
+    int                    fd = -1;
+    llvm::SmallString<256> temporary_path;
+
+    if (auto error = llvm::sys::fs::createUniqueFile(temporary_model, fd, temporary_path)) {
+        return llvm::errorCodeToError(error);
+    }
+
+  { llvm::raw_fd_ostream os(fd, true);
+    os << data;
+    os.close();
+
+    if (os.has_error()) {
+        auto error = os.error();
+        os.clear_error();
+        llvm::sys::fs::remove(temporary_path);
+        return llvm::errorCodeToError(error);
+    } }
+
+    if (auto error = llvm::sys::fs::rename(temporary_path, getEntryPath(d_path, key))) {
+        llvm::sys::fs::remove(temporary_path);
+        return llvm::errorCodeToError(error);
+    }
+
+    llvm::pruneCache(d_path, d_policy);
+
+    return llvm::Error::success();
+}
+
+llvm::Optional<DiskCache>
+getDiskCache(llvm::StringRef path_, const llvm::Optional<llvm::CachePruningPolicy>& policy_,
+             const char *path_variable, const char *policy_variable) {
+    // Is the path set via a setter?
+    llvm::SmallString<256> path(path_);
+
+    // Is the path set via an environment variable?
+    if (path.empty()) {
+        auto tmp = llvm::sys::Process::GetEnv(path_variable);
+        if (tmp) {
+            llvm::sys::path::native(*tmp, path);
+        }
+    }
+
+    if (path.empty()) {
+        return llvm::None;
+    }
+
+    // Is the policy set via a setter?
+    auto policy = policy_;
+
+    // Is the policy set via an environment variable?
+    if (!policy) {
+        auto tmp = llvm::sys::Process::GetEnv(policy_variable);
+        if (tmp) {
+            auto parsed_policy = llvm::parseCachePruningPolicy(*tmp);
+            if (parsed_policy) {
+                policy = *parsed_policy;
+            }
+            else {
+                llvm::consumeError(parsed_policy.takeError());
+            }
+        }
+    }
+
+    if (!policy) {
+        policy = llvm::CachePruningPolicy();
+        policy->MaxSizeBytes = 1024 * 1024 * 1024;
+    }
+
+    return DiskCache(path, *policy);
+}
+
+// MemoryCache:
+MemoryCache::MemoryCache(std::size_t capacity)
+    : d_capacity(capacity) {
+}
+
+std::shared_ptr<llvm::MemoryBuffer>
+MemoryCache::lookup(llvm::StringRef key) {
+    std::lock_guard<std::mutex> lock(d_mutex);
+
+    auto it = d_index.find(key);
+    if (it == d_index.end()) {
+        return nullptr;
+    }
+
+    d_entries.splice(d_entries.begin(), d_entries, it->second);
+
+    return it->second->second;
+}
+
+void
+MemoryCache::insert(llvm::StringRef key, std::shared_ptr<llvm::MemoryBuffer> buffer) {
+    std::lock_guard<std::mutex> lock(d_mutex);
+
+    auto size = buffer->getBufferSize();
+
+    if (auto it = d_index.find(key); it != d_index.end()) {
+        d_size -= it->second->second->getBufferSize();
+        d_entries.erase(it->second);
+        d_index.erase(it);
+    }
+
+    if (size > d_capacity) {
+        return;
+    }
+
+    d_entries.emplace_front(key.str(), std::move(buffer));
+    d_index.insert({ key, d_entries.begin() });
+    d_size += size;
+
+    evict();
+}
+
+void
+MemoryCache::setCapacity(std::size_t capacity) {
+    std::lock_guard<std::mutex> lock(d_mutex);
+
+    d_capacity = capacity;
+
+    evict();
+}
+
+void
+MemoryCache::evict() {
+    while (d_size > d_capacity) {
+        auto& entry = d_entries.back();
+
+        d_size -= entry.second->getBufferSize();
+        d_index.erase(entry.first);
+        d_entries.pop_back();
+    }
+}
+
+namespace {
+
+class SharedMemoryBuffer : public llvm::MemoryBuffer {
+public:
+
+    explicit SharedMemoryBuffer(std::shared_ptr<llvm::MemoryBuffer> buffer)
+        : d_buffer(std::move(buffer)) {
+        init(d_buffer->getBufferStart(), d_buffer->getBufferEnd(), false);
+    }
+
+    llvm::StringRef getBufferIdentifier() const override { return d_buffer->getBufferIdentifier(); }
+
+    BufferKind getBufferKind() const override { return d_buffer->getBufferKind(); }
+
+private:
+
+    std::shared_ptr<llvm::MemoryBuffer> d_buffer;
+};
+
+} // namespace
+
+std::unique_ptr<llvm::MemoryBuffer>
+shareMemoryBuffer(std::shared_ptr<llvm::MemoryBuffer> buffer) {
+    return std::make_unique<SharedMemoryBuffer>(std::move(buffer));
+}
+
+} // End namespace llair
@@ -0,0 +1,107 @@
+//-*-C++-*-
+#ifndef LLAIR_CACHEIMPL_H
+#define LLAIR_CACHEIMPL_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/CachePruning.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#if LLVM_VERSION_MAJOR >= 13
+#include <llvm/Support/SHA256.h>
+#else
+#include <llvm/Support/SHA1.h>
+#endif
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace llair {
+
+// Accumulates everything that determines a cached result into a strong hash:
+class CacheKey {
+public:
+
+    // Each part is length-prefixed, so that ("ab", "c") and ("a", "bc") differ:
+    CacheKey& add(llvm::StringRef);
+    CacheKey& add(llvm::ArrayRef<llvm::StringRef>);
+
+    // The hash, in hex:
+    std::string str();
+
+private:
+
+#if LLVM_VERSION_MAJOR >= 13
+    llvm::SHA256 d_hasher;
+#else
+    llvm::SHA1   d_hasher;
+#endif
+};
+
+// A directory of files named 'llvmcache-<key>'. Entries are written to a temporary file and
+// renamed into place, so concurrent readers and writers (in this or another process) never see a
+// partial entry; the directory is kept within its size bounds by llvm::pruneCache():
+class DiskCache {
+public:
+
+    DiskCache(llvm::StringRef path, llvm::CachePruningPolicy policy);
+
+    // Returns nullptr on a miss:
+    std::unique_ptr<llvm::MemoryBuffer> lookup(llvm::StringRef key) const;
+
+    llvm::Error store(llvm::StringRef key, llvm::StringRef data) const;
+
+private:
+
+    std::string              d_path;
+    llvm::CachePruningPolicy d_policy;
+};
+
+// The path and policy that were set, or else those from the environment variables; the default
+// policy bounds the cache to 1GB. Returns llvm::None if there's no path:
+llvm::Optional<DiskCache> getDiskCache(llvm::StringRef path,
+                                       const llvm::Optional<llvm::CachePruningPolicy>& policy,
+                                       const char *path_variable, const char *policy_variable);
+
+// Keeps the most recently used entries in memory, within a budget of bytes. Entries are shared, so
+// that one that's evicted stays valid while a caller still holds it:
+class MemoryCache {
+public:
+
+    explicit MemoryCache(std::size_t capacity);
+
+    // Returns nullptr on a miss:
+    std::shared_ptr<llvm::MemoryBuffer> lookup(llvm::StringRef key);
+
+    // An entry larger than the whole budget isn't kept:
+    void insert(llvm::StringRef key, std::shared_ptr<llvm::MemoryBuffer> buffer);
+
+    void setCapacity(std::size_t capacity);
+
+private:
+
+    using Entries = std::list<std::pair<std::string, std::shared_ptr<llvm::MemoryBuffer>>>;
+
+    // Drops the least recently used entries until the size is within the budget:
+    void evict();
+
+    std::mutex                       d_mutex;
+    std::size_t                      d_capacity = 0, d_size = 0;
+
+    // Most recently used first:
+    Entries                          d_entries;
+    llvm::StringMap<Entries::iterator> d_index;
+};
+
+// Refers to a buffer held by a MemoryCache, and keeps it alive:
+std::unique_ptr<llvm::MemoryBuffer> shareMemoryBuffer(std::shared_ptr<llvm::MemoryBuffer> buffer);
+
+} // End namespace llair
+
+#endif
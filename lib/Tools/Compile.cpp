@@ -1,25 +1,112 @@
+#include <llair/Bitcode/Bitcode.h>
 #include <llair/IR/LLAIRContext.h>
 #include <llair/IR/Module.h>
 #include <llair/Tools/Compile.h>
 #include <llair/Tools/Program.h>
 
-#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Config/llvm-config.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Path.h>
 #include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 #include <string>
 
+#include "CacheImpl.h"
+#include "CompileImpl.h"
 #include "ToolsImpl.h"
 
 namespace llair {
 
-llvm::Expected<std::unique_ptr<Module>>
-compileBuffer(llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> options,
-              LLAIRContext &context) {
-    auto path     = getPathToTools();
+namespace {
+
+// Guards the cache path and policy, which the setters may change while workers read them:
+std::mutex &
+compileCacheMutex() {
+    static std::mutex s_compileCacheMutex;
+    return s_compileCacheMutex;
+}
+
+llvm::SmallString<256> &
+compileCachePath() {
+    static llvm::SmallString<256> s_compileCachePath;
+    return s_compileCachePath;
+}
+
+llvm::Optional<llvm::CachePruningPolicy> &
+compileCachePolicy() {
+    static llvm::Optional<llvm::CachePruningPolicy> s_compileCachePolicy;
+    return s_compileCachePolicy;
+}
+
+std::atomic<CompileBackend> &
+compileBackend() {
+    static std::atomic<CompileBackend> s_compileBackend = { CompileBackend::Default };
+    return s_compileBackend;
+}
+
+} // namespace
+
+llvm::Optional<DiskCache>
+getCompileCache() {
+    llvm::SmallString<256>                  path;
+    llvm::Optional<llvm::CachePruningPolicy> policy;
+
+  { std::lock_guard<std::mutex> lock(compileCacheMutex());
+    path   = compileCachePath();
+    policy = compileCachePolicy(); }
+
+    return getDiskCache(path, policy, "LLAIR_COMPILE_CACHE_PATH", "LLAIR_COMPILE_CACHE_POLICY");
+}
+
+llvm::Expected<std::string>
+getCompilerVersion(llvm::StringRef path) {
+    static std::mutex                 s_mutex;
+    static llvm::StringMap<std::string> s_versions;
+
+  { std::lock_guard<std::mutex> lock(s_mutex);
+    auto it = s_versions.find(path);
+    if (it != s_versions.end()) {
+        return it->second;
+    } }
+
+    auto filename = llvm::sys::path::filename(path).str();
+
+    std::vector<std::string> args = {filename.data(), "metal", "--version"};
+
+    auto output = runProgram(path.str(), args, llvm::MemoryBufferRef("", ""));
+
+    if (!output) {
+        return output.takeError();
+    }
+
+    auto version = (*output)->getBuffer().str();
+
+    if (version.empty()) {
+        return llvm::createStringError(std::errc::executable_format_error,
+                                       "unable to determine the version of '%s'", path.str().c_str());
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_versions.insert({ path, version });
+
+    return version;
+}
+
+namespace {
+
+std::vector<std::string>
+getCompilerArgs(llvm::StringRef path, llvm::ArrayRef<llvm::StringRef> options) {
     auto filename = llvm::sys::path::filename(path).str();
 
     std::vector<std::string> args = {filename.data(), "metal", "-c", "-x", "metal"};
@@ -31,34 +118,414 @@ compileBuffer(llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> opti
             return option.str();
         });
 
+    return args;
+}
+
+} // namespace
+
+std::string
+getCompileCacheKey(const llvm::Optional<DiskCache>& cache, llvm::StringRef path,
+                   llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> options) {
+    if (!cache) {
+        return std::string();
+    }
+
+    auto version = getCompilerVersion(path);
+
+    if (!version) {
+        llvm::consumeError(version.takeError());
+        return std::string();
+    }
+
+    return CacheKey()
+        .add(buffer.getBuffer())
+        .add(options)
+        .add(path)
+        .add(*version)
+        .str();
+}
+
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+compileToBitcode(llvm::StringRef path, llvm::MemoryBufferRef buffer,
+                 llvm::ArrayRef<llvm::StringRef> options) {
+    auto args = getCompilerArgs(path, options);
+
     args.push_back("-o");
     args.push_back("-");
     args.push_back("-");
 
-#if LLVM_VERSION_MAJOR >= 12
-    auto bitcode = llvm::errorOrToExpected(runProgram((std::string)path, args, buffer));
-#else
-    auto bitcode = llvm::errorOrToExpected(runProgram(path.str(), args, buffer));
-#endif
+    return runProgram(path.str(), args, buffer);
+}
+
+namespace {
+
+// The compiler reads a single source from its standard input, which it calls '-'; a batch's
+// sources are named after their temporary files, which mustn't show:
+const char *const kSourceFileName = "-";
+
+} // namespace
+
+llvm::Expected<std::unique_ptr<Module>>
+readCompiled(llvm::MemoryBufferRef bitcode, LLAIRContext &context) {
+    auto module = getBitcodeModule(bitcode, context);
+
+    if (module) {
+        (*module)->getLLModule()->setSourceFileName(kSourceFileName);
+    }
+
+    return module;
+}
+
+llvm::Expected<std::unique_ptr<Module>>
+loadCompiled(llvm::MemoryBufferRef bitcode, const llvm::Optional<DiskCache>& cache,
+             llvm::StringRef key, LLAIRContext &context) {
+    auto module = readCompiled(bitcode, context);
+
+    // Only cache output that could be loaded; failing to cache isn't an error:
+    if (module && !key.empty()) {
+        llvm::consumeError(cache->store(key, bitcode.getBuffer()));
+    }
+
+    return module;
+}
+
+namespace {
+
+// Returns nullptr on a miss:
+std::unique_ptr<Module>
+lookupCompiled(const llvm::Optional<DiskCache>& cache, llvm::StringRef key, LLAIRContext &context) {
+    if (key.empty()) {
+        return nullptr;
+    }
+
+    auto bitcode = cache->lookup(key);
+
+    if (!bitcode) {
+        return nullptr;
+    }
+
+    auto module = readCompiled(bitcode->getMemBufferRef(), context);
+
+    if (!module) {
+        // A corrupt entry is overwritten when the source is recompiled:
+        llvm::consumeError(module.takeError());
+        return nullptr;
+    }
+
+    return std::move(*module);
+}
+
+llvm::Expected<std::unique_ptr<Module>>
+compileUncached(llvm::StringRef path, llvm::MemoryBufferRef buffer,
+                llvm::ArrayRef<llvm::StringRef> options, const llvm::Optional<DiskCache>& cache,
+                llvm::StringRef key, LLAIRContext &context) {
+    auto bitcode = compileToBitcode(path, buffer, options);
+
+    if (!bitcode) {
+        return bitcode.takeError();
+    }
+
+    return loadCompiled((*bitcode)->getMemBufferRef(), cache, key, context);
+}
+
+// Options whose values are paths; longer names come first, so that none is taken for a prefix of
+// another:
+const char *const kPathOptions[] = {
+    "-include-pch", "-iframework", "-idirafter", "-isysroot", "-isystem", "-imacros", "-include",
+    "-iquote", "-I", "-F"
+};
+
+// Makes the paths in the options absolute, so that they mean the same to a compiler that resolves
+// relative paths against another directory:
+std::vector<std::string>
+getAbsoluteOptions(llvm::ArrayRef<llvm::StringRef> options, llvm::StringRef directory) {
+    auto absolute = [directory](llvm::StringRef path) -> std::string {
+        llvm::SmallString<256> absolute_path(path);
+        llvm::sys::fs::make_absolute(directory, absolute_path);
+        return absolute_path.str().str();
+    };
+
+    std::vector<std::string> absolute_options;
+
+    for (std::size_t i = 0, n = options.size(); i < n; ++i) {
+        auto option = options[i];
+
+        auto it = std::find_if(
+            std::begin(kPathOptions), std::end(kPathOptions),
+            [option](auto path_option) -> bool { return option.startswith(path_option); });
+
+        if (it == std::end(kPathOptions)) {
+            absolute_options.push_back(option.str());
+            continue;
+        }
+
+        llvm::StringRef name(*it);
+
+        // '-I <path>':
+        if (option == name) {
+            absolute_options.push_back(option.str());
+
+            if (i + 1 < n) {
+                absolute_options.push_back(absolute(options[++i]));
+            }
 
-    if (bitcode) {
-        auto llmodule = llvm::getLazyBitcodeModule(**bitcode, context.getLLContext());
-        if (llmodule) {
-            auto error = (*llmodule)->materializeAll();
+            continue;
+        }
+
+        // '-I<path>':
+        absolute_options.push_back(name.str() + absolute(option.drop_front(name.size())));
+    }
+
+    return absolute_options;
+}
+
+// Compiles several buffers that share options with one invocation of the compiler. Each is written
+// to '<index>.metal' in a temporary directory, where the compiler writes '<index>.air'; the
+// compiler runs in the caller's working directory, and only resolves its own files against the
+// temporary one (-working-directory), so the caller's relative paths are made absolute. Each source
+// starts with a line marker, so that it's named as the compiler names its standard input. Inputs
+// whose output is missing (e.g., because they failed to compile) are retried one at a time, to
+// report their errors:
+void
+compileBatch(llvm::StringRef path, llvm::ArrayRef<CompileInput> inputs,
+             llvm::ArrayRef<std::size_t> indices, llvm::ArrayRef<std::string> keys,
+             const llvm::Optional<DiskCache>& cache, LLAIRContext &context,
+             std::vector<llvm::Optional<llvm::Expected<std::unique_ptr<Module>>>>& results) {
+    auto options = inputs[indices.front()].options;
+
+    llvm::SmallString<256> current_directory;
+    auto error = llvm::sys::fs::current_path(current_directory);
+
+    llvm::SmallString<256> directory;
+    if (!error) {
+        error = llvm::sys::fs::createUniqueDirectory("llair-compile", directory);
+    }
+
+    if (!error) {
+        auto absolute_options = getAbsoluteOptions(options, current_directory);
+
+        std::vector<llvm::StringRef> compiler_options(absolute_options.begin(),
+                                                      absolute_options.end());
+
+        // A source read from the standard input includes files relative to the working
+        // directory, and debug info records it:
+        auto debug_directory = "-fdebug-compilation-dir=" + current_directory.str().str();
+
+        compiler_options.push_back("-iquote");
+        compiler_options.push_back(current_directory);
+        compiler_options.push_back(debug_directory);
+        compiler_options.push_back("-working-directory");
+        compiler_options.push_back(directory);
+
+        auto args = getCompilerArgs(path, compiler_options);
+
+        for (std::size_t i = 0, n = indices.size(); i < n && !error; ++i) {
+            llvm::SmallString<256> source_path(directory);
+            llvm::sys::path::append(source_path, std::to_string(i) + ".metal");
+
+            llvm::raw_fd_ostream os(source_path, error, llvm::sys::fs::OF_None);
             if (!error) {
-                return std::unique_ptr<Module>(new Module(std::move(*llmodule)));
+                os << "#line 1 \"<stdin>\"\n" << inputs[indices[i]].buffer.getBuffer();
             }
-            else {
-                return std::move(error);
+
+            args.push_back(source_path.str().str());
+        }
+
+        if (!error) {
+            // The compiler fails if any of the inputs do; those are retried below, which reports
+            // their diagnostics:
+            std::string diagnostics;
+
+            ProgramOptions program_options;
+            program_options.diagnostics = &diagnostics;
+
+            auto output = runProgram(path.str(), args, llvm::MemoryBufferRef("", ""),
+                                     program_options);
+            if (!output) {
+                llvm::consumeError(output.takeError());
             }
         }
-        else {
-            return llmodule.takeError();
+    }
+
+    for (std::size_t i = 0, n = indices.size(); i < n; ++i) {
+        auto index = indices[i];
+
+        if (!error) {
+            llvm::SmallString<256> bitcode_path(directory);
+            llvm::sys::path::append(bitcode_path, std::to_string(i) + ".air");
+
+#if LLVM_VERSION_MAJOR >= 13
+            auto bitcode = llvm::MemoryBuffer::getFile(bitcode_path, /*IsText=*/false,
+                                                       /*RequiresNullTerminator=*/false);
+#else
+            auto bitcode = llvm::MemoryBuffer::getFile(bitcode_path, /*FileSize=*/-1,
+                                                       /*RequiresNullTerminator=*/false);
+#endif
+
+            if (bitcode) {
+                auto module = loadCompiled((*bitcode)->getMemBufferRef(), cache, keys[index], context);
+
+                if (module) {
+                    results[index].emplace(std::move(module));
+                    continue;
+                }
+
+                llvm::consumeError(module.takeError());
+            }
         }
+
+        results[index].emplace(
+            compileUncached(path, inputs[index].buffer, options, cache, keys[index], context));
     }
-    else {
-        return bitcode.takeError();
+
+    if (!directory.empty()) {
+        llvm::sys::fs::remove_directories(directory);
+    }
+}
+
+} // namespace
+
+void
+setCompileCachePath(llvm::StringRef path) {
+    std::lock_guard<std::mutex> lock(compileCacheMutex());
+    llvm::sys::path::native(path, compileCachePath());
+}
+
+llvm::Error
+setCompileCachePolicy(llvm::StringRef policy) {
+    auto parsed_policy = llvm::parseCachePruningPolicy(policy);
+
+    if (!parsed_policy) {
+        return parsed_policy.takeError();
+    }
+
+    std::lock_guard<std::mutex> lock(compileCacheMutex());
+    compileCachePolicy() = *parsed_policy;
+
+    return llvm::Error::success();
+}
+
+void
+setCompileBackend(CompileBackend backend) {
+    compileBackend() = backend;
+}
+
+CompileBackend
+getCompileBackend(CompileBackend backend) {
+    // Is the backend chosen by the caller?
+    if (backend != CompileBackend::Default) {
+        return backend;
+    }
+
+    // Is the backend set via setCompileBackend()?
+    auto global_backend = compileBackend().load();
+    if (global_backend != CompileBackend::Default) {
+        return global_backend;
+    }
+
+    // Is the backend set via an environment variable?
+    auto tmp = llvm::sys::Process::GetEnv("LLAIR_COMPILE_BACKEND");
+    if (tmp && *tmp == "in-process") {
+        return CompileBackend::InProcess;
+    }
+
+    return CompileBackend::Process;
+}
+
+llvm::Expected<std::unique_ptr<Module>>
+compileBuffer(llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> options,
+              LLAIRContext &context, CompileBackend backend) {
+    // There's no bitcode to cache:
+    if (getCompileBackend(backend) == CompileBackend::InProcess) {
+        return compileInProcess(buffer, options, context);
+    }
+
+    auto path = getPathToTools();
+
+    auto cache = getCompileCache();
+    auto key   = getCompileCacheKey(cache, path, buffer, options);
+
+    if (auto module = lookupCompiled(cache, key, context)) {
+        return std::move(module);
+    }
+
+    return compileUncached(path, buffer, options, cache, key, context);
+}
+
+std::vector<llvm::Expected<std::unique_ptr<Module>>>
+compileBuffers(llvm::ArrayRef<CompileInput> inputs, LLAIRContext &context,
+               CompileBackend backend) {
+    // There's no process startup to amortize:
+    if (getCompileBackend(backend) == CompileBackend::InProcess) {
+        std::vector<llvm::Expected<std::unique_ptr<Module>>> modules;
+        modules.reserve(inputs.size());
+
+        std::transform(
+            inputs.begin(), inputs.end(),
+            std::back_inserter(modules),
+            [&context](const auto& input) -> llvm::Expected<std::unique_ptr<Module>> {
+                return compileInProcess(input.buffer, input.options, context);
+            });
+
+        return modules;
+    }
+
+    auto path = getPathToTools();
+
+    auto cache = getCompileCache();
+
+    // Each result is set exactly once, as an unchecked llvm::Expected can't be assigned to:
+    std::vector<llvm::Optional<llvm::Expected<std::unique_ptr<Module>>>> results(inputs.size());
+
+    std::vector<std::string> keys;
+    keys.reserve(inputs.size());
+
+    // Inputs that miss the cache, grouped by their options:
+    llvm::StringMap<std::size_t>                   batch_indices;
+    std::vector<llvm::SmallVector<std::size_t, 8>> batches;
+
+    for (std::size_t index = 0, n = inputs.size(); index < n; ++index) {
+        const auto& input = inputs[index];
+
+        keys.push_back(getCompileCacheKey(cache, path, input.buffer, input.options));
+
+        if (auto module = lookupCompiled(cache, keys.back(), context)) {
+            results[index].emplace(std::move(module));
+            continue;
+        }
+
+        // Options can't contain NUL characters, so this joining is unambiguous:
+        auto it = batch_indices.insert(
+            { llvm::join(input.options, llvm::StringRef("\0", 1)), batches.size() }).first;
+        if (it->second == batches.size()) {
+            batches.emplace_back();
+        }
+
+        batches[it->second].push_back(index);
     }
+
+    std::for_each(
+        batches.begin(), batches.end(),
+        [&](const auto& indices) -> void {
+            if (indices.size() == 1) {
+                auto index = indices.front();
+                results[index].emplace(compileUncached(path, inputs[index].buffer,
+                                                       inputs[index].options, cache, keys[index],
+                                                       context));
+                return;
+            }
+
+            compileBatch(path, inputs, indices, keys, cache, context, results);
+        });
+
+    std::vector<llvm::Expected<std::unique_ptr<Module>>> modules;
+    modules.reserve(inputs.size());
+
+    std::for_each(
+        results.begin(), results.end(),
+        [&modules](auto& result) -> void { modules.push_back(std::move(*result)); });
+
+    return modules;
 }
 
 } // namespace llair
@@ -0,0 +1,58 @@
+//-*-C++-*-
+#ifndef LLAIR_COMPILEIMPL_H
+#define LLAIR_COMPILEIMPL_H
+
+#include <llair/Tools/Compile.h>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <memory>
+#include <string>
+
+#include "CacheImpl.h"
+
+namespace llair {
+class LLAIRContext;
+class Module;
+
+// The cache configured by setCompileCachePath() and setCompileCachePolicy(), if any:
+llvm::Optional<DiskCache> getCompileCache();
+
+// The output of `metal --version` for a given tools path, which identifies the compiler for the
+// purposes of caching:
+llvm::Expected<std::string> getCompilerVersion(llvm::StringRef path);
+
+// Returns an empty key if the result can't be cached:
+std::string getCompileCacheKey(const llvm::Optional<DiskCache>& cache, llvm::StringRef path,
+                               llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> options);
+
+// Runs the compiler; doesn't touch any LLAIRContext, so it can be called from any thread:
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+compileToBitcode(llvm::StringRef path, llvm::MemoryBufferRef buffer,
+                 llvm::ArrayRef<llvm::StringRef> options);
+
+// Loads compiled bitcode into `context`, named as the compiler names a source read from its
+// standard input, however it was compiled:
+llvm::Expected<std::unique_ptr<Module>>
+readCompiled(llvm::MemoryBufferRef bitcode, LLAIRContext &context);
+
+// Loads compiled bitcode with readCompiled(), and caches it under `key` if it loaded:
+llvm::Expected<std::unique_ptr<Module>>
+loadCompiled(llvm::MemoryBufferRef bitcode, const llvm::Optional<DiskCache>& cache,
+             llvm::StringRef key, LLAIRContext &context);
+
+// Resolves CompileBackend::Default:
+CompileBackend getCompileBackend(CompileBackend backend);
+
+// Fails with std::errc::not_supported if LLAIR was built without clang:
+llvm::Expected<std::unique_ptr<Module>>
+compileInProcess(llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> options,
+                 LLAIRContext &context);
+
+} // End namespace llair
+
+#endif
@@ -0,0 +1,155 @@
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+#include <llair/Tools/Compile.h>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+
+#if defined(LLAIR_HAVE_CLANG)
+#include <clang/Basic/DiagnosticOptions.h>
+#include <clang/CodeGen/CodeGenAction.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/CompilerInvocation.h>
+#include <clang/Frontend/FrontendOptions.h>
+#include <clang/Frontend/TextDiagnosticPrinter.h>
+#include <clang/Frontend/Utils.h>
+#include <clang/Lex/PreprocessorOptions.h>
+#endif
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "CompileImpl.h"
+
+namespace llair {
+
+#if defined(LLAIR_HAVE_CLANG)
+
+namespace {
+
+// The source is compiled as if it were this file:
+const char *const kInputFilename = "llair-input.metal";
+
+const char *const kTriple = "air64-apple-macosx14.0.0";
+
+} // namespace
+
+bool
+isInProcessCompileAvailable() {
+    return true;
+}
+
+llvm::Expected<std::unique_ptr<Module>>
+compileInProcess(llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> options,
+                 LLAIRContext &context) {
+    // The options are the driver's, as they would be given to the compiler run as a program, so
+    // the driver translates them for the frontend, and rejects those that it doesn't know. It
+    // doesn't read the input, but would insist that a named one exists:
+    std::vector<std::string> args = {"clang", "-target", kTriple, "-x", "metal"};
+
+    std::transform(
+        options.begin(), options.end(),
+        std::back_inserter(args),
+        [](auto option) -> auto {
+            return option.str();
+        });
+
+    args.push_back("-");
+
+    std::vector<const char *> argv;
+    argv.reserve(args.size());
+    std::transform(
+        args.begin(), args.end(), std::back_inserter(argv),
+        [](const std::string& arg) -> const char * { return arg.c_str(); });
+
+    std::string              diagnostics;
+    llvm::raw_string_ostream diagnostics_stream(diagnostics);
+
+    auto failed = [&diagnostics, &diagnostics_stream]() -> llvm::Error {
+        diagnostics_stream.flush();
+        return llvm::createStringError(std::errc::invalid_argument, "%s",
+                                       llvm::StringRef(diagnostics).rtrim().str().c_str());
+    };
+
+    // The options' own diagnostics (-W, -w, -Werror and so on) only apply once they're parsed, so
+    // the driver reports to diagnostics of its own, as cc1_main()'s parser does:
+    llvm::IntrusiveRefCntPtr<clang::DiagnosticOptions> driver_diagnostic_options(
+        new clang::DiagnosticOptions());
+
+    auto driver_diagnostics = clang::CompilerInstance::createDiagnostics(
+        driver_diagnostic_options.get(),
+        new clang::TextDiagnosticPrinter(diagnostics_stream, driver_diagnostic_options.get()));
+
+#if LLVM_VERSION_MAJOR >= 15
+    clang::CreateInvocationOptions invocation_options;
+    invocation_options.Diags = driver_diagnostics;
+
+    auto invocation = clang::createInvocation(argv, std::move(invocation_options));
+#else
+    auto invocation = clang::createInvocationFromCommandLine(argv, driver_diagnostics);
+#endif
+
+    if (!invocation || driver_diagnostics->hasErrorOccurred()) {
+        return failed();
+    }
+
+    auto& inputs = invocation->getFrontendOpts().Inputs;
+
+    if (inputs.size() != 1) {
+        return llvm::createStringError(std::errc::invalid_argument,
+                                       "the options name inputs of their own");
+    }
+
+    auto kind = inputs.front().getKind();
+    inputs.clear();
+    inputs.emplace_back(kInputFilename, kind);
+
+    clang::CompilerInstance compiler;
+    compiler.setInvocation(std::move(invocation));
+    compiler.createDiagnostics(
+        new clang::TextDiagnosticPrinter(diagnostics_stream, &compiler.getDiagnosticOpts()));
+
+    // The source is read from the buffer rather than from the file system; the compiler deletes
+    // this (non-owning) MemoryBuffer once it's done:
+    compiler.getPreprocessorOpts().addRemappedFile(
+        kInputFilename, llvm::MemoryBuffer::getMemBuffer(buffer, false).release());
+
+    // The code is generated directly into the context, so there's no bitcode to write or read:
+    clang::EmitLLVMOnlyAction action(&context.getLLContext());
+
+    if (!compiler.ExecuteAction(action)) {
+        return failed();
+    }
+
+    auto llmodule = action.takeModule();
+
+    if (!llmodule) {
+        return failed();
+    }
+
+    // Warnings go where the compiler's would, if it were run as a program:
+    diagnostics_stream.flush();
+    llvm::errs() << diagnostics;
+
+    return std::make_unique<Module>(std::move(llmodule));
+}
+
+#else
+
+bool
+isInProcessCompileAvailable() {
+    return false;
+}
+
+llvm::Expected<std::unique_ptr<Module>>
+compileInProcess(llvm::MemoryBufferRef, llvm::ArrayRef<llvm::StringRef>, LLAIRContext &) {
+    return llvm::createStringError(std::errc::not_supported,
+                                   "LLAIR was built without clang; in-process compilation isn't "
+                                   "available");
+}
+
+#endif
+
+} // End namespace llair
@@ -0,0 +1,234 @@
+#include <llair/Bitcode/Bitcode.h>
+#include <llair/IR/Module.h>
+#include <llair/Tools/CompileScheduler.h>
+
+#include <llvm/ADT/ScopeExit.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "CompileImpl.h"
+#include "ToolsImpl.h"
+
+namespace llair {
+
+namespace {
+
+llvm::Error
+makeCancelledError() {
+    return llvm::createStringError(std::make_error_code(std::errc::operation_canceled),
+                                   "compile job cancelled");
+}
+
+} // namespace
+
+CompileScheduler::CompileScheduler(unsigned concurrency) {
+    if (concurrency == 0) {
+        concurrency = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    d_workers.reserve(concurrency);
+
+    for (unsigned i = 0; i < concurrency; ++i) {
+        d_workers.emplace_back([this]() -> void { run(); });
+    }
+}
+
+CompileScheduler::~CompileScheduler() {
+    std::map<QueueKey, Work, QueueOrder> cancelled;
+
+  { std::lock_guard<std::mutex> lock(d_mutex);
+    d_stopping = true;
+    cancelled.swap(d_queue);
+    d_priorities.clear(); }
+
+    d_queued.notify_all();
+
+    std::for_each(
+        cancelled.begin(), cancelled.end(),
+        [](auto& tmp) -> void { tmp.second.callback(makeCancelledError()); });
+
+    std::for_each(
+        d_workers.begin(), d_workers.end(),
+        [](auto& worker) -> void { worker.join(); });
+}
+
+CompileScheduler::JobID
+CompileScheduler::submit(llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> options,
+                         LLAIRContext &context, Callback callback, int priority) {
+    Work work;
+    work.buffer = llvm::MemoryBuffer::getMemBufferCopy(buffer.getBuffer(),
+                                                       buffer.getBufferIdentifier());
+    std::transform(
+        options.begin(), options.end(),
+        std::back_inserter(work.options),
+        [](auto option) -> auto { return option.str(); });
+    work.context  = &context;
+    work.callback = std::move(callback);
+
+    JobID id;
+
+  { std::lock_guard<std::mutex> lock(d_mutex);
+    id = d_next_id++;
+    d_queue.emplace(QueueKey(priority, id), std::move(work));
+    d_priorities.insert({ id, priority }); }
+
+    d_queued.notify_one();
+
+    return id;
+}
+
+CompileScheduler::Job
+CompileScheduler::submit(llvm::MemoryBufferRef buffer, llvm::ArrayRef<llvm::StringRef> options,
+                         LLAIRContext &context, int priority) {
+    // std::function must be copyable:
+    auto promise = std::make_shared<std::promise<Result>>();
+    auto result  = promise->get_future();
+
+    auto id = submit(buffer, options, context,
+                     [promise](Result module) -> void { promise->set_value(std::move(module)); },
+                     priority);
+
+    return { id, std::move(result) };
+}
+
+bool
+CompileScheduler::cancel(JobID id) {
+    std::unique_lock<std::mutex> lock(d_mutex);
+
+    auto it = d_priorities.find(id);
+    if (it == d_priorities.end()) {
+        return false;
+    }
+
+    auto jt = d_queue.find(QueueKey(it->second, id));
+    auto work = std::move(jt->second);
+
+    d_queue.erase(jt);
+    d_priorities.erase(it);
+
+    bool idle = d_queue.empty() && d_running == 0;
+
+    lock.unlock();
+
+    work.callback(makeCancelledError());
+
+    if (idle) {
+        d_idle.notify_all();
+    }
+
+    return true;
+}
+
+void
+CompileScheduler::wait() {
+    std::unique_lock<std::mutex> lock(d_mutex);
+    d_idle.wait(lock, [this]() -> bool { return d_queue.empty() && d_running == 0; });
+}
+
+void
+CompileScheduler::run() {
+    std::unique_lock<std::mutex> lock(d_mutex);
+
+    while (true) {
+        d_queued.wait(lock, [this]() -> bool { return d_stopping || !d_queue.empty(); });
+
+        if (d_queue.empty()) {
+            return;
+        }
+
+        auto it   = d_queue.begin();
+        auto work = std::move(it->second);
+
+        d_priorities.erase(it->first.second);
+        d_queue.erase(it);
+        ++d_running;
+
+        lock.unlock();
+
+        perform(work);
+
+        lock.lock();
+
+        --d_running;
+
+        if (d_queue.empty() && d_running == 0) {
+            d_idle.notify_all();
+        }
+    }
+}
+
+void
+CompileScheduler::perform(Work& work) {
+    auto path  = getPathToTools();
+    auto cache = getCompileCache();
+
+    llvm::SmallVector<llvm::StringRef, 8> options(work.options.begin(), work.options.end());
+
+    auto buffer = work.buffer->getMemBufferRef();
+    auto key    = getCompileCacheKey(cache, path, buffer, options);
+
+    auto& context_mutex = acquireContextMutex(work.context);
+    auto  release       = llvm::make_scope_exit(
+        [this, &work]() -> void { releaseContextMutex(work.context); });
+
+    // Neither the cache nor the compiler touch the context, so these run concurrently:
+    if (!key.empty()) {
+        if (auto bitcode = cache->lookup(key)) {
+            std::lock_guard<std::mutex> lock(context_mutex);
+
+            auto module = readCompiled(bitcode->getMemBufferRef(), *work.context);
+
+            if (module) {
+                work.callback(std::move(module));
+                return;
+            }
+
+            // A corrupt entry is overwritten when the source is recompiled:
+            llvm::consumeError(module.takeError());
+        }
+    }
+
+    auto bitcode = compileToBitcode(path, buffer, options);
+
+    std::lock_guard<std::mutex> lock(context_mutex);
+
+    if (!bitcode) {
+        work.callback(bitcode.takeError());
+        return;
+    }
+
+    work.callback(loadCompiled((*bitcode)->getMemBufferRef(), cache, key, *work.context));
+}
+
+std::mutex&
+CompileScheduler::acquireContextMutex(LLAIRContext *context) {
+    std::lock_guard<std::mutex> lock(d_mutex);
+
+    auto& state = d_contexts[context];
+    if (!state) {
+        state.reset(new ContextState());
+    }
+
+    ++state->users;
+
+    return state->mutex;
+}
+
+// The entry goes with the context's last work item, so the map doesn't grow with every context
+// that's ever used, and a context that reuses the address starts afresh:
+void
+CompileScheduler::releaseContextMutex(LLAIRContext *context) {
+    std::lock_guard<std::mutex> lock(d_mutex);
+
+    auto it = d_contexts.find(context);
+    assert(it != d_contexts.end());
+
+    if (--it->second->users == 0) {
+        d_contexts.erase(it);
+    }
+}
+
+} // End namespace llair
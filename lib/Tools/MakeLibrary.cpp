@@ -4,64 +4,696 @@
 #include <llair/Tools/MakeLibrary.h>
 #include <llair/Tools/Program.h>
 
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
 #include <llvm/ADT/StringSet.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Linker/Linker.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Path.h>
 #include <llvm/Support/Process.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/raw_ostream.h>
 #include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/AlwaysInliner.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/Transforms/Utils/Cloning.h>
 
+#if LLVM_VERSION_MAJOR >= 13
+#include <llvm/IR/PassTimingInfo.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/IPO/GlobalDCE.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "CacheImpl.h"
+#include "CompileImpl.h"
 #include "ToolsImpl.h"
 
 namespace llair {
 
-std::unique_ptr<llvm::Module>
-finalizeLibrary(const Module& module) {
-#if LLVM_VERSION_MAJOR >= 8
-    auto finalized_module = llvm::CloneModule(*module.getLLModule());
+namespace {
+
+// Guards the cache path and policy, which the setters may change while workers read them:
+std::mutex &
+libraryCacheMutex() {
+    static std::mutex s_libraryCacheMutex;
+    return s_libraryCacheMutex;
+}
+
+llvm::SmallString<256> &
+libraryCachePath() {
+    static llvm::SmallString<256> s_libraryCachePath;
+    return s_libraryCachePath;
+}
+
+llvm::Optional<llvm::CachePruningPolicy> &
+libraryCachePolicy() {
+    static llvm::Optional<llvm::CachePruningPolicy> s_libraryCachePolicy;
+    return s_libraryCachePolicy;
+}
+
+std::atomic<std::size_t> &
+libraryMemoryCacheSize() {
+    static std::atomic<std::size_t> s_libraryMemoryCacheSize = { 64 * 1024 * 1024 };
+    return s_libraryMemoryCacheSize;
+}
+
+MemoryCache &
+libraryMemoryCache() {
+    static MemoryCache s_libraryMemoryCache(libraryMemoryCacheSize());
+    return s_libraryMemoryCache;
+}
+
+struct LibraryCacheCounters {
+    std::atomic<uint64_t> memory_hits = { 0 }, disk_hits = { 0 }, misses = { 0 };
+};
+
+LibraryCacheCounters &
+libraryCacheCounters() {
+    static LibraryCacheCounters s_libraryCacheCounters;
+    return s_libraryCacheCounters;
+}
+
+// Objects removed from a Module leave null operands in its named metadata:
+void
+stripNullMetadataOperands(llvm::Module& module) {
+    for (auto& named_md : module.named_metadata()) {
+        auto has_null = std::any_of(
+            named_md.op_begin(), named_md.op_end(),
+            [](auto operand) -> bool { return operand == nullptr; });
+
+        if (!has_null) {
+            continue;
+        }
+
+        std::vector<llvm::MDNode *> operands;
+        std::copy_if(
+            named_md.op_begin(), named_md.op_end(),
+            std::back_inserter(operands),
+            [](auto operand) -> bool { return operand != nullptr; });
+
+        named_md.clearOperands();
+        std::for_each(
+            operands.begin(), operands.end(),
+            [&named_md](auto operand) -> void { named_md.addOperand(operand); });
+    }
+}
+
+// Reads the function bodies of a lazily loaded module, so that it can be cloned; this doesn't
+// change what the module holds:
+llvm::Error
+materializeForCloning(const Module& module) {
+    return const_cast<Module&>(module).materializeAll();
+}
+
+#if LLVM_VERSION_MAJOR >= 13
+
+// It was PassBuilder's until LLVM 14:
+#if LLVM_VERSION_MAJOR >= 14
+using OptimizationLevel = llvm::OptimizationLevel;
 #else
-    auto finalized_module =  llvm::CloneModule(module.getLLModule());
+using OptimizationLevel = llvm::PassBuilder::OptimizationLevel;
 #endif
 
-    if (auto class_md = finalized_module->getNamedMetadata("llair.class"); class_md) {
-        finalized_module->eraseNamedMetadata(class_md);
+OptimizationLevel
+getOptimizationLevel(const FinalizeOptions& options) {
+    if (options.opt_level == 0) {
+        return OptimizationLevel::O0;
+    }
+
+    if (options.opt_level == 1) {
+        return OptimizationLevel::O1;
+    }
+
+    if (options.size_level >= 2) {
+        return OptimizationLevel::Oz;
+    }
+
+    // -Os optimizes at level 2, so level 3 (the default) keeps its speed:
+    if (options.size_level == 1 && options.opt_level == 2) {
+        return OptimizationLevel::Os;
+    }
+
+    switch (options.opt_level) {
+    case 2:
+        return OptimizationLevel::O2;
+    default:
+        return OptimizationLevel::O3;
+    }
+}
+
+llvm::Error
+optimize(llvm::Module& module, const FinalizeOptions& options) {
+    auto level = getOptimizationLevel(options);
+
+    // The same defaults as clang's:
+    auto vectorize = level.getSpeedupLevel() > 1 && level.getSizeLevel() < 2;
+
+    llvm::PipelineTuningOptions tuning;
+    tuning.LoopVectorization = options.loop_vectorization.getValueOr(vectorize);
+    tuning.SLPVectorization  = options.slp_vectorization.getValueOr(vectorize);
+    tuning.LoopUnrolling     = options.loop_unrolling.getValueOr(level != OptimizationLevel::O0);
+    tuning.LoopInterleaving  = options.loop_interleaving.getValueOr(tuning.LoopUnrolling);
+
+    // Reports when it's destroyed, after the passes and analyses:
+    llvm::TimePassesHandler             time_passes(options.time_passes != nullptr);
+    llvm::PassInstrumentationCallbacks  callbacks;
+
+    if (options.time_passes) {
+        time_passes.setOutStream(*options.time_passes);
+        time_passes.registerCallbacks(callbacks);
+    }
+
+    llvm::PassBuilder pass_builder(nullptr, tuning, llvm::None, &callbacks);
+
+    llvm::LoopAnalysisManager     lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager    cgam;
+    llvm::ModuleAnalysisManager   mam;
+
+    pass_builder.registerModuleAnalyses(mam);
+    pass_builder.registerCGSCCAnalyses(cgam);
+    pass_builder.registerFunctionAnalyses(fam);
+    pass_builder.registerLoopAnalyses(lam);
+    pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+    llvm::ModulePassManager mpm;
+
+    if (!options.pipeline.empty()) {
+        if (auto error = pass_builder.parsePassPipeline(mpm, options.pipeline)) {
+            return error;
+        }
+    }
+    else if (level == OptimizationLevel::O0) {
+        mpm = pass_builder.buildO0DefaultPipeline(level);
+    }
+    else if (level == OptimizationLevel::O1) {
+        // The inliner, and the simplification it repeats for each SCC that it changes, are most of
+        // the time that the default pipeline takes; O1 inlines only what must be, and then
+        // simplifies each function once:
+        mpm.addPass(llvm::AlwaysInlinerPass());
+        mpm.addPass(llvm::createModuleToFunctionPassAdaptor(
+            pass_builder.buildFunctionSimplificationPipeline(level, llvm::ThinOrFullLTOPhase::None)));
+        mpm.addPass(llvm::GlobalDCEPass());
+    }
+    else {
+        mpm = pass_builder.buildPerModuleDefaultPipeline(level);
+    }
+
+    mpm.run(module, mam);
+
+    return llvm::Error::success();
+}
+
+#else
+
+// The legacy pass manager has no textual pipelines, nor a timer that reports to a stream:
+llvm::Error
+optimize(llvm::Module& module, const FinalizeOptions& options) {
+    if (!options.pipeline.empty() || options.time_passes) {
+        return llvm::createStringError(std::errc::not_supported,
+                                       "custom pipelines and pass timing need LLVM 13 or later");
     }
 
-    llvm::legacy::FunctionPassManager fpm(finalized_module.get());
+    llvm::legacy::FunctionPassManager fpm(&module);
 
     llvm::legacy::PassManager mpm;
 
     llvm::PassManagerBuilder pmb;
 
-    pmb.OptLevel  = 3;
-    pmb.SizeLevel = 1;
+    pmb.OptLevel  = std::min(options.opt_level, 3u);
+    pmb.SizeLevel = pmb.OptLevel > 1 ? std::min(options.size_level, 2u) : 0;
 
-    pmb.Inliner = llvm::createFunctionInliningPass(pmb.OptLevel, pmb.SizeLevel, false);
+    if (pmb.OptLevel > 1) {
+        pmb.Inliner = llvm::createFunctionInliningPass(pmb.OptLevel, pmb.SizeLevel, false);
+    }
+    else {
+        pmb.Inliner = llvm::createAlwaysInlinerLegacyPass();
+    }
+
+    auto vectorize = pmb.OptLevel > 1 && pmb.SizeLevel < 2;
 
-    pmb.DisableUnrollLoops = pmb.OptLevel == 0;
-    pmb.LoopVectorize = pmb.OptLevel > 1 && pmb.SizeLevel < 2;
-    pmb.SLPVectorize = pmb.OptLevel > 1 && pmb.SizeLevel < 2;
+    pmb.DisableUnrollLoops = !options.loop_unrolling.getValueOr(pmb.OptLevel > 0);
+    pmb.LoopVectorize      = options.loop_vectorization.getValueOr(vectorize);
+    pmb.SLPVectorize       = options.slp_vectorization.getValueOr(vectorize);
 
     pmb.populateFunctionPassManager(fpm);
     pmb.populateModulePassManager(mpm);
 
     fpm.doInitialization();
 
-    for (auto& function : *finalized_module) {
+    for (auto& function : module) {
         fpm.run(function);
     }
     fpm.doFinalization();
 
-    mpm.run(*finalized_module);
+    mpm.run(module);
 
-    return finalized_module;
+    return llvm::Error::success();
+}
+
+#endif
+
+const char *const kEntryPointMetadataNames[] = {
+    "air.vertex", "air.fragment", "air.kernel"
+};
+
+// Reduces the module to what the preserved globals reach; the rest of what they reach becomes
+// internal, so that each partition has its own copy. Entry points that aren't preserved are
+// removed from the metadata, and only the first partition keeps the module's other named metadata
+// (the linker would otherwise repeat it). Likewise, only the first partition keeps the static
+// constructors and the globals marked as used; the others drop them before they are reduced, so that
+// they neither keep their own copies alive nor repeat them when the partitions are linked:
+void
+makePartition(llvm::Module& module, const llvm::StringSet<>& gvs, bool first) {
+    if (!first) {
+        for (auto name : { "llvm.global_ctors", "llvm.used", "llvm.compiler.used" }) {
+            if (auto gv = module.getNamedGlobal(name)) {
+                gv->eraseFromParent();
+            }
+        }
+    }
+
+    std::vector<llvm::NamedMDNode *> erased_mds;
+
+    for (auto& named_md : module.named_metadata()) {
+        auto name = named_md.getName();
+
+        auto is_entry_points = std::any_of(
+            std::begin(kEntryPointMetadataNames), std::end(kEntryPointMetadataNames),
+            [name](auto entry_point_name) -> bool { return name == entry_point_name; });
+
+        if (!is_entry_points) {
+            // Each partition's debug info refers to its own compile unit; the linker merges the
+            // module flags:
+            if (!first && name != "llvm.dbg.cu" && name != "llvm.module.flags") {
+                erased_mds.push_back(&named_md);
+            }
+
+            continue;
+        }
+
+        std::vector<llvm::MDNode *> operands;
+        std::copy_if(
+            named_md.op_begin(), named_md.op_end(),
+            std::back_inserter(operands),
+            [&gvs](auto operand) -> bool {
+                if (!operand || operand->getNumOperands() == 0) {
+                    return false;
+                }
+
+                auto function = llvm::mdconst::dyn_extract_or_null<llvm::Function>(operand->getOperand(0));
+                return function && gvs.count(function->getName()) == 1;
+            });
+
+        named_md.clearOperands();
+        std::for_each(
+            operands.begin(), operands.end(),
+            [&named_md](auto operand) -> void { named_md.addOperand(operand); });
+    }
+
+    std::for_each(
+        erased_mds.begin(), erased_mds.end(),
+        [&module](auto named_md) -> void { module.eraseNamedMetadata(named_md); });
+
+    llvm::legacy::PassManager mpm;
+
+    mpm.add(llvm::createInternalizePass([&gvs](const llvm::GlobalValue& gv) -> bool {
+        return gvs.count(gv.getName()) == 1;
+    }));
+
+    mpm.add(llvm::createGlobalDCEPass());
+
+    mpm.run(module);
+}
+
+// The first partition preserves the externally visible definitions that aren't entry points, and
+// each of the others preserves one entry point:
+llvm::Expected<std::unique_ptr<llvm::Module>>
+optimizePartitions(std::unique_ptr<llvm::Module> module, llvm::ArrayRef<std::string> entry_points,
+                   const FinalizeOptions& options) {
+    std::vector<llvm::StringSet<>> partitions(entry_points.size() + 1);
+
+    std::for_each(
+        module->global_values().begin(), module->global_values().end(),
+        [entry_points, &partitions](const auto& gv) -> void {
+            if (gv.isDeclaration() || gv.hasLocalLinkage() ||
+                std::find(entry_points.begin(), entry_points.end(), gv.getName()) != entry_points.end()) {
+                return;
+            }
+
+            partitions.front().insert(gv.getName());
+        });
+
+    for (std::size_t index = 0, n = entry_points.size(); index < n; ++index) {
+        partitions[index + 1].insert(entry_points[index]);
+    }
+
+    // Each partition is read into a context of its own:
+    llvm::SmallVector<char, 0> bitcode;
+
+  { llvm::raw_svector_ostream os(bitcode);
+#if LLVM_VERSION_MAJOR >= 8
+    llvm::WriteBitcodeToFile(*module, os);
+#else
+    llvm::WriteBitcodeToFile(module.get(), os);
+#endif
+  }
+
+    llvm::MemoryBufferRef input(llvm::StringRef(bitcode.data(), bitcode.size()),
+                                module->getModuleIdentifier());
+
+    auto& context = module->getContext();
+    module.reset();
+
+    std::vector<llvm::SmallVector<char, 0>> outputs(partitions.size());
+    std::vector<std::string>                time_reports(partitions.size());
+    std::vector<llvm::Error>                errors;
+
+    for (std::size_t index = 0, n = partitions.size(); index < n; ++index) {
+        errors.push_back(llvm::Error::success());
+    }
+
+  {
+#if LLVM_VERSION_MAJOR >= 11
+    llvm::ThreadPool pool(llvm::hardware_concurrency(options.partition_threads));
+#else
+    llvm::ThreadPool pool(options.partition_threads
+                              ? options.partition_threads
+                              : std::max(std::thread::hardware_concurrency(), 1u));
+#endif
+
+    for (std::size_t index = 0, n = partitions.size(); index < n; ++index) {
+        pool.async([index, input, &partitions, &options, &outputs, &time_reports, &errors]() -> void {
+            llvm::LLVMContext partition_context;
+
+            auto partition = llvm::parseBitcodeFile(input, partition_context);
+
+            if (!partition) {
+                errors[index] = partition.takeError();
+                return;
+            }
+
+            makePartition(**partition, partitions[index], index == 0);
+
+            // Partitions are timed separately, and reported in order:
+            llvm::raw_string_ostream time_report(time_reports[index]);
+
+            auto partition_options        = options;
+            partition_options.time_passes = options.time_passes ? &time_report : nullptr;
+
+            if (auto error = optimize(**partition, partition_options)) {
+                errors[index] = std::move(error);
+                return;
+            }
+
+            llvm::raw_svector_ostream os(outputs[index]);
+#if LLVM_VERSION_MAJOR >= 8
+            llvm::WriteBitcodeToFile(**partition, os);
+#else
+            llvm::WriteBitcodeToFile(partition->get(), os);
+#endif
+        });
+    }
+
+    pool.wait();
+  }
+
+    llvm::Error error = llvm::Error::success();
+
+    std::for_each(
+        errors.begin(), errors.end(),
+        [&error](auto& partition_error) -> void {
+            error = llvm::joinErrors(std::move(error), std::move(partition_error));
+        });
+
+    if (error) {
+        return std::move(error);
+    }
+
+    if (options.time_passes) {
+        for (std::size_t index = 0, n = partitions.size(); index < n; ++index) {
+            *options.time_passes << "partition "
+                                 << (index == 0 ? llvm::StringRef("<rest>")
+                                                : llvm::StringRef(entry_points[index - 1]))
+                                 << ":\n" << time_reports[index];
+        }
+    }
+
+    // Link the partitions, in order, back into the caller's context:
+    std::unique_ptr<llvm::Module> combined_module;
+
+    for (std::size_t index = 0, n = partitions.size(); index < n; ++index) {
+        llvm::MemoryBufferRef output(llvm::StringRef(outputs[index].data(), outputs[index].size()),
+                                     input.getBufferIdentifier());
+
+        auto partition = llvm::parseBitcodeFile(output, context);
+
+        if (!partition) {
+            return partition.takeError();
+        }
+
+        if (!combined_module) {
+            combined_module = std::move(*partition);
+            continue;
+        }
+
+        if (llvm::Linker::linkModules(*combined_module, std::move(*partition))) {
+            return llvm::createStringError(std::errc::invalid_argument,
+                                           "unable to link the partition of '%s'",
+                                           entry_points[index - 1].c_str());
+        }
+    }
+
+    return std::move(combined_module);
+}
+
+// Everything in the options that changes the library, for the cache key:
+std::string
+getOptimizationSettings(const FinalizeOptions& options) {
+    std::string              settings;
+    llvm::raw_string_ostream os(settings);
+
+    os << "opt-level=" << options.opt_level << ":size-level=" << options.size_level;
+
+    auto toggle = [&os](const char *name, const llvm::Optional<bool>& value) -> void {
+        if (value) {
+            os << ":" << name << "=" << (*value ? 1 : 0);
+        }
+    };
+
+    toggle("vectorize-loops", options.loop_vectorization);
+    toggle("vectorize-slp", options.slp_vectorization);
+    toggle("unroll-loops", options.loop_unrolling);
+    toggle("interleave-loops", options.loop_interleaving);
+
+    if (!options.pipeline.empty()) {
+        os << ":passes=" << options.pipeline;
+    }
+
+    // The number of threads doesn't change the library:
+    if (options.partition) {
+        os << ":partition";
+    }
+
+    return os.str();
+}
+
+template<typename Make>
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+makeCachedLibrary(const Module& module, llvm::StringRef variant, llvm::StringRef settings,
+                  Make make) {
+    llvm::SmallString<256>                  path;
+    llvm::Optional<llvm::CachePruningPolicy> policy;
+
+  { std::lock_guard<std::mutex> lock(libraryCacheMutex());
+    path   = libraryCachePath();
+    policy = libraryCachePolicy(); }
+
+    auto memory_cache = libraryMemoryCacheSize() > 0 ? &libraryMemoryCache() : nullptr;
+    auto disk_cache   = getDiskCache(path, policy,
+                                     "LLAIR_LIBRARY_CACHE_PATH", "LLAIR_LIBRARY_CACHE_POLICY");
+
+    if (!memory_cache && !disk_cache) {
+        return make();
+    }
+
+    // The module's structural hash stands for its contents; it doesn't change with the names of
+    // local values or the order of globals, and it's cheaper than writing bitcode:
+    auto hash = module.structuralHash();
+
+    if (!hash) {
+        return hash.takeError();
+    }
+
+    CacheKey key_builder;
+    key_builder
+        .add(llvm::utohexstr(*hash))
+        .add(variant)
+        .add(settings)
+        .add(LLVM_VERSION_STRING);
+
+    // The tools make the library from the finalized module:
+    if (variant == "lld") {
+        auto path    = getPathToTools();
+        auto version = getCompilerVersion(path);
+
+        if (!version) {
+            llvm::consumeError(version.takeError());
+            return make();
+        }
+
+        key_builder.add(path).add(*version);
+    }
+
+    auto key = key_builder.str();
+
+    auto& counters = libraryCacheCounters();
+
+    if (memory_cache) {
+        if (auto library = memory_cache->lookup(key)) {
+            ++counters.memory_hits;
+            return shareMemoryBuffer(std::move(library));
+        }
+    }
+
+    if (disk_cache) {
+        if (auto library = disk_cache->lookup(key)) {
+            ++counters.disk_hits;
+
+            if (!memory_cache) {
+                return std::move(library);
+            }
+
+            std::shared_ptr<llvm::MemoryBuffer> shared(std::move(library));
+            memory_cache->insert(key, shared);
+            return shareMemoryBuffer(std::move(shared));
+        }
+    }
+
+    ++counters.misses;
+
+    auto library = make();
+
+    if (!library) {
+        return library.takeError();
+    }
+
+    // Failing to cache isn't an error:
+    if (disk_cache) {
+        llvm::consumeError(disk_cache->store(key, (*library)->getBuffer()));
+    }
+
+    if (!memory_cache) {
+        return library;
+    }
+
+    std::shared_ptr<llvm::MemoryBuffer> shared(std::move(*library));
+    memory_cache->insert(key, shared);
+    return shareMemoryBuffer(std::move(shared));
+}
+
+}
+
+void
+setLibraryCachePath(llvm::StringRef path) {
+    std::lock_guard<std::mutex> lock(libraryCacheMutex());
+    llvm::sys::path::native(path, libraryCachePath());
+}
+
+llvm::Error
+setLibraryCachePolicy(llvm::StringRef policy) {
+    auto parsed_policy = llvm::parseCachePruningPolicy(policy);
+
+    if (!parsed_policy) {
+        return parsed_policy.takeError();
+    }
+
+    std::lock_guard<std::mutex> lock(libraryCacheMutex());
+    libraryCachePolicy() = *parsed_policy;
+
+    return llvm::Error::success();
+}
+
+void
+setLibraryMemoryCacheSize(std::size_t bytes) {
+    libraryMemoryCacheSize() = bytes;
+    libraryMemoryCache().setCapacity(bytes);
+}
+
+LibraryCacheStatistics
+getLibraryCacheStatistics() {
+    auto& counters = libraryCacheCounters();
+
+    LibraryCacheStatistics statistics;
+    statistics.memory_hits = counters.memory_hits;
+    statistics.disk_hits   = counters.disk_hits;
+    statistics.misses      = counters.misses;
+
+    return statistics;
+}
+
+std::unique_ptr<llvm::Module>
+finalizeLibrary(const Module& module) {
+    return llvm::cantFail(finalizeLibrary(module, FinalizeOptions()));
+}
+
+llvm::Expected<std::unique_ptr<llvm::Module>>
+finalizeLibrary(const Module& module, const FinalizeOptions& options) {
+    if (auto error = materializeForCloning(module)) {
+        return std::move(error);
+    }
+
+#if LLVM_VERSION_MAJOR >= 8
+    auto finalized_module = llvm::CloneModule(*module.getLLModule());
+#else
+    auto finalized_module =  llvm::CloneModule(module.getLLModule());
+#endif
+
+    if (auto class_md = finalized_module->getNamedMetadata("llair.class"); class_md) {
+        finalized_module->eraseNamedMetadata(class_md);
+    }
+
+    if (auto abi_index_md = finalized_module->getNamedMetadata("llair.abi_index"); abi_index_md) {
+        finalized_module->eraseNamedMetadata(abi_index_md);
+    }
+
+    stripNullMetadataOperands(*finalized_module);
+
+    if (options.partition) {
+        std::vector<std::string> entry_points;
+
+        std::for_each(
+            module.entry_point_begin(), module.entry_point_end(),
+            [&entry_points](const auto& entry_point) -> void {
+                if (auto function = entry_point.getFunction(); function) {
+                    entry_points.push_back(function->getName().str());
+                }
+            });
+
+        if (entry_points.size() > 1) {
+            return optimizePartitions(std::move(finalized_module), entry_points, options);
+        }
+    }
+
+    if (auto error = optimize(*finalized_module, options)) {
+        return std::move(error);
+    }
+
+    return std::move(finalized_module);
 }
 
 llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
@@ -76,14 +708,32 @@ makeLibrary(const llvm::Module &module) {
 
 llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
 makeLibrary(const Module &module) {
-    auto finalized_module = finalizeLibrary(module);
+    return makeLibrary(module, FinalizeOptions());
+}
 
-    return makeLibrary(*finalized_module);
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+makeLibrary(const Module &module, const FinalizeOptions &options) {
+    auto make = [&module, &options]() -> llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> {
+        auto finalized_module = finalizeLibrary(module, options);
+
+        if (!finalized_module) {
+            return finalized_module.takeError();
+        }
+
+        return makeLibrary(**finalized_module);
+    };
+
+    // A cached library has no timings to report:
+    if (options.time_passes) {
+        return make();
+    }
+
+    return makeCachedLibrary(module, "metallib", getOptimizationSettings(options), make);
 }
 
 namespace {
 
-std::unique_ptr<llvm::Module>
+llvm::Expected<std::unique_ptr<llvm::Module>>
 finalizeLibraryForLLD(const Module& module) {
     llvm::StringSet gvs;
 
@@ -93,6 +743,10 @@ finalizeLibraryForLLD(const Module& module) {
             gvs.insert(entry_point.getFunction()->getName());
         });
 
+    if (auto error = materializeForCloning(module)) {
+        return std::move(error);
+    }
+
 #if LLVM_VERSION_MAJOR >= 8
     auto finalized_module = llvm::CloneModule(*module.getLLModule());
 #else
@@ -103,6 +757,12 @@ finalizeLibraryForLLD(const Module& module) {
         finalized_module->eraseNamedMetadata(class_md);
     }
 
+    if (auto abi_index_md = finalized_module->getNamedMetadata("llair.abi_index"); abi_index_md) {
+        finalized_module->eraseNamedMetadata(abi_index_md);
+    }
+
+    stripNullMetadataOperands(*finalized_module);
+
     llvm::legacy::PassManager mpm;
 
     mpm.add(llvm::createInternalizePass([&gvs](const llvm::GlobalValue& gv) -> bool {
@@ -123,36 +783,42 @@ makeLibraryWithLLD(const llvm::Module &module) {
     auto path     = getPathToTools();
     auto filename = llvm::sys::path::filename(path).str();
 
-    llvm::ArrayRef<std::string> args = {filename.data(), "air-lld", "--macos_version_min", "14.0", "-o", "-", "/dev/stdin"};
+    std::vector<std::string> args = {filename.data(), "air-lld", "--macos_version_min", "14.0", "-o", "-", "/dev/stdin"};
 
-#if LLVM_VERSION_MAJOR >= 12
-    auto program = llvm::errorOrToExpected(openProgram((std::string)path, args));
+    llvm::SmallVector<char, 0> bitcode;
+
+  { llvm::raw_svector_ostream os(bitcode);
+#if LLVM_VERSION_MAJOR >= 8
+    llvm::WriteBitcodeToFile(module, os);
 #else
-    auto program = llvm::errorOrToExpected(openProgram(path.str(), args));
+    llvm::WriteBitcodeToFile(&module, os);
 #endif
+  }
+
+    llvm::MemoryBufferRef input(llvm::StringRef(bitcode.data(), bitcode.size()), "");
 
-    if (program) {
-        // Write the module:
- #if LLVM_VERSION_MAJOR >= 8
-        llvm::WriteBitcodeToFile(module, *program->input);
+    // The linker's output is read while the module is written, so neither side can block on a
+    // full pipe:
+#if LLVM_VERSION_MAJOR >= 12
+    return runProgram((std::string)path, args, input);
 #else
-        llvm::WriteBitcodeToFile(&module, *program->input);
+    return runProgram(path.str(), args, input);
 #endif
-        program->input->close();
-
-        // Read output:
-        return llvm::errorOrToExpected(getMemoryBufferForStream(program->output, ""));
-    }
-    else {
-        return program.takeError();
-    }
 }
 
 llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
 makeLibraryWithLLD(const Module &module) {
-    auto finalized_module = finalizeLibraryForLLD(module);
+    return makeCachedLibrary(
+        module, "lld", "internalize",
+        [&module]() -> llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> {
+            auto finalized_module = finalizeLibraryForLLD(module);
+
+            if (!finalized_module) {
+                return finalized_module.takeError();
+            }
 
-    return makeLibraryWithLLD(*finalized_module);
+            return makeLibraryWithLLD(**finalized_module);
+        });
 }
 
 } // namespace llair
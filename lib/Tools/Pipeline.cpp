@@ -0,0 +1,366 @@
+#include <llair/Bitcode/Bitcode.h>
+#include <llair/IR/Class.h>
+#include <llair/IR/Interface.h>
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+#include <llair/Linker/Linker.h>
+#include <llair/Tools/MakeLibrary.h>
+#include <llair/Tools/Pipeline.h>
+
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <thread>
+
+#include "CompileImpl.h"
+#include "ToolsImpl.h"
+
+namespace llair {
+
+namespace {
+
+// A stage, which is queued on the pool once the tasks that it depends on have finished:
+class Task {
+public:
+
+    explicit Task(std::function<void()> work)
+        : d_work(std::move(work)) {
+    }
+
+    // Dependencies must be added before either task is started:
+    static void addDependency(const std::shared_ptr<Task>& task, Task& dependency) {
+        ++task->d_pending;
+        dependency.d_dependents.push_back(task);
+    }
+
+    static void start(const std::shared_ptr<Task>& task, llvm::ThreadPool& pool) {
+        release(task, pool);
+    }
+
+private:
+
+    static void release(const std::shared_ptr<Task>& task, llvm::ThreadPool& pool) {
+        if (--task->d_pending > 0) {
+            return;
+        }
+
+        pool.async([task, &pool]() -> void {
+            task->d_work();
+
+            std::for_each(
+                task->d_dependents.begin(), task->d_dependents.end(),
+                [&pool](const auto& dependent) -> void { release(dependent, pool); });
+        });
+    }
+
+    std::function<void()>              d_work;
+
+    // The dependencies that haven't finished, plus one until the task is started:
+    std::atomic<unsigned>              d_pending = { 1 };
+
+    std::vector<std::shared_ptr<Task>> d_dependents;
+};
+
+struct Job {
+    struct Source {
+        std::unique_ptr<llvm::MemoryBuffer> buffer;
+        std::vector<std::string>            options;
+
+        // Set by the source's compile task:
+        std::string                         key;
+        bool                                cached = false;
+        llvm::Optional<llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>> bitcode;
+    };
+
+    std::vector<Source>                   sources;
+    PipelineOptions                       options;
+    Pipeline::Callback                    callback;
+
+    llvm::SmallString<256>                path;
+    llvm::Optional<DiskCache>             cache;
+
+    // Stages after compilation run one at a time, so these need no synchronization:
+    std::unique_ptr<llvm::LLVMContext>    llvm_context;
+    std::unique_ptr<LLAIRContext>         llair_context;
+    std::unique_ptr<Module>               module;
+    std::unique_ptr<llvm::Module>         library_module;
+
+    bool                                  delivered = false;
+    std::chrono::steady_clock::time_point submitted;
+    PipelineTimings                       timings;
+};
+
+template<typename Function>
+PipelineTimings::Duration
+measure(Function&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::steady_clock::now() - start;
+}
+
+void
+deliver(Job& job, llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> library) {
+    job.delivered = true;
+
+    // In the reverse order of their dependencies:
+    job.library_module.reset();
+    job.module.reset();
+    job.llair_context.reset();
+    job.llvm_context.reset();
+
+    job.timings.total = std::chrono::steady_clock::now() - job.submitted;
+
+    job.callback(PipelineResult{ std::move(library), std::move(job.timings) });
+}
+
+// Doesn't touch a context, so the sources of a library are compiled concurrently:
+void
+compileSource(Job& job, std::size_t index) {
+    auto& source = job.sources[index];
+
+    llvm::SmallVector<llvm::StringRef, 8> options(source.options.begin(), source.options.end());
+
+    auto buffer = source.buffer->getMemBufferRef();
+
+    source.key = getCompileCacheKey(job.cache, job.path, buffer, options);
+
+    if (!source.key.empty()) {
+        if (auto bitcode = job.cache->lookup(source.key)) {
+            source.cached = true;
+            source.bitcode.emplace(std::move(bitcode));
+            return;
+        }
+    }
+
+    source.bitcode.emplace(compileToBitcode(job.path, buffer, options));
+}
+
+llvm::Expected<std::unique_ptr<Module>>
+loadSource(Job& job, Job::Source& source) {
+    auto& bitcode = *source.bitcode;
+
+    if (!bitcode) {
+        return bitcode.takeError();
+    }
+
+    if (source.cached) {
+        auto module = readCompiled((*bitcode)->getMemBufferRef(), *job.llair_context);
+
+        if (module) {
+            return module;
+        }
+
+        // A corrupt entry is overwritten when the source is recompiled:
+        llvm::consumeError(module.takeError());
+
+        llvm::SmallVector<llvm::StringRef, 8> options(source.options.begin(), source.options.end());
+
+        auto recompiled = compileToBitcode(job.path, source.buffer->getMemBufferRef(), options);
+
+        if (!recompiled) {
+            return recompiled.takeError();
+        }
+
+        *bitcode = std::move(*recompiled);
+    }
+
+    return loadCompiled((*bitcode)->getMemBufferRef(), job.cache, source.key, *job.llair_context);
+}
+
+llvm::Error
+linkSources(Job& job) {
+    job.llvm_context.reset(new llvm::LLVMContext());
+    job.llair_context.reset(new LLAIRContext(*job.llvm_context));
+    job.module.reset(new Module(job.options.name, *job.llair_context));
+
+    llvm::Error error = llvm::Error::success();
+
+    std::for_each(
+        job.sources.begin(), job.sources.end(),
+        [&job, &error](auto& source) -> void {
+            auto module = loadSource(job, source);
+
+            if (!module) {
+                error = llvm::joinErrors(std::move(error), module.takeError());
+                return;
+            }
+
+            linkModules(job.module.get(), module->get());
+        });
+
+    return error;
+}
+
+llvm::Error
+finalizeSources(Job& job) {
+    auto interfaces = job.module->getAllInterfacesFromABI();
+
+    auto class_kinds = job.options.class_kinds;
+
+    if (!class_kinds) {
+        auto kinds = std::make_shared<llvm::StringMap<uint32_t>>();
+
+        class_kinds = [kinds](const Class *klass) -> uint32_t {
+            auto it = kinds->find(klass->getName());
+            if (it == kinds->end()) {
+                it = kinds->insert({ klass->getName(), kinds->size() }).first;
+            }
+
+            return it->second;
+        };
+    }
+
+    return finalizeInterfaces(job.module.get(), interfaces, class_kinds);
+}
+
+} // namespace
+
+Pipeline::Pipeline(unsigned concurrency)
+#if LLVM_VERSION_MAJOR >= 11
+    : d_pool(llvm::hardware_concurrency(concurrency)) {
+#else
+    : d_pool(concurrency ? concurrency : std::max(std::thread::hardware_concurrency(), 1u)) {
+#endif
+}
+
+Pipeline::~Pipeline() {
+    d_pool.wait();
+}
+
+void
+Pipeline::submit(llvm::ArrayRef<CompileInput> sources, const PipelineOptions& options,
+                 Callback callback) {
+    auto job = std::make_shared<Job>();
+
+    std::transform(
+        sources.begin(), sources.end(),
+        std::back_inserter(job->sources),
+        [](const auto& input) -> Job::Source {
+            Job::Source source;
+            source.buffer = llvm::MemoryBuffer::getMemBufferCopy(
+                input.buffer.getBuffer(), input.buffer.getBufferIdentifier());
+            std::transform(
+                input.options.begin(), input.options.end(),
+                std::back_inserter(source.options),
+                [](auto option) -> auto { return option.str(); });
+            return source;
+        });
+
+    job->options   = options;
+    job->callback  = std::move(callback);
+    job->path      = getPathToTools();
+    job->cache     = getCompileCache();
+    job->submitted = std::chrono::steady_clock::now();
+    job->timings.compile.resize(job->sources.size());
+
+    // Each stage after compilation is skipped once the result has been delivered:
+    auto stage = [job](auto function) -> std::shared_ptr<Task> {
+        return std::make_shared<Task>([job, function]() -> void {
+            if (!job->delivered) {
+                function(*job);
+            }
+        });
+    };
+
+    std::vector<std::shared_ptr<Task>> compile_tasks;
+
+    for (std::size_t index = 0, n = job->sources.size(); index < n; ++index) {
+        compile_tasks.push_back(std::make_shared<Task>([job, index]() -> void {
+            job->timings.compile[index] = measure([&job, index]() -> void {
+                compileSource(*job, index);
+            });
+        }));
+    }
+
+    auto link_task = stage([](Job& job) -> void {
+        llvm::Optional<llvm::Error> error;
+
+        job.timings.link = measure([&job, &error]() -> void { error.emplace(linkSources(job)); });
+
+        if (*error) {
+            deliver(job, std::move(*error));
+        }
+    });
+
+    auto finalize_interfaces_task = stage([](Job& job) -> void {
+        llvm::Optional<llvm::Error> error;
+
+        job.timings.finalize_interfaces = measure([&job, &error]() -> void {
+            error.emplace(finalizeSources(job));
+        });
+
+        if (*error) {
+            deliver(job, std::move(*error));
+        }
+    });
+
+    auto finalize_library_task = stage([](Job& job) -> void {
+        llvm::Optional<llvm::Expected<std::unique_ptr<llvm::Module>>> library_module;
+
+        job.timings.finalize_library = measure([&job, &library_module]() -> void {
+            library_module.emplace(finalizeLibrary(*job.module, job.options.finalize));
+        });
+
+        if (!*library_module) {
+            deliver(job, library_module->takeError());
+            return;
+        }
+
+        job.library_module = std::move(**library_module);
+    });
+
+    auto make_library_task = stage([](Job& job) -> void {
+        llvm::Optional<llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>> library;
+
+        job.timings.make_library = measure([&job, &library]() -> void {
+            library.emplace(job.options.use_lld ? makeLibraryWithLLD(*job.library_module)
+                                                : makeLibrary(*job.library_module));
+        });
+
+        deliver(job, std::move(*library));
+    });
+
+    std::for_each(
+        compile_tasks.begin(), compile_tasks.end(),
+        [&link_task](const auto& compile_task) -> void {
+            Task::addDependency(link_task, *compile_task);
+        });
+
+    Task::addDependency(finalize_interfaces_task, *link_task);
+    Task::addDependency(finalize_library_task, *finalize_interfaces_task);
+    Task::addDependency(make_library_task, *finalize_library_task);
+
+    std::for_each(
+        compile_tasks.begin(), compile_tasks.end(),
+        [this](const auto& compile_task) -> void { Task::start(compile_task, d_pool); });
+
+    Task::start(link_task, d_pool);
+    Task::start(finalize_interfaces_task, d_pool);
+    Task::start(finalize_library_task, d_pool);
+    Task::start(make_library_task, d_pool);
+}
+
+std::future<PipelineResult>
+Pipeline::submit(llvm::ArrayRef<CompileInput> sources, const PipelineOptions& options) {
+    // std::function must be copyable:
+    auto promise = std::make_shared<std::promise<PipelineResult>>();
+    auto result  = promise->get_future();
+
+    submit(sources, options,
+           [promise](PipelineResult library) -> void { promise->set_value(std::move(library)); });
+
+    return result;
+}
+
+void
+Pipeline::wait() {
+    d_pool.wait();
+}
+
+} // End namespace llair
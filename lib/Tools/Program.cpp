@@ -1,42 +1,180 @@
 #include <llair/Tools/Program.h>
 
-#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/Support/ErrorHandling.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include "popen2.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
 #include <vector>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 namespace llair {
 
+namespace {
+
+std::error_code
+lastError() {
+    return std::error_code(errno, std::generic_category());
+}
+
+// A MemoryBuffer that takes ownership of a block allocated with malloc():
+class MallocMemoryBuffer : public llvm::MemoryBuffer {
+public:
+
+    // data[size] must be '\0':
+    MallocMemoryBuffer(char *data, std::size_t size, const llvm::Twine& name)
+        : d_data(data)
+        , d_name(name.str()) {
+        init(data, data + size, true);
+    }
+
+    ~MallocMemoryBuffer() override {
+        std::free(d_data);
+    }
+
+    llvm::StringRef getBufferIdentifier() const override { return d_name; }
+
+    BufferKind getBufferKind() const override { return MemoryBuffer_Malloc; }
+
+private:
+
+    char *      d_data;
+    std::string d_name;
+};
+
+// Collects a stream's contents in a block that grows geometrically, and then becomes a
+// MemoryBuffer without being copied:
+class StreamBuffer {
+public:
+
+    StreamBuffer() = default;
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    ~StreamBuffer() {
+        std::free(d_data);
+    }
+
+    std::size_t size() const { return d_size; }
+
+    llvm::StringRef str() const { return llvm::StringRef(d_data, d_size); }
+
+    // Ensures that there's room for at least `n` more bytes; room is always left for a
+    // terminating '\0':
+    void reserve(std::size_t n) {
+        if (d_capacity - d_size < n + 1) {
+            auto capacity = std::max(d_capacity * 2, d_size + n + 1);
+            auto data     = static_cast<char *>(std::realloc(d_data, capacity));
+
+            if (!data) {
+                llvm::report_bad_alloc_error("StreamBuffer::reserve failed");
+            }
+
+            d_data     = data;
+            d_capacity = capacity;
+        }
+    }
+
+    llvm::MutableArrayRef<char> room() {
+        return d_capacity == 0
+                   ? llvm::MutableArrayRef<char>()
+                   : llvm::MutableArrayRef<char>(d_data + d_size, d_capacity - d_size - 1);
+    }
+
+    void commit(std::size_t n) { d_size += n; }
+
+    std::unique_ptr<llvm::MemoryBuffer> take(const llvm::Twine& name) {
+        reserve(0);
+        d_data[d_size] = 0;
+
+        std::unique_ptr<llvm::MemoryBuffer> buffer(new MallocMemoryBuffer(d_data, d_size, name));
+
+        d_data     = nullptr;
+        d_size     = 0;
+        d_capacity = 0;
+
+        return buffer;
+    }
+
+private:
+
+    char *      d_data     = nullptr;
+    std::size_t d_size     = 0;
+    std::size_t d_capacity = 0;
+};
+
+const std::size_t ChunkSize = 4096 * 4;
+
+// Appends what `fd` returns from a single read() to `buffer`, which grows only once it's full;
+// returns false at the end of the stream:
+llvm::ErrorOr<bool>
+readChunk(int fd, StreamBuffer& buffer) {
+    if (buffer.room().empty()) {
+        buffer.reserve(ChunkSize);
+    }
+    auto room = buffer.room();
+
+    ssize_t nread;
+    do {
+        nread = read(fd, room.data(), room.size());
+    } while (nread == -1 && errno == EINTR);
+
+    if (nread == -1) {
+        return errno == EAGAIN ? llvm::ErrorOr<bool>(true) : llvm::ErrorOr<bool>(lastError());
+    }
+
+    buffer.commit(nread);
+
+    return nread > 0;
+}
+
+} // namespace
+
 llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
 getMemoryBufferForStream(int FD, const llvm::Twine &BufferName) {
-    const ssize_t                ChunkSize = 4096 * 4;
-    llvm::SmallString<ChunkSize> Buffer;
-    ssize_t                      size = 0, nread;
+    StreamBuffer buffer;
 
-    do {
-        Buffer.resize_for_overwrite(size + ChunkSize);
-        nread = read(FD, Buffer.begin() + size, ChunkSize);
+    // A short read doesn't mean the end of a pipe's contents, only a read of nothing does. The
+    // size of a regular file is known, so it can be read with a single allocation; the extra
+    // byte is room for the read that finds the end, so that it doesn't grow the block:
+    struct stat status;
+    if (fstat(FD, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+        buffer.reserve(status.st_size + 1);
+    }
 
-        if (nread == -1) {
-            return std::error_code(errno, std::generic_category());
-        }
+    while (true) {
+        auto more = readChunk(FD, buffer);
 
-        size += nread;
-    } while (nread == ChunkSize);
+        if (!more) {
+            return more.getError();
+        }
 
-    Buffer.truncate(size);
+        if (!*more) {
+            break;
+        }
+    }
 
-    return llvm::MemoryBuffer::getMemBufferCopy(Buffer, BufferName);
+    return buffer.take(BufferName);
 }
 
-llvm::ErrorOr<llair::Program>
-openProgram(const std::string& path, llvm::ArrayRef<std::string> args) {
+namespace {
+
+llvm::ErrorOr<struct popen2>
+spawnProgram(const std::string& path, llvm::ArrayRef<std::string> args, llvm::StringRef directory,
+             bool capture_error) {
     std::vector<char *> argv;
     argv.reserve(args.size());
     std::transform(
@@ -44,35 +182,282 @@ openProgram(const std::string& path, llvm::ArrayRef<std::string> args) {
         [](const std::string& arg) -> char * { return const_cast<char *const>(arg.c_str()); });
     argv.push_back(nullptr);
 
+    auto directory_str = directory.str();
+
     struct popen2 child;
-    int           e = popen2(path.c_str(), argv.data(), &child);
+    int           e = popen2(path.c_str(), argv.data(),
+                             directory.empty() ? nullptr : directory_str.c_str(), capture_error,
+                             &child);
 
     if (e < 0) {
-        return std::error_code(errno, std::generic_category());
+        return lastError();
+    }
+
+    return child;
+}
+
+// Reaps the program, and fails unless it exited with status 0; its standard error, if it was
+// captured, is included in the error:
+llvm::Error
+waitForProgram(pid_t pid, const std::string& path, llvm::StringRef diagnostics) {
+    int status = 0;
+
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            return llvm::errorCodeToError(lastError());
+        }
+    }
+
+    diagnostics = diagnostics.rtrim();
+
+    auto separator = diagnostics.empty() ? "" : ":\n";
+
+    if (WIFSIGNALED(status)) {
+        return llvm::createStringError(std::errc::interrupted, "'%s' was terminated by signal %d%s%s",
+                                       path.c_str(), WTERMSIG(status), separator,
+                                       diagnostics.str().c_str());
+    }
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        return llvm::createStringError(std::errc::io_error, "'%s' exited with status %d%s%s",
+                                       path.c_str(), WEXITSTATUS(status), separator,
+                                       diagnostics.str().c_str());
+    }
+
+    return llvm::Error::success();
+}
+
+// Writing to a program that has exited raises SIGPIPE, which would terminate the caller. While
+// this is in scope, such writes fail with EPIPE instead:
+class SigPipeBlocker {
+public:
+
+    SigPipeBlocker() {
+        sigset_t sigpipe = getSigPipeSet();
+        pthread_sigmask(SIG_BLOCK, &sigpipe, &d_old_mask);
+
+        sigset_t pending;
+        sigpending(&pending);
+        d_was_pending = sigismember(&pending, SIGPIPE);
+    }
+
+    ~SigPipeBlocker() {
+        sigset_t pending;
+        sigpending(&pending);
+
+        // Discard the signal raised by a failed write, so that it isn't delivered on unblocking:
+        if (!d_was_pending && sigismember(&pending, SIGPIPE)) {
+            sigset_t sigpipe = getSigPipeSet();
+            int      sig;
+            sigwait(&sigpipe, &sig);
+        }
+
+        pthread_sigmask(SIG_SETMASK, &d_old_mask, nullptr);
+    }
+
+private:
+
+    static sigset_t getSigPipeSet() {
+        sigset_t sigpipe;
+        sigemptyset(&sigpipe);
+        sigaddset(&sigpipe, SIGPIPE);
+        return sigpipe;
+    }
+
+    sigset_t d_old_mask;
+    bool     d_was_pending = false;
+};
+
+} // namespace
+
+llvm::ErrorOr<llair::Program>
+openProgram(const std::string& path, llvm::ArrayRef<std::string> args,
+            llvm::StringRef directory, bool capture_error) {
+    auto child = spawnProgram(path, args, directory, capture_error);
+
+    if (!child) {
+        return child.getError();
     }
 
     return Program(
-        {child.child_pid,
-         std::unique_ptr<llvm::raw_fd_ostream>(new llvm::raw_fd_ostream(child.to_child, true)),
-         child.from_child});
+        {child->child_pid,
+         std::unique_ptr<llvm::raw_fd_ostream>(new llvm::raw_fd_ostream(child->to_child, true)),
+         child->from_child,
+         child->err_from_child,
+         path});
 }
 
-llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+llvm::Error
+closeProgram(Program& program) {
+    if (program.input) {
+        program.input->close();
+        program.input.reset();
+    }
+
+    if (program.output >= 0) {
+        close(program.output);
+        program.output = -1;
+    }
+
+    StreamBuffer diagnostics;
+
+    if (program.error >= 0) {
+        while (true) {
+            auto more = readChunk(program.error, diagnostics);
+
+            if (!more || !*more) {
+                break;
+            }
+        }
+
+        close(program.error);
+        program.error = -1;
+    }
+
+    return waitForProgram(program.pid, program.path, diagnostics.str());
+}
+
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
 runProgram(const std::string& path, llvm::ArrayRef<std::string> args,
-           llvm::MemoryBufferRef input) {
-    auto program = openProgram(path, args);
+           llvm::MemoryBufferRef input, const ProgramOptions& options) {
+    // Standard error is always captured, to report it if the program fails:
+    auto child = spawnProgram(path, args, options.directory, true);
+
+    if (!child) {
+        return llvm::createStringError(child.getError(), "unable to run '%s': %s", path.c_str(),
+                                       child.getError().message().c_str());
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + options.timeout;
+
+    // Writing mustn't block, so that the output is drained while the input is written:
+    fcntl(child->to_child, F_SETFL, fcntl(child->to_child, F_GETFL) | O_NONBLOCK);
+
+    SigPipeBlocker sigpipe_blocker;
+
+    enum { kInput, kOutput, kError, kStreamCount };
+
+    // poll() ignores negative descriptors, so streams are closed by setting them to -1:
+    struct pollfd streams[kStreamCount] = {
+        { child->to_child,       POLLOUT, 0 },
+        { child->from_child,     POLLIN,  0 },
+        { child->err_from_child, POLLIN,  0 } };
+
+    auto closeStream = [&streams](int stream) -> void {
+        close(streams[stream].fd);
+        streams[stream].fd = -1;
+    };
+
+    auto remaining = input.getBuffer();
 
-    if (program) {
-        // Write input:
-        program->input->write(input.getBufferStart(), input.getBufferSize());
-        program->input->close();
+    if (remaining.empty()) {
+        closeStream(kInput);
+    }
+
+    StreamBuffer    output, diagnostics;
+    std::error_code error;
+
+    auto readStream = [&](int stream, StreamBuffer& buffer) -> void {
+        auto more = readChunk(streams[stream].fd, buffer);
+
+        if (!more) {
+            error = more.getError();
+        }
+        else if (!*more) {
+            closeStream(stream);
+        }
+    };
+
+    while (!error && std::any_of(std::begin(streams), std::end(streams),
+                                 [](const auto& stream) -> bool { return stream.fd >= 0; })) {
+        int timeout = -1;
+
+        if (options.timeout.count() > 0) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+
+            if (left <= 0) {
+                error = std::make_error_code(std::errc::timed_out);
+                break;
+            }
+
+            timeout = (int)std::min<decltype(left)>(left, std::numeric_limits<int>::max());
+        }
+
+        if (poll(streams, kStreamCount, timeout) == -1) {
+            if (errno != EINTR) {
+                error = lastError();
+            }
+            continue;
+        }
+
+        if (streams[kInput].fd >= 0 && streams[kInput].revents) {
+            auto nwritten = write(streams[kInput].fd, remaining.data(),
+                                  std::min<std::size_t>(remaining.size(), 4096 * 16));
+
+            if (nwritten >= 0) {
+                remaining = remaining.drop_front(nwritten);
+
+                if (remaining.empty()) {
+                    closeStream(kInput);
+                }
+            }
+            else if (errno == EPIPE) {
+                // The program won't read any more of its input:
+                closeStream(kInput);
+            }
+            else if (errno != EINTR && errno != EAGAIN) {
+                error = lastError();
+            }
+        }
+
+        if (!error && streams[kOutput].fd >= 0 && streams[kOutput].revents) {
+            readStream(kOutput, output);
+        }
+
+        if (!error && streams[kError].fd >= 0 && streams[kError].revents) {
+            readStream(kError, diagnostics);
+        }
+    }
+
+    for (int stream = 0; stream < kStreamCount; ++stream) {
+        if (streams[stream].fd >= 0) {
+            closeStream(stream);
+        }
+    }
+
+    // The program may be a driver (e.g., xcrun) whose own children would otherwise keep running,
+    // and keep the pipes open; the group is still there while the program is unreaped:
+    if (error) {
+        kill(-child->child_pid, SIGKILL);
+    }
 
-        // Read output:
-        return getMemoryBufferForStream(program->output, "");
+    auto status = waitForProgram(child->child_pid, path, diagnostics.str());
+
+    if (options.diagnostics) {
+        *options.diagnostics = diagnostics.str().str();
     }
-    else {
-        return program.getError();
+
+    if (error == std::errc::timed_out) {
+        llvm::consumeError(std::move(status));
+        return llvm::createStringError(error, "'%s' timed out", path.c_str());
     }
+
+    if (error) {
+        llvm::consumeError(std::move(status));
+        return llvm::errorCodeToError(error);
+    }
+
+    if (status) {
+        return std::move(status);
+    }
+
+    // Warnings from a program that succeeded go where they would have if they weren't captured:
+    if (!options.diagnostics) {
+        llvm::errs() << diagnostics.str();
+    }
+
+    return output.take("");
 }
 
 } // End namespace llair
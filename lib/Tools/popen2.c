@@ -1,31 +1,169 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* pipe2() */
+#endif
+
 #include "popen2.h"
 
+#include <fcntl.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/errno.h>
 #include <unistd.h>
 
-int popen2(char const *path, char * const argv[], struct popen2 *childinfo) {
-  pid_t p;
-  int pipe_stdin[2], pipe_stdout[2];
+#if defined(__APPLE__)
+#include <crt_externs.h>
+#define environ (*_NSGetEnviron())
+#else
+extern char **environ;
+#endif
+
+/* posix_spawn() can change the child's working directory: */
+#if defined(__APPLE__) || (defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29)))
+#define HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP 1
+#endif
+
+/* pipe2() makes the pipes atomically: */
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define HAVE_PIPE2 1
+#endif
+
+/* The pipes are close-on-exec, so that a child spawned concurrently by another thread doesn't
+   inherit them (and keep them open after this child exits). Without pipe2(), another thread could
+   spawn between pipe() and fcntl(); on Apple platforms, every child is spawned with
+   POSIX_SPAWN_CLOEXEC_DEFAULT, so that it doesn't matter: */
+static int cloexec_pipe(int fds[2]) {
+#if defined(HAVE_PIPE2)
+  return pipe2(fds, O_CLOEXEC);
+#else
+  if(pipe(fds)) return -1;
+  if(fcntl(fds[0], F_SETFD, FD_CLOEXEC) || fcntl(fds[1], F_SETFD, FD_CLOEXEC)) {
+    int e = errno;
+    close(fds[0]); close(fds[1]);
+    errno = e;
+    return -1;
+  }
+  return 0;
+#endif
+}
+
+static void close_pipe(int fds[2]) {
+  if(fds[0] >= 0) close(fds[0]);
+  if(fds[1] >= 0) close(fds[1]);
+}
+
+/* Makes `fd` the child's `target`; dup2() clears close-on-exec, but if they are already the same,
+   it has to be inherited explicitly (or cleared in the parent): */
+static int add_redirection(posix_spawn_file_actions_t *actions, int fd, int target) {
+  if(fd != target) return posix_spawn_file_actions_adddup2(actions, fd, target);
+#if defined(__APPLE__)
+  return posix_spawn_file_actions_addinherit_np(actions, fd);
+#else
+  return fcntl(fd, F_SETFD, 0) ? errno : 0;
+#endif
+}
+
+static pid_t spawn(char const *path, char * const argv[], char const *directory,
+                   int pipe_stdin[2], int pipe_stdout[2], int pipe_stderr[2]) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attributes;
+  short flags = POSIX_SPAWN_SETPGROUP;
+  pid_t p = -1;
+  int e = posix_spawn_file_actions_init(&actions);
+  if(e) { errno = e; return -1; }
+  e = posix_spawnattr_init(&attributes);
+  if(e) { posix_spawn_file_actions_destroy(&actions); errno = e; return -1; }
+
+  /* The child leads a process group of its own, so that it can be killed along with whatever it
+     spawns; on Apple platforms, it inherits only the descriptors that are redirected: */
+#if defined(__APPLE__)
+  flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
+#endif
+  e = posix_spawnattr_setflags(&attributes, flags);
+  if(!e) e = posix_spawnattr_setpgroup(&attributes, 0);
 
-  if(pipe(pipe_stdin)) return -1;
-  if(pipe(pipe_stdout)) return -1;
+  if(!e) e = add_redirection(&actions, pipe_stdin[0], 0);
+  if(!e) e = add_redirection(&actions, pipe_stdout[1], 1);
+  if(!e && pipe_stderr[1] >= 0) e = add_redirection(&actions, pipe_stderr[1], 2);
+#if defined(__APPLE__)
+  /* Otherwise, the child shares the parent's stderr, which it must be told to inherit: */
+  if(!e && pipe_stderr[1] < 0) e = add_redirection(&actions, 2, 2);
+#endif
+#if defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP)
+  if(!e && directory) e = posix_spawn_file_actions_addchdir_np(&actions, directory);
+#endif
+  if(!e) e = posix_spawn(&p, path, &actions, &attributes, argv, environ);
 
-  p = fork();
+  posix_spawnattr_destroy(&attributes);
+  posix_spawn_file_actions_destroy(&actions);
+
+  if(e) { errno = e; return -1; }
+  return p;
+}
+
+#if !defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP)
+static pid_t spawn_in_directory(char const *path, char * const argv[], char const *directory,
+                                int pipe_stdin[2], int pipe_stdout[2], int pipe_stderr[2]) {
+  pid_t p = fork();
   if(p < 0) return p; /* Fork failed */
-  if(p == 0) { /* child */
-    close(pipe_stdin[1]);
-    dup2(pipe_stdin[0], 0);
-    close(pipe_stdout[0]);
-    dup2(pipe_stdout[1], 1);
+  if(p == 0) { /* child; the original descriptors are closed on exec */
+    setpgid(0, 0);
+    if(pipe_stdin[0] != 0) dup2(pipe_stdin[0], 0); else fcntl(0, F_SETFD, 0);
+    if(pipe_stdout[1] != 1) dup2(pipe_stdout[1], 1); else fcntl(1, F_SETFD, 0);
+    if(pipe_stderr[1] >= 0) {
+      if(pipe_stderr[1] != 2) dup2(pipe_stderr[1], 2); else fcntl(2, F_SETFD, 0);
+    }
+    if(chdir(directory)) {
+      fprintf(stderr,"chdir to '%s' failed with error: %s\n",
+	      directory, strerror(errno)); _exit(99);
+    }
     execv(path, argv);
     fprintf(stderr,"execl of '%s' failed with error: %s\n",
-	    path, strerror(errno)); exit(99);
+	    path, strerror(errno)); _exit(99);
+  }
+  /* Either of them may run first; the group must exist before the parent signals it: */
+  setpgid(p, p);
+  return p;
+}
+#endif
+
+int popen2(char const *path, char * const argv[], char const *directory, int capture_stderr,
+           struct popen2 *childinfo) {
+  pid_t p;
+  int pipe_stdin[2] = { -1, -1 }, pipe_stdout[2] = { -1, -1 }, pipe_stderr[2] = { -1, -1 };
+  int e;
+
+  if(cloexec_pipe(pipe_stdin) ||
+     cloexec_pipe(pipe_stdout) ||
+     (capture_stderr && cloexec_pipe(pipe_stderr))) {
+    e = errno;
+    close_pipe(pipe_stdin); close_pipe(pipe_stdout); close_pipe(pipe_stderr);
+    errno = e;
+    return -1;
+  }
+
+#if !defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP)
+  if(directory)
+    p = spawn_in_directory(path, argv, directory, pipe_stdin, pipe_stdout, pipe_stderr);
+  else
+#endif
+  p = spawn(path, argv, directory, pipe_stdin, pipe_stdout, pipe_stderr);
+
+  if(p < 0) {
+    e = errno;
+    close_pipe(pipe_stdin); close_pipe(pipe_stdout); close_pipe(pipe_stderr);
+    errno = e;
+    return -1;
   }
+
+  /* The parent only keeps its own ends, so that it sees EOF once the child exits: */
+  close(pipe_stdin[0]);
+  close(pipe_stdout[1]);
+  if(capture_stderr) close(pipe_stderr[1]);
   childinfo->child_pid = p;
   childinfo->to_child = pipe_stdin[1];
   childinfo->from_child = pipe_stdout[0];
-  return 0; 
+  childinfo->err_from_child = pipe_stderr[0];
+  return 0;
 }
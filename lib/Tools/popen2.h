@@ -10,9 +10,15 @@ extern "C" {
 struct popen2 {
     pid_t child_pid;
     int   from_child, to_child;
+    /* The child's stderr, or -1 if it is inherited: */
+    int   err_from_child;
 };
 
-int popen2(char const *, char *const[], struct popen2 *);
+/* Spawns the child with posix_spawn(), in the given working directory unless it is NULL; its
+   stderr is captured if capture_stderr is non-zero. On failure, returns -1 and sets errno, and
+   nothing is left open. The child leads a new process group, whose ID is its pid, so that
+   kill(-child_pid, ...) reaches whatever it spawns. The caller must reap the child: */
+int popen2(char const *, char *const[], char const *, int capture_stderr, struct popen2 *);
 
 #if defined(__cplusplus)
 }
@@ -0,0 +1,259 @@
+#include <llair/Bitcode/Bitcode.h>
+#include <llair/IR/Class.h>
+#include <llair/IR/Interface.h>
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Loads classes from bitcode whose ABI index has been tampered with, to tell whether the index was
+// trusted or the function names were demangled: an index that matches the module's functions is
+// trusted even where it's wrong, and one that doesn't match them, or is malformed, is ignored:
+namespace {
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+const char *const kCircleMethod = "_ZN6Circle4drawEv", *const kSquareMethod = "_ZN6Square4drawEv";
+
+// Two classes, and an interface that both implement:
+const char *const kSource = R"(
+%struct.Circle = type { float }
+%struct.Square = type { float }
+%struct.Shape = type { i32 }
+
+define void @_ZN6Circle4drawEv(%struct.Circle addrspace(1)* %self) {
+entry:
+  ret void
+}
+
+define void @_ZN6Square4drawEv(%struct.Square addrspace(1)* %self) {
+entry:
+  ret void
+}
+
+declare void @_ZN5Shape4drawEv(%struct.Shape addrspace(1)*)
+
+define void @draw(%struct.Shape addrspace(1)* %shape) {
+entry:
+  call void @_ZN5Shape4drawEv(%struct.Shape addrspace(1)* %shape)
+  ret void
+}
+)";
+
+using Tamper = std::function<void(llvm::Module&)>;
+
+// Indexes the module's functions, lets `tamper` change the module or its index, and writes it
+// without updating the index again, as writeBitcode() would:
+llvm::SmallString<0>
+writeTampered(const Tamper& tamper) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+    llvm::SMDiagnostic  diagnostic;
+    llvm::SmallString<0> bytes;
+
+    auto llmodule = llvm::parseAssemblyString(kSource, diagnostic, llcontext);
+
+    if (!llmodule) {
+        diagnostic.print("llair-test-abi-index", llvm::errs());
+        ++s_failures;
+        return bytes;
+    }
+
+    // The classes aren't loaded, so that the bitcode doesn't list them in its metadata:
+    auto module = std::make_unique<llair::Module>(std::move(llmodule));
+    module->updateABIIndex();
+
+    tamper(*module->getLLModule());
+
+    llvm::raw_svector_ostream os(bytes);
+    llvm::WriteBitcodeToFile(*module->getLLModule(), os);
+
+    return bytes;
+}
+
+llvm::MDTuple *
+getIndex(llvm::Module& module) {
+    auto named_md = module.getNamedMetadata("llair.abi_index");
+    return named_md ? llvm::cast<llvm::MDTuple>(named_md->getOperand(0)) : nullptr;
+}
+
+// Replaces the index's operands with those that `change` makes of them:
+void
+changeIndex(llvm::Module& module,
+            const std::function<void(std::vector<llvm::Metadata *>&)>& change) {
+    auto index = getIndex(module);
+
+    if (!index) {
+        check(false, "has an index");
+        return;
+    }
+
+    std::vector<llvm::Metadata *> operands(index->op_begin(), index->op_end());
+    change(operands);
+
+    module.getNamedMetadata("llair.abi_index")->setOperand(
+        0, llvm::MDTuple::get(module.getContext(), operands));
+}
+
+// Each function's entry is its operand and three offsets, after the hash:
+std::vector<llvm::Metadata *>::iterator
+findEntry(std::vector<llvm::Metadata *>& operands, llvm::StringRef name) {
+    for (auto it = operands.begin() + 1; it < operands.end(); it += 4) {
+        auto function = llvm::mdconst::dyn_extract_or_null<llvm::Function>(*it);
+
+        if (function && function->getName() == name) {
+            return it;
+        }
+    }
+
+    return operands.end();
+}
+
+// Forgets that Square's method is a method, which only a trusted index can make the loader do:
+void
+forgetSquare(llvm::Module& module) {
+    changeIndex(module, [](auto& operands) -> void {
+        auto it = findEntry(operands, kSquareMethod);
+
+        check(it != operands.end(), "indexes the method");
+
+        if (it != operands.end()) {
+            operands.erase(it, it + 4);
+        }
+    });
+}
+
+struct Loaded {
+    std::vector<std::string> classes;
+    std::vector<std::string> interfaces;
+};
+
+Loaded
+load(llvm::StringRef bytes, const std::string& what) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+    Loaded              loaded;
+
+    auto module = llair::getBitcodeModule(llvm::MemoryBufferRef(bytes, "tampered"), context);
+
+    if (!module) {
+        check(false, what + ": " + llvm::toString(module.takeError()));
+        return loaded;
+    }
+
+    for (auto klass : (*module)->getOrLoadAllClassesFromABI()) {
+        loaded.classes.push_back(klass->getName().str());
+
+        check(klass->method_size() == 1 && klass->findMethod("drawEv") != nullptr,
+              what + ": finds the method of " + loaded.classes.back());
+    }
+
+    for (auto interface : (*module)->getAllInterfacesFromABI()) {
+        loaded.interfaces.push_back(interface->getType()->getName().str());
+    }
+
+    std::sort(loaded.classes.begin(), loaded.classes.end());
+
+    return loaded;
+}
+
+void
+checkDemangled(const Tamper& tamper, const std::string& what) {
+    auto loaded = load(writeTampered(tamper), what);
+
+    check(loaded.classes == std::vector<std::string>({ "Circle", "Square" }),
+          what + ": demangles the function names");
+    check(loaded.interfaces == std::vector<std::string>({ "struct.Shape" }),
+          what + ": finds the interface");
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    // An index that's as it was written is trusted, and agrees with the demangler:
+    checkDemangled([](llvm::Module&) -> void {}, "an intact index");
+
+    // An index that matches the functions is trusted, even where it's wrong:
+    auto loaded = load(writeTampered(forgetSquare), "a trusted index");
+    check(loaded.classes == std::vector<std::string>({ "Circle" }), "trusts the index");
+    check(loaded.interfaces == std::vector<std::string>({ "struct.Shape" }),
+          "trusts the index for interfaces");
+
+    // Once the functions change, the index is ignored:
+    checkDemangled(
+        [](llvm::Module& module) -> void {
+            forgetSquare(module);
+            auto type = llvm::FunctionType::get(llvm::Type::getVoidTy(module.getContext()), false);
+            llvm::Function::Create(type, llvm::GlobalValue::ExternalLinkage, "added", module);
+        },
+        "an added function");
+
+    checkDemangled(
+        [](llvm::Module& module) -> void {
+            forgetSquare(module);
+            module.getFunction("draw")->setName("drawAll");
+        },
+        "a renamed function");
+
+    // A malformed index is ignored:
+    checkDemangled(
+        [](llvm::Module& module) -> void {
+            forgetSquare(module);
+            changeIndex(module, [](auto& operands) -> void { operands.pop_back(); });
+        },
+        "a truncated entry");
+
+    checkDemangled(
+        [](llvm::Module& module) -> void {
+            forgetSquare(module);
+            changeIndex(module, [&module](auto& operands) -> void {
+                auto it = findEntry(operands, kCircleMethod);
+                if (it != operands.end()) {
+                    *(it + 2) = llvm::ConstantAsMetadata::get(
+                        llvm::ConstantInt::get(llvm::Type::getInt32Ty(module.getContext()), 1000));
+                }
+            });
+        },
+        "an offset out of range");
+
+    checkDemangled(
+        [](llvm::Module& module) -> void {
+            forgetSquare(module);
+            changeIndex(module, [&module](auto& operands) -> void {
+                operands[0] = llvm::MDString::get(module.getContext(), "hash");
+            });
+        },
+        "a hash that isn't an integer");
+
+    checkDemangled(
+        [](llvm::Module& module) -> void {
+            module.eraseNamedMetadata(module.getNamedMetadata("llair.abi_index"));
+        },
+        "no index");
+
+    return s_failures == 0 ? 0 : 1;
+}
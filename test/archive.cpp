@@ -0,0 +1,311 @@
+#include <llair/Bitcode/Archive.h>
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+#include <llair/Linker/Linker.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Writes an archive from modules, looks its symbols up, links from it selectively into a module of
+// another context, and checks that damaged archives are rejected:
+namespace {
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+std::unique_ptr<llair::Module>
+parse(const std::string& text, const std::string& name, llair::LLAIRContext& context) {
+    llvm::SMDiagnostic diagnostic;
+
+    auto llmodule = llvm::parseAssemblyString(text, diagnostic, context.getLLContext());
+
+    if (!llmodule) {
+        diagnostic.print("llair-test-archive", llvm::errs());
+        return nullptr;
+    }
+
+    llmodule->setModuleIdentifier(name);
+
+    auto module = std::make_unique<llair::Module>(std::move(llmodule));
+    module->getOrLoadAllClassesFromABI();
+
+    return module;
+}
+
+// A class with a method named `method`:
+std::string
+makeClass(const std::string& name, const std::string& method = "draw") {
+    const auto mangled = std::to_string(name.size()) + name + std::to_string(method.size()) + method;
+
+    return "%struct." + name + " = type { float }\n"
+           "define void @_ZN" + mangled + "Ev(%struct." + name + " addrspace(1)* %self) {\n"
+           "entry:\n"
+           "  ret void\n"
+           "}\n";
+}
+
+// Declares the interface that `draw` methods implement, and calls it:
+const char *const kShapeUser = R"(
+%struct.Shape = type { i32 }
+
+declare void @_ZN5Shape4drawEv(%struct.Shape addrspace(1)*)
+
+define void @draw(%struct.Shape addrspace(1)* %shape) {
+entry:
+  call void @_ZN5Shape4drawEv(%struct.Shape addrspace(1)* %shape)
+  ret void
+}
+)";
+
+// Enough functions that the binary search has to look at both halves, more than once:
+std::string
+makeHelpers(unsigned count) {
+    std::string text;
+
+    for (unsigned index = 0; index < count; ++index) {
+        text += "define i32 @helper" + std::to_string(index) + "(i32 %value) {\n"
+                "entry:\n"
+                "  ret i32 %value\n"
+                "}\n";
+    }
+
+    return text;
+}
+
+const unsigned kHelperCount = 20;
+
+// The members, in archive order:
+enum Member : unsigned { kHelpers, kCircle, kSquare, kTriangle, kDuplicate, kMemberCount };
+
+llvm::SmallString<0>
+writeArchive() {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+
+    llvm::SmallString<0> bytes;
+
+    std::vector<std::unique_ptr<llair::Module>> modules;
+    modules.push_back(parse(makeHelpers(kHelperCount), "helpers", context));
+    modules.push_back(parse(makeClass("Circle") + kShapeUser, "circle", context));
+    modules.push_back(parse(makeClass("Square"), "square", context));
+    modules.push_back(parse(makeClass("Triangle", "fill"), "triangle", context));
+    modules.push_back(parse(makeHelpers(1) + "define void @duplicate() {\n  ret void\n}\n",
+                            "duplicate", context));
+
+    if (std::any_of(modules.begin(), modules.end(), [](const auto& module) -> bool { return !module; })) {
+        ++s_failures;
+        return bytes;
+    }
+
+    std::vector<llair::Module *> members;
+    std::transform(
+        modules.begin(), modules.end(),
+        std::back_inserter(members),
+        [](const auto& module) -> llair::Module * { return module.get(); });
+
+    llvm::raw_svector_ostream os(bytes);
+
+    if (auto error = llair::Archive::write(members, os)) {
+        llvm::errs() << llvm::toString(std::move(error)) << "\n";
+        ++s_failures;
+    }
+
+    return bytes;
+}
+
+std::unique_ptr<llair::Archive>
+readArchive(llvm::StringRef bytes) {
+    auto archive = llair::Archive::create(llvm::MemoryBuffer::getMemBufferCopy(bytes, "test.llairar"));
+
+    if (!archive) {
+        llvm::errs() << llvm::toString(archive.takeError()) << "\n";
+        ++s_failures;
+        return nullptr;
+    }
+
+    return std::move(*archive);
+}
+
+void
+checkLookups(const llair::Archive& archive) {
+    using SymbolKind = llair::Archive::SymbolKind;
+
+    check(archive.member_size() == kMemberCount, "member count");
+    check(archive.getMemberName(kSquare) == "square", "member name");
+
+    for (unsigned index = 0; index < kHelperCount; ++index) {
+        auto name = "helper" + std::to_string(index);
+        check(archive.lookup(SymbolKind::Function, name) == unsigned(kHelpers), "finds " + name);
+    }
+
+    // The first member that provides a symbol wins, as in a static library:
+    check(archive.lookup(SymbolKind::Function, "helper0") == unsigned(kHelpers), "first wins");
+    check(archive.lookupAll(SymbolKind::Function, "helper0").size() == 1, "one function entry");
+    check(archive.lookup(SymbolKind::Function, "duplicate") == unsigned(kDuplicate), "last member");
+
+    check(!archive.lookup(SymbolKind::Function, "helper"), "no prefix match");
+    check(!archive.lookup(SymbolKind::Function, "zzz"), "none after the last");
+    check(!archive.lookup(SymbolKind::Function, "_ZN5Shape4drawEv"), "no declarations");
+    check(!archive.lookup(SymbolKind::Class, "helper1"), "kinds are apart");
+
+    check(archive.lookup(SymbolKind::Class, "Circle") == unsigned(kCircle), "finds a class");
+    check(archive.lookup(SymbolKind::Class, "Triangle") == unsigned(kTriangle), "finds another class");
+
+    // Every class that implements the interface is indexed, whichever member declares it:
+    auto implementers = archive.lookupAll(SymbolKind::Interface, "struct.Shape");
+    check(implementers.size() == 2 && implementers[0] == kCircle && implementers[1] == kSquare,
+          "finds the interface's implementers");
+}
+
+// Links from the archive into a module that calls @helper3 and the interface:
+std::unique_ptr<llair::Module>
+link(const llair::Archive& archive, llair::LLAIRContext& context,
+     llvm::ArrayRef<llvm::StringRef> symbols = {}) {
+    auto module = parse(std::string(kShapeUser) + R"(
+declare i32 @helper3(i32)
+
+define i32 @call(i32 %value) {
+entry:
+  %result = call i32 @helper3(i32 %value)
+  ret i32 %result
+}
+)", "linked", context);
+
+    if (!module) {
+        ++s_failures;
+        return nullptr;
+    }
+
+    if (auto error = llair::linkArchive(module.get(), archive, symbols)) {
+        llvm::errs() << llvm::toString(std::move(error)) << "\n";
+        ++s_failures;
+        return nullptr;
+    }
+
+    return module;
+}
+
+bool
+defines(const llair::Module& module, llvm::StringRef name) {
+    auto function = module.getLLModule()->getFunction(name);
+    return function && !function->isDeclaration();
+}
+
+void
+checkLinks(const llair::Archive& archive) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+
+    // The type that the archive indexes the interface by is renamed in this context:
+    llvm::SMDiagnostic diagnostic;
+    auto taken = llvm::parseAssemblyString("%struct.Shape = type { i64 }\n"
+                                           "@taken = global %struct.Shape zeroinitializer\n",
+                                           diagnostic, llcontext);
+    check(taken != nullptr, "takes the interface's name");
+
+    auto module = link(archive, context);
+
+    if (module) {
+        check(defines(*module, "helper3"), "links the member that defines a declared function");
+        check(defines(*module, "_ZN6Circle4drawEv"), "links an implementer of the interface");
+        check(defines(*module, "_ZN6Square4drawEv"), "links another implementer of the interface");
+        check(!defines(*module, "_ZN8Triangle4fillEv"), "doesn't link a class that isn't needed");
+        check(!defines(*module, "duplicate"), "doesn't link a member that isn't needed");
+    }
+
+    // Named symbols are linked even if nothing refers to them:
+    module = link(archive, context, { "Triangle", "duplicate" });
+
+    if (module) {
+        check(defines(*module, "_ZN8Triangle4fillEv"), "links a named class");
+        check(defines(*module, "duplicate"), "links a named function");
+        check(defines(*module, "helper3"), "still links what's declared");
+    }
+}
+
+// Parses a copy of the archive that `damage` has changed, and returns the error's message:
+template<typename Damage>
+std::string
+parseDamaged(llvm::StringRef bytes, Damage damage) {
+    std::string damaged = bytes.str();
+    damage(damaged);
+
+    auto archive = llair::Archive::create(llvm::MemoryBuffer::getMemBufferCopy(damaged, "damaged"));
+
+    if (archive) {
+        return {};
+    }
+
+    return llvm::toString(archive.takeError());
+}
+
+void
+checkMalformed(llvm::StringRef bytes) {
+    // The header's fields, after the 8 bytes of magic:
+    const std::size_t kVersionOffset = 8, kMemberCountOffset = 12, kSymbolCountOffset = 16;
+
+    // The first member's entry, after the header; and the first symbol's, after the members':
+    const std::size_t kMemberOffset = 24, kSymbolOffset = kMemberOffset + kMemberCount * 24;
+
+    auto set32 = [](std::size_t offset, uint32_t value) {
+        return [offset, value](std::string& bytes) -> void {
+            llvm::support::endian::write32le(&bytes[offset], value);
+        };
+    };
+
+    auto expect = [bytes](auto damage, const char *message) -> void {
+        auto error = parseDamaged(bytes, damage);
+        check(error.find(message) != std::string::npos, std::string("rejects: ") + message);
+    };
+
+    expect([](std::string& bytes) -> void { bytes[0] = 'X'; }, "bad magic");
+    expect([](std::string& bytes) -> void { bytes.resize(12); }, "bad magic");
+    expect(set32(kVersionOffset, 2), "unsupported version");
+    expect(set32(kMemberCountOffset, 0x10000000), "truncated tables");
+    expect(set32(kSymbolCountOffset, 0x10000000), "truncated tables");
+    expect([](std::string& bytes) -> void { bytes.resize(kSymbolOffset); }, "truncated tables");
+    expect(set32(kMemberOffset + 8, 0xffffffff), "member out of range");
+    expect(set32(kMemberOffset + 16, 0xffffffff), "member name out of range");
+    expect(set32(kSymbolOffset, 0xffffffff), "symbol name out of range");
+    expect(set32(kSymbolOffset + 12, kMemberCount), "symbol member out of range");
+
+    check(parseDamaged(bytes, [](std::string&) -> void {}).empty(), "accepts the original");
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    auto bytes = writeArchive();
+
+    check(llair::Archive::isArchive(llvm::MemoryBufferRef(bytes, "test.llairar")), "is an archive");
+
+    auto archive = readArchive(bytes);
+
+    if (archive) {
+        checkLookups(*archive);
+        checkLinks(*archive);
+    }
+
+    checkMalformed(bytes);
+
+    return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+#include <llair/Tools/Compile.h>
+#include <llair/Tools/Tools.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Compiles sources with a stand-in for the compiler (see stand-in-xcrun.sh), whose path is the
+// only argument, and checks that the compile cache only runs it on a miss, doesn't keep failures
+// or corrupt entries, and is pruned to its policy's bounds, least recently used entries first:
+namespace {
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+std::string
+makePath(llvm::StringRef directory, llvm::StringRef name) {
+    llvm::SmallString<256> path(directory);
+    llvm::sys::path::append(path, name);
+    return path.str().str();
+}
+
+// The stand-in's output, for every source:
+bool
+writeBitcode(const std::string& path) {
+    llvm::LLVMContext  llcontext;
+    llvm::SMDiagnostic diagnostic;
+
+    auto llmodule = llvm::parseAssemblyString("define void @compiled() {\n"
+                                              "entry:\n"
+                                              "  ret void\n"
+                                              "}\n",
+                                              diagnostic, llcontext);
+
+    if (!llmodule) {
+        diagnostic.print("llair-test-compile-cache", llvm::errs());
+        return false;
+    }
+
+    std::error_code      error;
+    llvm::raw_fd_ostream os(path, error, llvm::sys::fs::OF_None);
+
+    if (error) {
+        return false;
+    }
+
+    llvm::WriteBitcodeToFile(*llmodule, os);
+
+    return true;
+}
+
+// How many times the stand-in has compiled:
+unsigned
+countCompiles(const std::string& log) {
+    auto buffer = llvm::MemoryBuffer::getFile(log);
+
+    if (!buffer) {
+        return 0;
+    }
+
+    llvm::SmallVector<llvm::StringRef, 16> lines;
+    (*buffer)->getBuffer().split(lines, '\n', -1, false);
+
+    return std::count_if(
+        lines.begin(), lines.end(),
+        [](auto line) -> bool { return line.startswith("start "); });
+}
+
+std::vector<std::string>
+getEntries(const std::string& cache) {
+    std::vector<std::string> entries;
+    std::error_code          error;
+
+    for (llvm::sys::fs::directory_iterator it(cache, error), end; it != end && !error;
+         it.increment(error)) {
+        auto name = llvm::sys::path::filename(it->path());
+
+        if (name.startswith("llvmcache-") && name != "llvmcache.timestamp") {
+            entries.push_back(it->path());
+        }
+    }
+
+    return entries;
+}
+
+class Compiler {
+public:
+
+    Compiler(const std::string& log, llair::LLAIRContext& context)
+        : d_log(log)
+        , d_context(context) {
+    }
+
+    // Compiles `source`, and checks whether the stand-in ran:
+    void checkCompiles(llvm::StringRef source, llvm::ArrayRef<llvm::StringRef> options, bool miss,
+                       const std::string& what) {
+        auto compiles = countCompiles(d_log);
+        auto module   = llair::compileBuffer(llvm::MemoryBufferRef(source, "source.metal"), options,
+                                             d_context);
+
+        if (!module) {
+            check(false, what + ": " + llvm::toString(module.takeError()));
+            return;
+        }
+
+        auto llmodule = (*module)->getLLModule();
+
+        check(llmodule->getFunction("compiled") != nullptr, what + ": loads the bitcode");
+        check(llmodule->getSourceFileName() == "-", what + ": names the source");
+        check(countCompiles(d_log) == compiles + (miss ? 1 : 0),
+              what + (miss ? ": runs the compiler" : ": doesn't run the compiler"));
+    }
+
+    // Compiles a source that fails, and returns the error's message:
+    std::string checkFails(llvm::StringRef source, const std::string& what) {
+        auto compiles = countCompiles(d_log);
+        auto module   = llair::compileBuffer(llvm::MemoryBufferRef(source, "source.metal"), {},
+                                             d_context);
+
+        check(countCompiles(d_log) == compiles + 1, what + ": runs the compiler");
+
+        if (module) {
+            check(false, what + ": fails");
+            return {};
+        }
+
+        return llvm::toString(module.takeError());
+    }
+
+private:
+
+    std::string          d_log;
+    llair::LLAIRContext& d_context;
+};
+
+} // namespace
+
+int
+main(int argc, char **argv) {
+    if (argc != 2) {
+        llvm::errs() << "usage: " << argv[0] << " <stand-in-xcrun>\n";
+        return 1;
+    }
+
+    llvm::SmallString<256> directory;
+    if (auto error = llvm::sys::fs::createUniqueDirectory("llair-test-compile-cache", directory)) {
+        llvm::errs() << error.message() << "\n";
+        return 1;
+    }
+
+    auto bitcode = makePath(directory, "compiled.air");
+    auto log     = makePath(directory, "compiles.log");
+    auto cache   = makePath(directory, "cache");
+
+    if (!writeBitcode(bitcode)) {
+        return 1;
+    }
+
+    setenv("LLAIR_TEST_BITCODE", bitcode.c_str(), 1);
+    setenv("LLAIR_TEST_LOG", log.c_str(), 1);
+
+    llair::setPathToTools(argv[1]);
+    llair::setCompileCachePath(cache);
+
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+    Compiler            compiler(log, context);
+
+    // The source, the options and the compiler are the key:
+    compiler.checkCompiles("// a", {}, true, "the first compile");
+    compiler.checkCompiles("// a", {}, false, "the same source");
+    compiler.checkCompiles("// a", { "-DX" }, true, "other options");
+    compiler.checkCompiles("// a", { "-DX" }, false, "the same options");
+    compiler.checkCompiles("// b", {}, true, "another source");
+
+    check(getEntries(cache).size() == 3, "stores each result");
+
+    // Failures aren't cached, and their diagnostics are reported:
+    auto error = compiler.checkFails("#error a", "a failure");
+    check(error.find("error: #error a") != std::string::npos, "reports the diagnostics");
+    compiler.checkFails("#error a", "the same failure");
+
+    check(getEntries(cache).size() == 3, "doesn't store failures");
+
+    // A corrupt entry is a miss, and is replaced:
+    for (const auto& entry : getEntries(cache)) {
+        std::error_code      error;
+        llvm::raw_fd_ostream os(entry, error, llvm::sys::fs::OF_None);
+        os << "not bitcode";
+    }
+
+    compiler.checkCompiles("// a", {}, true, "a corrupt entry");
+    compiler.checkCompiles("// a", {}, false, "the replaced entry");
+
+    // Pruning removes the entries that were used least recently, once there are more than two:
+    if (auto error = llair::setCompileCachePolicy("prune_interval=0s:cache_size_files=2")) {
+        check(false, "sets the policy: " + llvm::toString(std::move(error)));
+    }
+
+    compiler.checkCompiles("// c", {}, true, "a third source");
+
+    check(getEntries(cache).size() == 2, "prunes to the policy's bounds");
+
+    compiler.checkCompiles("// a", {}, false, "a recently used entry");
+    compiler.checkCompiles("// c", {}, false, "the newest entry");
+    compiler.checkCompiles("// b", {}, true, "a pruned entry");
+
+    llvm::sys::fs::remove_directories(directory);
+
+    return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+#include <llair/Tools/Compile.h>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <string>
+
+// Compiles a source that needs no headers (nor an SDK) with the in-process backend, passing it the
+// options that would be given to the compiler run as a program. Skipped if LLAIR was built without
+// clang:
+namespace {
+
+// As CTest's SKIP_RETURN_CODE:
+const int kSkipped = 77;
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+const char *const kSource = R"(
+#if VALUE != 2
+#error VALUE isn't defined
+#endif
+
+#if defined(WARN)
+#warning a warning
+#endif
+
+kernel void
+add(device float *values [[buffer(0)]], unsigned int index [[thread_position_in_grid]]) {
+    values[index] += VALUE;
+}
+)";
+
+llvm::Expected<std::unique_ptr<llair::Module>>
+compile(llvm::ArrayRef<llvm::StringRef> options, llair::LLAIRContext& context) {
+    return llair::compileBuffer(llvm::MemoryBufferRef(kSource, "add.metal"), options, context,
+                                llair::CompileBackend::InProcess);
+}
+
+// Checks that compiling with the options succeeds, and returns the module:
+std::unique_ptr<llair::Module>
+checkCompiles(llvm::ArrayRef<llvm::StringRef> options, llair::LLAIRContext& context,
+              const char *what) {
+    auto module = compile(options, context);
+
+    if (!module) {
+        check(false, std::string(what) + ": " + llvm::toString(module.takeError()));
+        return nullptr;
+    }
+
+    return std::move(*module);
+}
+
+// Checks that compiling with the options fails, and returns the error's message:
+std::string
+checkFails(llvm::ArrayRef<llvm::StringRef> options, llair::LLAIRContext& context,
+           const char *what) {
+    auto module = compile(options, context);
+
+    if (module) {
+        check(false, what);
+        return {};
+    }
+
+    return llvm::toString(module.takeError());
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    if (!llair::isInProcessCompileAvailable()) {
+        llvm::outs() << "skipped: LLAIR was built without clang\n";
+        return kSkipped;
+    }
+
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+
+    // -g and -O2 are the driver's spellings, which the frontend wouldn't take as they are:
+    auto module = checkCompiles({ "-DVALUE=2", "-O2", "-g" }, context, "compiles");
+
+    if (module) {
+        auto llmodule = module->getLLModule();
+
+        check(llmodule->getFunction("add") != nullptr, "defines the kernel");
+        check(llmodule->getNamedMetadata("llvm.dbg.cu") != nullptr, "has debug info");
+    }
+
+    // Options that the driver doesn't know are errors, rather than being ignored:
+    checkFails({ "-DVALUE=2", "-fno-such-option" }, context, "rejects an unknown option");
+
+    // The source's own errors are reported:
+    auto error = checkFails({}, context, "reports the source's errors");
+    check(error.find("VALUE isn't defined") != std::string::npos, "reports the #error");
+
+    // The options' warning settings apply to the source:
+    checkCompiles({ "-DVALUE=2", "-DWARN" }, context, "compiles with a warning");
+    checkFails({ "-DVALUE=2", "-DWARN", "-Werror" }, context, "makes a warning an error");
+    checkCompiles({ "-DVALUE=2", "-DWARN", "-Werror", "-w" }, context, "suppresses a warning");
+
+    return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,341 @@
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+#include <llair/Tools/CompileScheduler.h>
+#include <llair/Tools/Tools.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs compile jobs with a stand-in for the compiler (see stand-in-xcrun.sh), whose path is the
+// only argument, and which sleeps before it echoes its bitcode. Checks that no more jobs run at
+// once than the scheduler has workers, that each context's jobs are loaded one at a time, that
+// jobs start in order of priority, and that cancelled jobs never run; and reports the time taken:
+namespace {
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+std::string
+makePath(llvm::StringRef directory, llvm::StringRef name) {
+    llvm::SmallString<256> path(directory);
+    llvm::sys::path::append(path, name);
+    return path.str().str();
+}
+
+// The stand-in's output, for every source:
+bool
+writeBitcode(const std::string& path) {
+    llvm::LLVMContext  llcontext;
+    llvm::SMDiagnostic diagnostic;
+
+    auto llmodule = llvm::parseAssemblyString("define void @compiled() {\n"
+                                              "entry:\n"
+                                              "  ret void\n"
+                                              "}\n",
+                                              diagnostic, llcontext);
+
+    if (!llmodule) {
+        diagnostic.print("llair-test-compile-scheduler", llvm::errs());
+        return false;
+    }
+
+    std::error_code      error;
+    llvm::raw_fd_ostream os(path, error, llvm::sys::fs::OF_None);
+
+    if (error) {
+        return false;
+    }
+
+    llvm::WriteBitcodeToFile(*llmodule, os);
+
+    return true;
+}
+
+// The stand-in's 'start <source>' and 'end <source>' lines, in the order they were written:
+std::vector<std::string>
+readLog(const std::string& log) {
+    std::vector<std::string> lines;
+
+    auto buffer = llvm::MemoryBuffer::getFile(log);
+
+    if (!buffer) {
+        return lines;
+    }
+
+    llvm::SmallVector<llvm::StringRef, 16> tmp;
+    (*buffer)->getBuffer().split(tmp, '\n', -1, false);
+
+    std::transform(
+        tmp.begin(), tmp.end(),
+        std::back_inserter(lines),
+        [](auto line) -> std::string { return line.str(); });
+
+    return lines;
+}
+
+// The most compiles that were running at once:
+unsigned
+getMostRunning(const std::vector<std::string>& lines) {
+    unsigned running = 0, most = 0;
+
+    std::for_each(
+        lines.begin(), lines.end(),
+        [&running, &most](const auto& line) -> void {
+            if (llvm::StringRef(line).startswith("start ")) {
+                most = std::max(most, ++running);
+            }
+            else if (running > 0) {
+                --running;
+            }
+        });
+
+    return most;
+}
+
+std::ptrdiff_t
+findLine(const std::vector<std::string>& lines, const std::string& line) {
+    auto it = std::find(lines.begin(), lines.end(), line);
+    return it == lines.end() ? -1 : std::distance(lines.begin(), it);
+}
+
+// Blocks until the stand-in has started compiling `source`:
+bool
+waitForStart(const std::string& log, const std::string& source) {
+    for (unsigned tries = 0; tries < 1000; ++tries) {
+        if (findLine(readLog(log), "start " + source) >= 0) {
+            return true;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return false;
+}
+
+bool
+isCancelled(llair::CompileScheduler::Result result) {
+    if (result) {
+        return false;
+    }
+
+    return llvm::errorToErrorCode(result.takeError()) == std::errc::operation_canceled;
+}
+
+void
+checkConcurrency(const std::string& log) {
+    const unsigned kConcurrency = 3, kJobCount = 12;
+
+    llvm::LLVMContext   llcontext0, llcontext1;
+    llair::LLAIRContext context0(llcontext0), context1(llcontext1);
+    llair::LLAIRContext *contexts[] = { &context0, &context1 };
+
+    // How many callbacks are running for each context, and how many have succeeded:
+    std::atomic<unsigned> loading[2] = { { 0 }, { 0 } };
+    std::atomic<unsigned> compiled   = { 0 };
+
+    std::vector<std::string> sources;
+    for (unsigned index = 0; index < kJobCount; ++index) {
+        sources.push_back("// job " + std::to_string(index));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+  { llair::CompileScheduler scheduler(kConcurrency);
+
+    check(scheduler.getConcurrency() == kConcurrency, "has as many workers as it was asked for");
+
+    for (unsigned index = 0; index < kJobCount; ++index) {
+        auto which = index % 2;
+
+        scheduler.submit(
+            llvm::MemoryBufferRef(sources[index], "job.metal"), {}, *contexts[which],
+            [&, which](llair::CompileScheduler::Result module) -> void {
+                check(++loading[which] == 1, "loads one job at a time into a context");
+
+                if (!module) {
+                    check(false, "compiles: " + llvm::toString(module.takeError()));
+                }
+                else {
+                    check(&(*module)->getContext() == contexts[which], "loads into the context");
+                    check((*module)->getLLModule()->getFunction("compiled") != nullptr,
+                          "loads the bitcode");
+                    ++compiled;
+                }
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+                --loading[which];
+            });
+    }
+
+    scheduler.wait(); }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    check(compiled == kJobCount, "compiles every job");
+
+    auto most = getMostRunning(readLog(log));
+    check(most <= kConcurrency, "runs no more compiles at once than it has workers");
+    check(most > 1, "runs compiles at once");
+
+    llvm::outs() << kJobCount << " compiles with " << kConcurrency << " workers took "
+                 << elapsed.count() << "ms, with up to " << most << " at once\n";
+}
+
+void
+checkOrder(const std::string& log) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+
+    std::string blocker = "// blocker", low = "// low", cancelled = "// cancelled",
+                high = "// high", failed = "#error failed";
+
+  { llair::CompileScheduler scheduler(1);
+
+    auto blocker_job = scheduler.submit(llvm::MemoryBufferRef(blocker, "blocker.metal"), {},
+                                        context);
+
+    // The rest are queued behind it:
+    check(waitForStart(log, blocker), "starts the first job");
+
+    auto low_job       = scheduler.submit(llvm::MemoryBufferRef(low, "low.metal"), {}, context);
+    auto cancelled_job = scheduler.submit(llvm::MemoryBufferRef(cancelled, "cancelled.metal"), {},
+                                          context);
+    auto high_job      = scheduler.submit(llvm::MemoryBufferRef(high, "high.metal"), {}, context,
+                                          1);
+    auto failed_job    = scheduler.submit(llvm::MemoryBufferRef(failed, "failed.metal"), {},
+                                          context);
+
+    check(scheduler.cancel(cancelled_job.id), "cancels a queued job");
+    check(!scheduler.cancel(cancelled_job.id), "doesn't cancel a job twice");
+    check(isCancelled(cancelled_job.result.get()), "reports the cancellation");
+
+    check(!scheduler.cancel(blocker_job.id), "doesn't cancel a running job");
+
+    check(bool(blocker_job.result.get()), "compiles the running job");
+    check(bool(low_job.result.get()), "compiles a job with a low priority");
+    check(bool(high_job.result.get()), "compiles a job with a high priority");
+
+    auto result = failed_job.result.get();
+    check(!result && llvm::toString(result.takeError()).find("error: #error failed") !=
+                         std::string::npos,
+          "reports a failure's diagnostics");
+
+    scheduler.wait();
+
+    check(!scheduler.cancel(low_job.id), "doesn't cancel a finished job"); }
+
+    auto lines = readLog(log);
+    check(findLine(lines, "start " + high) >= 0 &&
+              findLine(lines, "start " + high) < findLine(lines, "start " + low),
+          "starts higher priorities first");
+    check(findLine(lines, "start " + low) < findLine(lines, "start " + failed),
+          "starts the same priority in order");
+    check(findLine(lines, "start " + cancelled) < 0, "doesn't run a cancelled job");
+}
+
+// Destroying the scheduler cancels what's queued, and waits for what's running:
+void
+checkDestruction(const std::string& log) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+
+    std::string running = "// running", queued = "// queued";
+
+    std::atomic<unsigned> succeeded = { 0 }, cancelled = { 0 };
+
+    auto callback = [&succeeded, &cancelled](llair::CompileScheduler::Result module) -> void {
+        if (module) {
+            ++succeeded;
+        }
+        else if (isCancelled(std::move(module))) {
+            ++cancelled;
+        }
+    };
+
+  { llair::CompileScheduler scheduler(1);
+
+    scheduler.submit(llvm::MemoryBufferRef(running, "running.metal"), {}, context, callback);
+
+    check(waitForStart(log, running), "starts the job");
+
+    for (unsigned index = 0; index < 3; ++index) {
+        scheduler.submit(llvm::MemoryBufferRef(queued, "queued.metal"), {}, context, callback);
+    } }
+
+    check(succeeded == 1, "finishes the running job");
+    check(cancelled == 3, "cancels the queued jobs");
+    check(findLine(readLog(log), "start " + queued) < 0, "doesn't run the queued jobs");
+}
+
+} // namespace
+
+int
+main(int argc, char **argv) {
+    if (argc != 2) {
+        llvm::errs() << "usage: " << argv[0] << " <stand-in-xcrun>\n";
+        return 1;
+    }
+
+    llvm::SmallString<256> directory;
+    if (auto error = llvm::sys::fs::createUniqueDirectory("llair-test-compile-scheduler",
+                                                          directory)) {
+        llvm::errs() << error.message() << "\n";
+        return 1;
+    }
+
+    auto bitcode = makePath(directory, "compiled.air");
+
+    if (!writeBitcode(bitcode)) {
+        return 1;
+    }
+
+    // Every job runs the compiler:
+    unsetenv("LLAIR_COMPILE_CACHE_PATH");
+
+    setenv("LLAIR_TEST_BITCODE", bitcode.c_str(), 1);
+    setenv("LLAIR_TEST_DELAY", "0.2", 1);
+
+    llair::setPathToTools(argv[1]);
+
+    // Each check has a log of its own:
+    auto useLog = [&directory](const char *name) -> std::string {
+        auto log = makePath(directory, name);
+        setenv("LLAIR_TEST_LOG", log.c_str(), 1);
+        return log;
+    };
+
+    checkConcurrency(useLog("concurrency.log"));
+    checkOrder(useLog("order.log"));
+    checkDestruction(useLog("destruction.log"));
+
+    llvm::sys::fs::remove_directories(directory);
+
+    return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include <llair/IR/LLAIRContext.h>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Registers, looks up and unregisters contexts from many threads at once, as the Pipeline does
+// with a context per job:
+namespace {
+
+std::atomic<unsigned> s_failures = { 0 };
+
+void
+check(bool condition, const char *what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    // A context that's been unregistered isn't found, even by a thread that found it before:
+  { auto llcontext = std::make_unique<llvm::LLVMContext>();
+    auto context   = std::make_unique<llair::LLAIRContext>(*llcontext);
+
+    std::atomic<int> step = { 0 };
+
+    std::thread thread([&llcontext, &context, &step]() -> void {
+        check(llair::LLAIRContext::Get(llcontext.get()) == context.get(), "found before");
+        step = 1;
+        while (step != 2) {
+            std::this_thread::yield();
+        }
+        check(llair::LLAIRContext::Get(llcontext.get()) == nullptr, "not found after");
+    });
+
+    while (step != 1) {
+        std::this_thread::yield();
+    }
+    context.reset();
+    step = 2;
+
+    thread.join();
+
+    // ...until it's registered again:
+    context = std::make_unique<llair::LLAIRContext>(*llcontext);
+    check(llair::LLAIRContext::Get(llcontext.get()) == context.get(), "found again"); }
+
+    // Many threads, each repeatedly making a context, looking it up, and destroying it:
+    const unsigned kThreadCount = 8, kIterationCount = 200, kLookupCount = 100;
+
+    std::vector<std::thread> threads;
+
+    for (unsigned i = 0; i < kThreadCount; ++i) {
+        threads.emplace_back([]() -> void {
+            llvm::LLVMContext shared_llcontext;
+            llair::LLAIRContext shared_context(shared_llcontext);
+
+            for (unsigned j = 0; j < kIterationCount; ++j) {
+                auto llcontext = std::make_unique<llvm::LLVMContext>();
+                auto context   = std::make_unique<llair::LLAIRContext>(*llcontext);
+
+                for (unsigned k = 0; k < kLookupCount; ++k) {
+                    check(llair::LLAIRContext::Get(llcontext.get()) == context.get(), "own context");
+                    check(llair::LLAIRContext::Get(&shared_llcontext) == &shared_context,
+                          "long-lived context");
+                }
+
+                context.reset();
+                check(llair::LLAIRContext::Get(llcontext.get()) == nullptr, "destroyed context");
+            }
+        });
+    }
+
+    std::for_each(threads.begin(), threads.end(), [](auto& thread) -> void { thread.join(); });
+
+    return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <string>
+#include <vector>
+
+#include "ClassMethodName.h"
+
+// Compares the fast path that finds the class and method of a member function's name with the full
+// demangler, over names that it decides and names that it must leave to the demangler:
+namespace {
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+const char *
+describe(llair::FastParseResult result) {
+    switch (result) {
+    case llair::FastParseResult::kMethod:
+        return "method";
+    case llair::FastParseResult::kNotMethod:
+        return "not a method";
+    case llair::FastParseResult::kUnknown:
+        return "unknown";
+    }
+
+    return "";
+}
+
+struct Counts {
+    unsigned method = 0, not_method = 0, unknown = 0;
+};
+
+// The fast path's decision about `name` must be the full demangler's; where it can't decide, the
+// combined parser must give the full demangler's answer:
+llair::FastParseResult
+compare(llair::ClassMethodNameParser& parser, const std::string& name, Counts& counts) {
+    llvm::SmallVector<llvm::StringRef, 8> fast_path, full_path, path;
+    std::pair<llvm::StringRef, llvm::StringRef> fast_result;
+
+    auto decision    = llair::parseClassPathAndMethodNameFast(name, fast_path, fast_result);
+    auto full_result = parser.parseWithDemangler(name, full_path);
+    auto result      = parser.parse(name, path);
+
+    switch (decision) {
+    case llair::FastParseResult::kMethod:
+        ++counts.method;
+        check(full_result && *full_result == fast_result && full_path == fast_path,
+              "fast path agrees that it's a method: " + name);
+        break;
+    case llair::FastParseResult::kNotMethod:
+        ++counts.not_method;
+        check(!full_result, "fast path agrees that it isn't a method: " + name);
+        break;
+    case llair::FastParseResult::kUnknown:
+        ++counts.unknown;
+        break;
+    }
+
+    check(result == full_result && (!result || path == full_path), "same result: " + name);
+
+    return decision;
+}
+
+void
+checkDecision(llair::ClassMethodNameParser& parser, const std::string& name,
+              llair::FastParseResult expected, Counts& counts) {
+    auto decision = compare(parser, name, counts);
+    check(decision == expected,
+          name + " is " + describe(decision) + ", rather than " + describe(expected));
+}
+
+void
+checkMethod(llair::ClassMethodNameParser& parser, const std::string& name,
+            llvm::StringRef class_name, llvm::StringRef method_name) {
+    llvm::SmallVector<llvm::StringRef, 8> path;
+
+    auto result = parser.parse(name, path);
+    check(result && result->first == class_name && result->second == method_name,
+          "finds the class and method of " + name);
+}
+
+// Every combination of class path, qualifiers and parameters:
+std::vector<std::string>
+makeCorpus() {
+    const char *const paths[] = {
+        "5Shape", "2ns5Shape", "5outer5inner5Shape", "1a1b1c1d", "5ShapeIfE", "St6vectorIiSaIiEE",
+        "12_GLOBAL__N_15Shape"
+    };
+    const char *const qualifiers[] = {
+        "", "K", "V", "VK", "rVK", "R", "O", "KR", "KO"
+    };
+    const char *const methods[] = {
+        "4draw", "1f", "10drawShadow", "C2", "D2", "pl", "4nameB5cxx11", "4drawIiE"
+    };
+    const char *const parameters[] = {
+        "v", "i", "fff", "PKc", "RKS_", "PS_", "Dv4_f", "St6vectorIiSaIiEE", "PFviE", "U3AS1Pf"
+    };
+
+    std::vector<std::string> corpus;
+
+    for (auto path : paths) {
+        for (auto qualifier : qualifiers) {
+            for (auto method : methods) {
+                for (auto parameter : parameters) {
+                    corpus.push_back(std::string("_ZN") + qualifier + path + method + "E" + parameter);
+                }
+            }
+        }
+    }
+
+    return corpus;
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    using llair::FastParseResult;
+
+    llair::ClassMethodNameParser parser;
+    Counts                       counts;
+
+    // The fast path decides the common shape, whatever the qualifiers:
+    for (const char *name : { "_ZN5Shape4drawEv", "_ZNK5Shape4areaEv", "_ZNVK5Shape4areaEv",
+                              "_ZNR5Shape4areaEv", "_ZNO5Shape4areaEv", "_ZNKR5Shape4areaEv",
+                              "_ZN2ns5Shape4drawEfi", "__ZN5Shape4drawEv" }) {
+        checkDecision(parser, name, FastParseResult::kMethod, counts);
+    }
+
+    checkMethod(parser, "_ZN5Shape4drawEv", "Shape", "drawEv");
+    checkMethod(parser, "_ZNK2ns5Shape4areaEv", "ns5Shape", "areaEv");
+    checkMethod(parser, "_ZN5Shape4drawERKS_", "Shape", "drawERKS_");
+
+    // The names are spans of the mangled name, which constructors, class templates and anonymous
+    // namespaces don't have:
+    for (const char *name : { "_ZN5ShapeC2Ev", "_ZN5ShapeIfE4drawEv", "_ZN12_GLOBAL__N_15Shape4drawEv",
+                              "_ZN5Shape4nameB5cxx11Ev" }) {
+        llvm::SmallVector<llvm::StringRef, 8> path;
+        check(!parser.parse(name, path), std::string("isn't a method: ") + name);
+    }
+
+    // Names that can't be methods:
+    for (const char *name : { "main", "_Z4drawv", "_Z4drawRK5Shape", "_ZTV5Shape", "_ZTS5Shape",
+                              "_ZGVZ4mainE1x", "_ZN5Shape4drawE", "_ZN5Shape4drawE.cold",
+                              "_Z" }) {
+        checkDecision(parser, name, FastParseResult::kNotMethod, counts);
+    }
+
+    // Names that it leaves to the full demangler:
+    for (const char *name : {
+             // Constructors and destructors:
+             "_ZN5ShapeC1Ev", "_ZN5ShapeC2ERKS_", "_ZN5ShapeD0Ev", "_ZN5ShapeD2Ev",
+             // Templates, as the class and as the method:
+             "_ZN5ShapeIfE4drawEv", "_ZN2ns5ShapeIiLi4EE4drawEv", "_ZN5Shape4drawIiEEvT_",
+             // Substitutions in the class path:
+             "_ZNSt6vectorIiSaIiEE9push_backERKi", "_ZN2ns5Shape5InnerS0_4drawEv",
+             // Operators:
+             "_ZN5ShapeplERKS_", "_ZNK5ShapeclEv", "_ZN5ShapeaSEOS_",
+             // ABI tags:
+             "_ZN5Shape4nameB5cxx11Ev", "_ZN5ShapeB3abi4drawEv",
+             // Anonymous namespaces, local names and unscoped names:
+             "_ZN12_GLOBAL__N_15Shape4drawEv", "_ZZ4mainEN5Shape4drawEv", "_ZL4drawv",
+             // One component isn't a class:
+             "_ZN4drawEv",
+             // Vendor suffixes:
+             "_ZN5Shape4drawEv.cold", "_ZN5Shape4drawEv.llvm.123" }) {
+        checkDecision(parser, name, FastParseResult::kUnknown, counts);
+    }
+
+    // Every combination, and its truncations, which are mostly malformed:
+    auto corpus = makeCorpus();
+
+    for (const auto& name : corpus) {
+        compare(parser, name, counts);
+
+        for (std::size_t size = 2; size < name.size(); ++size) {
+            auto truncated = name.substr(0, size);
+
+            llvm::SmallVector<llvm::StringRef, 8> fast_path, full_path;
+            std::pair<llvm::StringRef, llvm::StringRef> fast_result;
+
+            // A malformed name may be accepted by the fast path, which doesn't parse parameters,
+            // but one that the full demangler accepts must never be rejected:
+            auto decision    = llair::parseClassPathAndMethodNameFast(truncated, fast_path, fast_result);
+            auto full_result = parser.parseWithDemangler(truncated, full_path);
+
+            if (decision == FastParseResult::kNotMethod) {
+                check(!full_result, "fast path agrees that it isn't a method: " + truncated);
+            }
+            else if (decision == FastParseResult::kMethod && full_result) {
+                check(*full_result == fast_result && full_path == fast_path,
+                      "fast path agrees about " + truncated);
+            }
+        }
+    }
+
+    // The corpus exercises both the fast path and the fallback:
+    check(counts.method > corpus.size() / 8, "the fast path decides many names");
+    check(counts.unknown > corpus.size() / 8, "the fast path leaves many names");
+
+    return s_failures == 0 ? 0 : 1;
+}
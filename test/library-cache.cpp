@@ -0,0 +1,190 @@
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+#include <llair/Tools/MakeLibrary.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <memory>
+#include <string>
+
+// Makes libraries of modules that are the same, or differ, in their contents and in the options
+// that they're finalized with, and checks that the library cache tells them apart, hits in memory
+// and then on disk, and returns what was made on the miss:
+namespace {
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+const char *const kSource = R"(
+define internal float @scale(float %value) {
+entry:
+  %scaled = fmul float %value, 2.0
+  ret float %scaled
+}
+
+define void @first(float addrspace(1)* %data) {
+entry:
+  %value = load float, float addrspace(1)* %data
+  %scaled = call float @scale(float %value)
+  store float %scaled, float addrspace(1)* %data
+  ret void
+}
+
+define void @second(float addrspace(1)* %data) {
+entry:
+  %value = load float, float addrspace(1)* %data
+  %scaled = call float @scale(float %value)
+  %sum = fadd float %scaled, 1.0
+  store float %sum, float addrspace(1)* %data
+  ret void
+}
+)";
+
+// Replaces every occurrence of `from`:
+std::string
+replace(std::string text, const std::string& from, const std::string& to) {
+    for (auto position = text.find(from); position != std::string::npos;
+         position = text.find(from, position + to.size())) {
+        text.replace(position, from.size(), to);
+    }
+
+    return text;
+}
+
+// The cache's counters that changed since `before`:
+llair::LibraryCacheStatistics
+since(const llair::LibraryCacheStatistics& before) {
+    auto after = llair::getLibraryCacheStatistics();
+
+    llair::LibraryCacheStatistics statistics;
+    statistics.memory_hits = after.memory_hits - before.memory_hits;
+    statistics.disk_hits   = after.disk_hits - before.disk_hits;
+    statistics.misses      = after.misses - before.misses;
+
+    return statistics;
+}
+
+enum class Lookup { kMiss, kMemoryHit, kDiskHit, kNone };
+
+// Makes a library of the source, in a context of its own, and checks how the cache found it:
+std::string
+checkLibrary(const std::string& text, const llair::FinalizeOptions& options, Lookup expected,
+             const std::string& what) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+    llvm::SMDiagnostic  diagnostic;
+
+    auto llmodule = llvm::parseAssemblyString(text, diagnostic, llcontext);
+
+    if (!llmodule) {
+        diagnostic.print("llair-test-library-cache", llvm::errs());
+        ++s_failures;
+        return {};
+    }
+
+    auto module = std::make_unique<llair::Module>(std::move(llmodule));
+
+    auto before  = llair::getLibraryCacheStatistics();
+    auto library = llair::makeLibrary(*module, options);
+    auto counted = since(before);
+
+    if (!library) {
+        check(false, what + ": " + llvm::toString(library.takeError()));
+        return {};
+    }
+
+    check(counted.misses == (expected == Lookup::kMiss ? 1 : 0), what + ": misses");
+    check(counted.memory_hits == (expected == Lookup::kMemoryHit ? 1 : 0), what + ": hits memory");
+    check(counted.disk_hits == (expected == Lookup::kDiskHit ? 1 : 0), what + ": hits the disk");
+
+    return (*library)->getBuffer().str();
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    llvm::SmallString<256> directory;
+    if (auto error = llvm::sys::fs::createUniqueDirectory("llair-test-library-cache", directory)) {
+        llvm::errs() << error.message() << "\n";
+        return 1;
+    }
+
+    llvm::SmallString<256> cache(directory);
+    llvm::sys::path::append(cache, "cache");
+
+    llair::setLibraryCachePath(cache);
+
+    llair::FinalizeOptions options;
+
+    auto library = checkLibrary(kSource, options, Lookup::kMiss, "the first library");
+    check(!library.empty(), "makes a library");
+
+    // The module's contents are the key, not the module or its context:
+    check(checkLibrary(kSource, options, Lookup::kMemoryHit, "the same module") == library,
+          "returns the library that was made");
+    check(checkLibrary(replace(kSource, "%scaled", "%doubled"), options,
+                       Lookup::kMemoryHit, "a renamed value") == library,
+          "returns the library that was made for a renamed value");
+    checkLibrary(replace(kSource, "fadd float %scaled, 1.0", "fadd float %scaled, 3.0"), options,
+                 Lookup::kMiss, "another constant");
+
+    // So are the options that change the library:
+    auto other_options = options;
+    other_options.opt_level = 1;
+    checkLibrary(kSource, other_options, Lookup::kMiss, "another level");
+    checkLibrary(kSource, other_options, Lookup::kMemoryHit, "the same level");
+
+    other_options = options;
+    other_options.loop_unrolling = false;
+    checkLibrary(kSource, other_options, Lookup::kMiss, "without unrolling");
+
+    other_options = options;
+    other_options.pipeline = "function(instcombine)";
+    checkLibrary(kSource, other_options, Lookup::kMiss, "another pipeline");
+
+    other_options = options;
+    other_options.partition = true;
+    checkLibrary(kSource, other_options, Lookup::kMiss, "partitioned");
+
+    // The number of threads doesn't change the library:
+    other_options.partition_threads = 1;
+    checkLibrary(kSource, other_options, Lookup::kMemoryHit, "partitioned on one thread");
+
+    // A library whose passes are timed is always made:
+    std::string              timings;
+    llvm::raw_string_ostream timings_os(timings);
+    other_options = options;
+    other_options.time_passes = &timings_os;
+    checkLibrary(kSource, other_options, Lookup::kNone, "timed passes");
+
+    // Without the memory cache, the library is found on disk, and then in memory again:
+    llair::setLibraryMemoryCacheSize(0);
+    check(checkLibrary(kSource, options, Lookup::kDiskHit, "without the memory cache") == library,
+          "returns the library from the disk");
+    checkLibrary(kSource, options, Lookup::kDiskHit, "without the memory cache, again");
+
+    llair::setLibraryMemoryCacheSize(64 * 1024 * 1024);
+    checkLibrary(kSource, options, Lookup::kDiskHit, "the restored memory cache");
+    check(checkLibrary(kSource, options, Lookup::kMemoryHit, "the refilled memory cache") == library,
+          "returns the library from memory");
+
+    llvm::sys::fs::remove_directories(directory);
+
+    return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+#include <llair/Tools/MakeLibrary.h>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Regex.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Finalizes a module of several entry points, which share a helper, a constant table and a
+// function that's visible outside the library, with and without partitioning it, at each level,
+// and checks that the two libraries define the same functions, list the same entry points, and
+// have the same code in them, up to the names that linking the partitions gives to each one's
+// copies:
+namespace {
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+const char *const kEntryPoints[] = { "blur", "sharpen", "tint" };
+
+const char *const kSource = R"(
+@weights = internal constant [4 x float] [float 0.25, float 0.5, float 0.75, float 1.0]
+
+define internal float @weigh(float %value, i32 %index) {
+entry:
+  %masked = and i32 %index, 3
+  %pointer = getelementptr [4 x float], [4 x float]* @weights, i32 0, i32 %masked
+  %weight = load float, float* %pointer
+  %weighed = fmul float %value, %weight
+  ret float %weighed
+}
+
+define float @clamp(float %value) {
+entry:
+  %low = fcmp olt float %value, 0.0
+  %clamped.low = select i1 %low, float 0.0, float %value
+  %high = fcmp ogt float %clamped.low, 1.0
+  %clamped = select i1 %high, float 1.0, float %clamped.low
+  ret float %clamped
+}
+
+define void @blur(float addrspace(1)* %data, i32 %count) {
+entry:
+  %empty = icmp eq i32 %count, 0
+  br i1 %empty, label %exit, label %loop
+
+loop:
+  %index = phi i32 [ 0, %entry ], [ %next, %loop ]
+  %pointer = getelementptr float, float addrspace(1)* %data, i32 %index
+  %value = load float, float addrspace(1)* %pointer
+  %weighed = call float @weigh(float %value, i32 %index)
+  %clamped = call float @clamp(float %weighed)
+  store float %clamped, float addrspace(1)* %pointer
+  %next = add i32 %index, 1
+  %done = icmp eq i32 %next, %count
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+define void @sharpen(float addrspace(1)* %data, i32 %index) {
+entry:
+  %pointer = getelementptr float, float addrspace(1)* %data, i32 %index
+  %value = load float, float addrspace(1)* %pointer
+  %weighed = call float @weigh(float %value, i32 %index)
+  %doubled = fmul float %weighed, 2.0
+  %clamped = call float @clamp(float %doubled)
+  store float %clamped, float addrspace(1)* %pointer
+  ret void
+}
+
+define void @tint(float addrspace(1)* %data) {
+entry:
+  %value = load float, float addrspace(1)* %data
+  %weighed = call float @weigh(float %value, i32 2)
+  store float %weighed, float addrspace(1)* %data
+  ret void
+}
+
+!air.kernel = !{!0, !1, !2}
+
+!0 = !{void (float addrspace(1)*, i32)* @blur, !{}, !{!3, !4}}
+!1 = !{void (float addrspace(1)*, i32)* @sharpen, !{}, !{!3, !5}}
+!2 = !{void (float addrspace(1)*)* @tint, !{}, !{!3}}
+!3 = !{i32 0, !"air.buffer", !"air.arg_name", !"data"}
+!4 = !{i32 1, !"air.arg_name", !"count"}
+!5 = !{i32 1, !"air.arg_name", !"index"}
+)";
+
+// The code of each function, printed without the comments, which list the blocks' predecessors in
+// the order of their uses, and without what tells a partition's own copy of a function apart: its
+// linkage, which is internal, and the suffix that linking the partitions gives to its name. The
+// copies of a function are listed under its name:
+std::map<std::string, std::vector<std::string>>
+getFunctions(const llvm::Module& module) {
+    std::map<std::string, std::vector<std::string>> functions;
+
+    llvm::Regex comment(" *;[^\n]*"), linkage("define internal "),
+        copy_suffix("(@[A-Za-z_.]*[A-Za-z_])\\.[0-9]+");
+
+    auto strip = [](llvm::Regex& regex, std::string text, const char *replacement) -> std::string {
+        while (regex.match(text)) {
+            text = regex.sub(replacement, text);
+        }
+
+        return text;
+    };
+
+    for (const auto& function : module) {
+        if (function.isDeclaration()) {
+            continue;
+        }
+
+        std::string              text;
+        llvm::raw_string_ostream os(text);
+        function.print(os);
+        os.flush();
+
+        text = strip(copy_suffix, strip(linkage, strip(comment, text, ""), "define "), "\\1");
+
+        auto name = strip(copy_suffix, "@" + function.getName().str(), "\\1");
+        functions[name].push_back(text);
+    }
+
+    return functions;
+}
+
+std::vector<std::string>
+getEntryPoints(const llvm::Module& module) {
+    std::vector<std::string> entry_points;
+
+    auto named_md = module.getNamedMetadata("air.kernel");
+
+    if (!named_md) {
+        return entry_points;
+    }
+
+    for (auto operand : named_md->operands()) {
+        auto function = llvm::mdconst::dyn_extract_or_null<llvm::Function>(operand->getOperand(0));
+        entry_points.push_back(function ? function->getName().str() : std::string());
+    }
+
+    return entry_points;
+}
+
+std::string
+print(const llvm::Module& module) {
+    std::string              text;
+    llvm::raw_string_ostream os(text);
+    module.print(os, nullptr);
+    return os.str();
+}
+
+void
+checkPartitions(const llair::Module& module, unsigned opt_level) {
+    auto what = "level " + std::to_string(opt_level);
+
+    llair::FinalizeOptions options;
+    options.opt_level = opt_level;
+
+    auto whole = llair::finalizeLibrary(module, options);
+
+    options.partition = true;
+    auto partitioned = llair::finalizeLibrary(module, options);
+
+    options.partition_threads = 1;
+    auto partitioned_serially = llair::finalizeLibrary(module, options);
+
+    if (!whole || !partitioned || !partitioned_serially) {
+        check(false, what + ": finalizes the library");
+        llvm::consumeError(whole.takeError());
+        llvm::consumeError(partitioned.takeError());
+        llvm::consumeError(partitioned_serially.takeError());
+        return;
+    }
+
+    std::vector<std::string> entry_points(std::begin(kEntryPoints), std::end(kEntryPoints));
+    check(getEntryPoints(**whole) == entry_points, what + ": lists the entry points");
+    check(getEntryPoints(**partitioned) == entry_points,
+          what + ": lists the entry points in order when it's partitioned");
+
+    auto whole_functions       = getFunctions(**whole);
+    auto partitioned_functions = getFunctions(**partitioned);
+
+    check(whole_functions.size() == partitioned_functions.size(),
+          what + ": defines the same functions");
+
+    // Each copy of a function has the same code as the function that wasn't partitioned:
+    for (const auto& [name, texts] : whole_functions) {
+        auto it = partitioned_functions.find(name);
+
+        if (it == partitioned_functions.end()) {
+            check(false, what + ": defines " + name);
+            continue;
+        }
+
+        check(texts.size() == 1, what + ": has one " + name + " when it isn't partitioned");
+        check(std::all_of(it->second.begin(), it->second.end(),
+                          [&texts](const auto& text) -> bool { return text == texts.front(); }),
+              what + ": has the same code in " + name);
+    }
+
+    // The number of threads doesn't change the library:
+    check(print(**partitioned) == print(**partitioned_serially),
+          what + ": partitions the same way on one thread");
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+    llvm::SMDiagnostic  diagnostic;
+
+    auto llmodule = llvm::parseAssemblyString(kSource, diagnostic, llcontext);
+
+    if (!llmodule) {
+        diagnostic.print("llair-test-partition", llvm::errs());
+        return 1;
+    }
+
+    auto module = std::make_unique<llair::Module>(std::move(llmodule));
+
+    for (unsigned opt_level = 0; opt_level <= 3; ++opt_level) {
+        checkPartitions(*module, opt_level);
+    }
+
+    return s_failures == 0 ? 0 : 1;
+}
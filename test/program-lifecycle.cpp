@@ -0,0 +1,214 @@
+#include <llair/Tools/Program.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Runs shell scripts that stand in for programs which fail in various ways, and checks that their
+// exit status and standard error are reported, that they're reaped, and that no descriptors are
+// leaked; and reports how long it takes to spawn a program:
+namespace {
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+runScript(const std::string& script, const llair::ProgramOptions& options = {}) {
+    return llair::runProgram("/bin/sh", { "sh", "-c", script }, llvm::MemoryBufferRef("", ""),
+                             options);
+}
+
+// Runs a script that must fail, and returns the error's message:
+std::string
+checkFails(const std::string& script, const std::string& what,
+           const llair::ProgramOptions& options = {}) {
+    auto output = runScript(script, options);
+
+    if (output) {
+        check(false, what + ": fails");
+        return {};
+    }
+
+    return llvm::toString(output.takeError());
+}
+
+bool
+contains(llvm::StringRef text, llvm::StringRef part) {
+    return text.find(part) != llvm::StringRef::npos;
+}
+
+// The descriptors that this process has open:
+unsigned
+countDescriptors() {
+    unsigned        count = 0;
+    std::error_code error;
+
+    for (llvm::sys::fs::directory_iterator it("/dev/fd", error), end; it != end && !error;
+         it.increment(error)) {
+        ++count;
+    }
+
+    return count;
+}
+
+// Every child has been reaped:
+bool
+hasNoChildren() {
+    return waitpid(-1, nullptr, WNOHANG) == -1 && errno == ECHILD;
+}
+
+void
+checkExitStatus() {
+    auto error = checkFails("echo 'first line' >&2; echo 'last line' >&2; exit 3",
+                            "an exit status");
+    check(contains(error, "exited with status 3"), "reports the exit status");
+    check(contains(error, "first line\nlast line"), "reports the standard error");
+
+    error = checkFails("kill -TERM $$", "a signal");
+    check(contains(error, "terminated by signal " + std::to_string(SIGTERM)), "reports the signal");
+
+    auto output = runScript("exit 0");
+    check(bool(output), "succeeds with status 0");
+    if (!output) {
+        llvm::consumeError(output.takeError());
+    }
+
+    output = llair::runProgram("/nonexistent/program", { "program" },
+                               llvm::MemoryBufferRef("", ""));
+    check(!output, "fails to run a missing program");
+    if (!output) {
+        llvm::consumeError(output.takeError());
+    }
+
+    // Standard error is collected if it's asked for, whether the program fails or not:
+    std::string           diagnostics;
+    llair::ProgramOptions options;
+    options.diagnostics = &diagnostics;
+
+    output = runScript("echo output; echo warning >&2", options);
+    check(output && (*output)->getBuffer() == "output\n", "reads the output");
+    check(diagnostics == "warning\n", "collects a warning");
+    if (!output) {
+        llvm::consumeError(output.takeError());
+    }
+
+    checkFails("echo error >&2; exit 1", "an error", options);
+    check(diagnostics == "error\n", "collects an error");
+}
+
+void
+checkTimeout() {
+    llair::ProgramOptions options;
+    options.timeout = std::chrono::milliseconds(100);
+
+    // The shell's own child holds the pipes open too, and must be killed with it:
+    auto start   = std::chrono::steady_clock::now();
+    auto output  = runScript("sleep 10; echo done", options);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    check(!output && llvm::errorToErrorCode(output.takeError()) == std::errc::timed_out,
+          "times out");
+    check(elapsed < std::chrono::seconds(5), "kills the program once it times out");
+}
+
+void
+checkDirectory() {
+    llvm::SmallString<256> directory, real_directory;
+    if (llvm::sys::fs::createUniqueDirectory("llair-test-program-lifecycle", directory) ||
+        llvm::sys::fs::real_path(directory, real_directory)) {
+        check(false, "creates a directory");
+        return;
+    }
+
+    llair::ProgramOptions options;
+    options.directory = directory;
+
+    auto output = runScript("pwd -P", options);
+    check(output && (*output)->getBuffer().rtrim() == real_directory,
+          "runs in the working directory");
+    if (!output) {
+        llvm::consumeError(output.takeError());
+    }
+
+    llvm::sys::fs::remove_directories(directory);
+}
+
+// The lower-level interface reports the exit status, and the standard error if it's captured:
+void
+checkOpenAndClose() {
+    auto program = llair::openProgram("/bin/sh", { "sh", "-c", "cat; echo closed >&2; exit 2" },
+                                      "", true);
+
+    if (!program) {
+        check(false, "opens a program: " + program.getError().message());
+        return;
+    }
+
+    *program->input << "input";
+    program->input->close();
+    program->input.reset();
+
+    auto output = llair::getMemoryBufferForStream(program->output, "output");
+    check(output && (*output)->getBuffer() == "input", "reads the program's output");
+
+    auto error = llvm::toString(llair::closeProgram(*program));
+    check(contains(error, "exited with status 2:\nclosed"), "reports the status on closing");
+}
+
+// Spawns a program that does nothing, many times, and reports the average time that it took:
+void
+reportSpawnLatency() {
+    const unsigned kCount = 200;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned index = 0; index < kCount; ++index) {
+        auto output = llair::runProgram("/bin/sh", { "sh", "-c", ":" },
+                                        llvm::MemoryBufferRef("", ""));
+
+        if (!output) {
+            check(false, "runs a program: " + llvm::toString(output.takeError()));
+            return;
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    llvm::outs() << "spawning and reaping a program took " << elapsed.count() / kCount
+                 << "us on average, over " << kCount << " runs\n";
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    auto descriptors = countDescriptors();
+
+    checkExitStatus();
+    checkTimeout();
+    checkDirectory();
+    checkOpenAndClose();
+    reportSpawnLatency();
+
+    check(hasNoChildren(), "reaps every program");
+    check(countDescriptors() == descriptors, "closes every descriptor");
+
+    return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+#include <llair/Tools/Program.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+#include <unistd.h>
+
+// Reads streams that deliver their contents in chunks of many sizes, slowly, and checks that all
+// of it is read, up to the end: from a pipe, from a regular file, and from a program's output:
+namespace {
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+// Contents whose every byte depends on its offset, so that a lost or repeated chunk shows:
+std::string
+makeContents(std::size_t size) {
+    std::string contents(size, '\0');
+
+    for (std::size_t offset = 0; offset < size; ++offset) {
+        contents[offset] = 'a' + (offset * 7 + offset / 251) % 26;
+    }
+
+    return contents;
+}
+
+// The buffer is complete, and terminated as a MemoryBuffer must be:
+void
+checkBuffer(const llvm::MemoryBuffer& buffer, llvm::StringRef expected, const std::string& what) {
+    check(buffer.getBufferSize() == expected.size(),
+          what + ": reads " + std::to_string(buffer.getBufferSize()) + " bytes, rather than " +
+              std::to_string(expected.size()));
+    check(buffer.getBuffer() == expected, what + ": reads the contents");
+    check(*buffer.getBufferEnd() == '\0', what + ": is terminated");
+}
+
+// Writes to a pipe in chunks of sizes that are smaller than, the same as and larger than the
+// reader's, pausing between some of them, so that many reads are short:
+void
+checkPipe(std::size_t size) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        check(false, "creates a pipe");
+        return;
+    }
+
+    auto contents = makeContents(size);
+    auto what     = "a pipe of " + std::to_string(size) + " bytes";
+
+    std::thread writer([&contents, fd = fds[1]]() -> void {
+        const std::size_t chunk_sizes[] = { 1, 7, 4095, 4096, 16384, 16385, 100000 };
+
+        llvm::StringRef remaining(contents);
+
+        for (unsigned index = 0; !remaining.empty(); ++index) {
+            auto chunk = remaining.take_front(chunk_sizes[index % 7]);
+
+            while (!chunk.empty()) {
+                auto nwritten = write(fd, chunk.data(), chunk.size());
+
+                if (nwritten < 0) {
+                    close(fd);
+                    return;
+                }
+
+                chunk     = chunk.drop_front(nwritten);
+                remaining = remaining.drop_front(nwritten);
+            }
+
+            if (index % 3 == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        close(fd);
+    });
+
+    auto buffer = llair::getMemoryBufferForStream(fds[0], "pipe");
+
+    // A reader that stops early fails the writer, rather than blocking it:
+    close(fds[0]);
+    writer.join();
+
+    if (!buffer) {
+        check(false, what + ": " + buffer.getError().message());
+        return;
+    }
+
+    checkBuffer(**buffer, contents, what);
+}
+
+void
+checkFile(std::size_t size) {
+    int                    fd = -1;
+    llvm::SmallString<256> path;
+
+    if (llvm::sys::fs::createTemporaryFile("llair-test-program-output", "txt", fd, path)) {
+        check(false, "creates a file");
+        return;
+    }
+
+    auto contents = makeContents(size);
+    auto what     = "a file of " + std::to_string(size) + " bytes";
+
+  { llvm::raw_fd_ostream os(fd, false);
+    os << contents; }
+
+    lseek(fd, 0, SEEK_SET);
+
+    auto buffer = llair::getMemoryBufferForStream(fd, path);
+
+    close(fd);
+    llvm::sys::fs::remove(path);
+
+    if (!buffer) {
+        check(false, what + ": " + buffer.getError().message());
+        return;
+    }
+
+    checkBuffer(**buffer, contents, what);
+}
+
+// A program that writes its output in numbered chunks, pausing between them:
+void
+checkProgram() {
+    const unsigned kChunkCount = 40, kChunkSize = 20000;
+
+    std::string script = "i=0\n"
+                         "while [ $i -lt " + std::to_string(kChunkCount) + " ]; do\n"
+                         "    printf 'chunk %d\\n' $i\n"
+                         "    head -c " + std::to_string(kChunkSize) + " /dev/zero | tr '\\0' x\n"
+                         "    sleep 0.005\n"
+                         "    i=$((i + 1))\n"
+                         "done\n";
+
+    std::string expected;
+    for (unsigned index = 0; index < kChunkCount; ++index) {
+        expected += "chunk " + std::to_string(index) + "\n" + std::string(kChunkSize, 'x');
+    }
+
+    auto output = llair::runProgram("/bin/sh", { "sh", "-c", script },
+                                    llvm::MemoryBufferRef("", ""));
+
+    if (!output) {
+        check(false, "runs the program: " + llvm::toString(output.takeError()));
+        return;
+    }
+
+    checkBuffer(**output, expected, "a program's chunked output");
+}
+
+// A program that echoes more input than a pipe holds, while it's still being written:
+void
+checkEcho() {
+    auto contents = makeContents(4 * 1024 * 1024 + 3);
+
+    auto output = llair::runProgram("/bin/sh", { "sh", "-c", "cat" },
+                                    llvm::MemoryBufferRef(contents, "input"));
+
+    if (!output) {
+        check(false, "runs the program: " + llvm::toString(output.takeError()));
+        return;
+    }
+
+    checkBuffer(**output, contents, "a program's echoed input");
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    // Writing to a pipe that the reader has closed fails with EPIPE:
+    signal(SIGPIPE, SIG_IGN);
+
+    for (std::size_t size : { 0, 1, 4096, 16383, 16384, 16385, 1000000 }) {
+        checkPipe(size);
+        checkFile(size);
+    }
+
+    checkProgram();
+    checkEcho();
+
+    return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Stands in for `xcrun metal` in the tests that run the compiler as a program, so that they run
+# where there's no Metal toolchain. It answers `metal --version`, and compiles the source on its
+# standard input by writing the bitcode file named by LLAIR_TEST_BITCODE to its standard output,
+# after sleeping for LLAIR_TEST_DELAY seconds. A source that contains '#error' fails to compile.
+#
+# Each compile appends 'start <source>' and 'end <source>' lines to the file named by
+# LLAIR_TEST_LOG, if it's set; the source is expected to be a single line.
+
+if [ "$1" != "metal" ]; then
+    echo "stand-in-xcrun: unknown tool '$1'" >&2
+    exit 1
+fi
+
+if [ "$2" = "--version" ]; then
+    echo "stand-in metal version 1"
+    exit 0
+fi
+
+source=$(cat)
+
+if [ -n "$LLAIR_TEST_LOG" ]; then
+    echo "start $source" >> "$LLAIR_TEST_LOG"
+fi
+
+sleep "${LLAIR_TEST_DELAY:-0}"
+
+if [ -n "$LLAIR_TEST_LOG" ]; then
+    echo "end $source" >> "$LLAIR_TEST_LOG"
+fi
+
+case "$source" in
+*'#error'*)
+    echo "<stdin>:1:1: error: $source" >&2
+    exit 1
+    ;;
+esac
+
+cat "$LLAIR_TEST_BITCODE"
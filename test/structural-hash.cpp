@@ -0,0 +1,333 @@
+#include <llair/Bitcode/Bitcode.h>
+#include <llair/IR/Class.h>
+#include <llair/IR/Interface.h>
+#include <llair/IR/LLAIRContext.h>
+#include <llair/IR/Module.h>
+#include <llair/Linker/Linker.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Checks that Module::structuralHash(), which keys the library cache, tells apart modules that
+// differ in anything that can change the code, but not ones that differ only in names and order;
+// and that linking makes the same bytes for the same inputs, whatever their order:
+namespace {
+
+unsigned s_failures = 0;
+
+void
+check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++s_failures;
+        llvm::errs() << "failed: " << what << "\n";
+    }
+}
+
+std::unique_ptr<llair::Module>
+parse(const std::string& text, llair::LLAIRContext& context) {
+    llvm::SMDiagnostic diagnostic;
+
+    auto llmodule = llvm::parseAssemblyString(text, diagnostic, context.getLLContext());
+
+    if (!llmodule) {
+        diagnostic.print("llair-test-structural-hash", llvm::errs());
+        return nullptr;
+    }
+
+    return std::make_unique<llair::Module>(std::move(llmodule));
+}
+
+uint64_t
+hash(const std::string& text) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+
+    auto module = parse(text, context);
+
+    if (!module) {
+        ++s_failures;
+        return 0;
+    }
+
+    auto hash = module->structuralHash();
+
+    if (!hash) {
+        llvm::errs() << llvm::toString(hash.takeError()) << "\n";
+        ++s_failures;
+        return 0;
+    }
+
+    return *hash;
+}
+
+// A function around `body`, with what the bodies refer to, and then the `metadata`:
+std::string
+makeFunction(const std::string& body, const std::string& metadata = {}) {
+    return R"(
+@table = internal constant [2 x i32] [i32 1, i32 2]
+@pointer = global i32* getelementptr inbounds ([2 x i32], [2 x i32]* @table, i64 1, i64 1)
+
+declare void @callee(i32*)
+
+define i32 @function(i32* %pointer, i32 %value) {
+entry:
+)" + body + R"(
+}
+
+define i32 @other(i32 %value) {
+entry:
+  ret i32 %value
+}
+)" + metadata;
+}
+
+void
+checkSame(const std::string& lhs, const std::string& rhs, const char *what) {
+    check(hash(lhs) == hash(rhs), std::string("same hash: ") + what);
+}
+
+void
+checkDifferent(const std::string& lhs, const std::string& rhs, const char *what) {
+    check(hash(lhs) != hash(rhs), std::string("different hash: ") + what);
+}
+
+// A function with a debug location on `line`:
+std::string
+makeDebugFunction(unsigned line) {
+    return R"(
+define void @located() !dbg !4 {
+  ret void, !dbg !7
+}
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C_plus_plus_14, file: !1, producer: "test", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug)
+!1 = !DIFile(filename: "test.metal", directory: "/")
+!3 = !{i32 2, !"Debug Info Version", i32 3}
+!4 = distinct !DISubprogram(name: "located", scope: !1, file: !1, line: 1, type: !5, spFlags: DISPFlagDefinition, unit: !0)
+!5 = !DISubroutineType(types: !6)
+!6 = !{null}
+!7 = !DILocation(line: )" + std::to_string(line) + R"(, column: 1, scope: !4)
+)";
+}
+
+llvm::SmallString<0>
+link(const std::string& lhs, const std::string& rhs) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+
+    auto lhs_module = parse(lhs, context), rhs_module = parse(rhs, context);
+
+    llvm::SmallString<0> bytes;
+
+    if (!lhs_module || !rhs_module) {
+        ++s_failures;
+        return bytes;
+    }
+
+    auto module = std::make_unique<llair::Module>("linked", context);
+    llair::linkModules(module.get(), lhs_module.get());
+    llair::linkModules(module.get(), rhs_module.get());
+
+    llvm::raw_svector_ostream os(bytes);
+
+    if (auto error = llair::writeBitcode(*module, os)) {
+        llvm::errs() << llvm::toString(std::move(error)) << "\n";
+        ++s_failures;
+    }
+
+    return bytes;
+}
+
+// A class whose `draw` method implements the interface:
+std::string
+makeClass(const std::string& name) {
+    const auto mangled = std::to_string(name.size()) + name;
+
+    return "%struct." + name + " = type { float }\n"
+           "define void @_ZN" + mangled + "4drawEv(%struct." + name + " addrspace(1)* %self) {\n"
+           "entry:\n"
+           "  ret void\n"
+           "}\n";
+}
+
+// A kernel that calls the interface's method, and one of the classes:
+std::string
+makeInterfaceUser() {
+    return makeClass("Circle") + R"(
+%struct.Shape = type { i32 }
+
+declare void @_ZN5Shape4drawEv(%struct.Shape addrspace(1)*)
+
+define void @use(%struct.Shape addrspace(1)* %shape) {
+entry:
+  call void @_ZN5Shape4drawEv(%struct.Shape addrspace(1)* %shape)
+  ret void
+}
+)";
+}
+
+// Links the inputs in the given order, as llair-link -deterministic does: the interfaces and the
+// classes' kinds are numbered in the order of their names, and the module is canonicalized:
+llvm::SmallString<0>
+linkDeterministically(const std::vector<std::string>& inputs) {
+    llvm::LLVMContext   llcontext;
+    llair::LLAIRContext context(llcontext);
+
+    llvm::SmallString<0> bytes;
+
+    std::vector<std::unique_ptr<llair::Module>> modules;
+
+    for (const auto& input : inputs) {
+        auto module = parse(input, context);
+
+        if (!module) {
+            ++s_failures;
+            return bytes;
+        }
+
+        module->getOrLoadAllClassesFromABI();
+        modules.push_back(std::move(module));
+    }
+
+    auto module = std::make_unique<llair::Module>("linked", context);
+
+    std::for_each(
+        modules.begin(), modules.end(),
+        [&module](const auto& input) -> void { llair::linkModules(module.get(), input.get()); });
+
+    auto interfaces = module->getAllInterfacesFromABI();
+    check(interfaces.size() == 1, "finds the interface");
+
+    std::stable_sort(
+        interfaces.begin(), interfaces.end(),
+        [](auto lhs, auto rhs) -> bool {
+            return lhs->getType()->getName() < rhs->getType()->getName();
+        });
+
+    std::vector<llvm::StringRef> class_names;
+    std::transform(
+        module->class_begin(), module->class_end(),
+        std::back_inserter(class_names),
+        [](const auto& klass) -> llvm::StringRef { return klass.getName(); });
+
+    std::sort(class_names.begin(), class_names.end());
+
+    llvm::StringMap<uint32_t> class_kinds;
+
+    std::for_each(
+        class_names.begin(), class_names.end(),
+        [&class_kinds](auto class_name) -> void {
+            class_kinds.insert({ class_name, class_kinds.size() });
+        });
+
+    auto error = llair::finalizeInterfaces(
+        module.get(), interfaces, [&class_kinds](const llair::Class *klass) -> uint32_t {
+            return class_kinds.lookup(klass->getName());
+        });
+
+    if (!error) {
+        check(std::distance(module->dispatcher_begin(), module->dispatcher_end()) > 0,
+              "makes a dispatcher");
+
+        module->canonicalize();
+
+        llvm::raw_svector_ostream os(bytes);
+        error = llair::writeBitcode(*module, os);
+    }
+
+    if (error) {
+        llvm::errs() << llvm::toString(std::move(error)) << "\n";
+        ++s_failures;
+    }
+
+    return bytes;
+}
+
+} // namespace
+
+int
+main(int, char **) {
+    const std::string rmw = "  %old = atomicrmw add i32* %pointer, i32 %value seq_cst\n  ret i32 %old";
+
+    // Names and order don't matter:
+    checkSame(makeFunction(rmw),
+              makeFunction("  %previous = atomicrmw add i32* %pointer, i32 %value seq_cst\n"
+                           "  ret i32 %previous"),
+              "renamed local");
+    {
+        auto renamed = makeFunction(rmw);
+        renamed.replace(renamed.find("@table"), 6, "@array");
+        renamed.replace(renamed.find("@table"), 6, "@array");
+        checkSame(makeFunction(rmw), renamed, "renamed internal global");
+    }
+    {
+        auto text = makeFunction(rmw), reordered = text;
+        auto other = reordered.find("define i32 @other");
+        auto moved = reordered.substr(other);
+        reordered.erase(other);
+        reordered.insert(reordered.find("define i32 @function"), moved + "\n");
+        checkSame(text, reordered, "reordered functions");
+    }
+
+    // What's kept outside of the operands does:
+    checkDifferent(makeFunction(rmw),
+                   makeFunction("  %old = atomicrmw sub i32* %pointer, i32 %value seq_cst\n  ret i32 %old"),
+                   "atomicrmw operation");
+    checkDifferent(makeFunction(rmw),
+                   makeFunction("  %old = atomicrmw add i32* %pointer, i32 %value monotonic\n  ret i32 %old"),
+                   "atomic ordering");
+    checkDifferent(makeFunction(rmw),
+                   makeFunction("  %old = atomicrmw add i32* %pointer, i32 %value syncscope(\"singlethread\") seq_cst\n"
+                                "  ret i32 %old"),
+                   "synchronization scope");
+    checkDifferent(makeFunction("  %loaded = load i32, i32* %pointer\n  ret i32 %loaded"),
+                   makeFunction("  %loaded = load volatile i32, i32* %pointer\n  ret i32 %loaded"),
+                   "volatile load");
+    checkDifferent(makeFunction("  call void @callee(i32* %pointer)\n  ret i32 0"),
+                   makeFunction("  tail call void @callee(i32* %pointer)\n  ret i32 0"),
+                   "tail call kind");
+    checkDifferent(makeFunction("  call void @callee(i32* %pointer)\n  ret i32 0"),
+                   makeFunction("  call void @callee(i32* noalias %pointer)\n  ret i32 0"),
+                   "call site argument attribute");
+    checkDifferent(makeFunction("  %loaded = load i32, i32* %pointer\n  ret i32 %loaded"),
+                   makeFunction("  %loaded = load i32, i32* %pointer, !range !0\n  ret i32 %loaded",
+                                "!0 = !{i32 0, i32 8}\n"),
+                   "instruction metadata");
+    checkDifferent(makeFunction("  br label %loop\nloop:\n  br label %loop"),
+                   makeFunction("  br label %loop\nloop:\n  br label %loop, !llvm.loop !0",
+                                "!0 = distinct !{!0}\n"),
+                   "loop metadata");
+    {
+        auto text = makeFunction(rmw), not_inbounds = text;
+        auto inbounds = not_inbounds.find("getelementptr inbounds");
+        not_inbounds.erase(inbounds + 14, 9);
+        checkDifferent(text, not_inbounds, "constant expression inbounds");
+    }
+    checkDifferent(makeDebugFunction(3), makeDebugFunction(4), "debug location");
+
+    // Linking the same input twice makes the same bytes:
+    const auto lhs = makeFunction(rmw), rhs = makeDebugFunction(3);
+    check(link(lhs, rhs) == link(lhs, rhs), "same bytes");
+
+    // Nor does the order of the inputs, with classes that implement an interface: the dispatcher's
+    // cases, the classes' kinds and the module's metadata all follow the names:
+    const auto user = makeInterfaceUser(), square = makeClass("Square"),
+               triangle = makeClass("Triangle");
+    check(linkDeterministically({ user, square, triangle }) ==
+              linkDeterministically({ triangle, square, user }),
+          "same bytes in either order");
+
+    return s_failures == 0 ? 0 : 1;
+}
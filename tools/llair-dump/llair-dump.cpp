@@ -33,10 +33,11 @@ main(int argc, char **argv) {
     auto llvm_context  = std::make_unique<llvm::LLVMContext>();
     auto llair_context = std::make_unique<llair::LLAIRContext>(*llvm_context);
 
+    // Only the metadata and declarations are printed, so function bodies are never read:
     auto buffer =
         exit_on_err(errorOrToExpected(llvm::MemoryBuffer::getFileOrSTDIN(input_filename)));
     auto module = exit_on_err(
-        llair::getBitcodeModule(llvm::MemoryBufferRef(*buffer), *llair_context));
+        llair::getLazyBitcodeModule(std::move(buffer), *llair_context));
 
     auto interfaces = module->getAllInterfacesFromABI();
     std::for_each(
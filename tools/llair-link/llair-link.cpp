@@ -1,3 +1,4 @@
+#include <llair/Bitcode/Archive.h>
 #include <llair/Bitcode/Bitcode.h>
 #include <llair/IR/Class.h>
 #include <llair/IR/Dispatcher.h>
@@ -6,7 +7,6 @@
 #include <llair/IR/Module.h>
 #include <llair/Linker/Linker.h>
 
-#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/CommandLine.h>
@@ -24,12 +24,25 @@
 namespace {
 
 llvm::cl::list<std::string> input_filenames(llvm::cl::Positional, llvm::cl::ZeroOrMore,
-                                            llvm::cl::desc("<input .bc files>"));
+                                            llvm::cl::desc("<input .bc files and archives>"));
 
 llvm::cl::opt<std::string> output_filename("o", llvm::cl::Required,
                                            llvm::cl::desc("Override output filename"),
                                            llvm::cl::value_desc("filename"));
 
+llvm::cl::opt<bool> write_archive("archive",
+                                  llvm::cl::desc("Write the inputs to an archive, rather than "
+                                                 "linking them"));
+
+llvm::cl::list<std::string> required_symbols("u", llvm::cl::ZeroOrMore,
+                                             llvm::cl::desc("Link the archive member that provides "
+                                                            "this class, entry point or function"),
+                                             llvm::cl::value_desc("symbol"));
+
+llvm::cl::opt<bool> deterministic("deterministic",
+                                  llvm::cl::desc("Write the same bitcode whatever the order of "
+                                                 "the inputs"));
+
 } // namespace
 
 using namespace llair;
@@ -45,18 +58,61 @@ main(int argc, char **argv) {
     auto llair_context = std::make_unique<llair::LLAIRContext>(*llvm_context);
 
     std::vector<std::unique_ptr<llair::Module>> input_modules;
+    std::vector<std::unique_ptr<llair::Archive>> input_archives;
 
-    std::transform(
+    std::for_each(
         input_filenames.begin(), input_filenames.end(),
-        std::back_inserter(input_modules),
-        [&exit_on_err, &llair_context](auto input_filename) -> std::unique_ptr<llair::Module> {
-            auto buffer =
-                exit_on_err(errorOrToExpected(llvm::MemoryBuffer::getFileOrSTDIN(input_filename)));
-            auto module = exit_on_err(
-                llair::getBitcodeModule(llvm::MemoryBufferRef(*buffer), *llair_context));
-            return module;
+        [&exit_on_err, &llair_context, &input_modules, &input_archives](auto input_filename) -> void {
+            // Archives are mapped, and their members are read only if they're needed:
+#if LLVM_VERSION_MAJOR >= 13
+            auto buffer = exit_on_err(errorOrToExpected(llvm::MemoryBuffer::getFileOrSTDIN(
+                input_filename, /*IsText=*/false, /*RequiresNullTerminator=*/false)));
+#else
+            auto buffer = exit_on_err(errorOrToExpected(llvm::MemoryBuffer::getFileOrSTDIN(
+                input_filename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false)));
+#endif
+
+            if (llair::Archive::isArchive(*buffer)) {
+                input_archives.push_back(exit_on_err(llair::Archive::create(std::move(buffer))));
+                return;
+            }
+
+            input_modules.push_back(exit_on_err(
+                llair::getLazyBitcodeModule(std::move(buffer), *llair_context)));
         });
 
+    std::error_code                       error_code;
+#if LLVM_VERSION_MAJOR >= 7
+    std::unique_ptr<llvm::ToolOutputFile> output_file(
+        new llvm::ToolOutputFile(output_filename, error_code, llvm::sys::fs::OF_None));
+#else
+    std::unique_ptr<llvm::ToolOutputFile> output_file(
+        new llvm::ToolOutputFile(output_filename, error_code, llvm::sys::fs::F_None));
+#endif
+
+    if (error_code) {
+        llvm::errs() << error_code.message();
+        return 1;
+    }
+
+    if (write_archive) {
+        if (!input_archives.empty()) {
+            llvm::errs() << "llair-link: archives can't be added to an archive\n";
+            return 1;
+        }
+
+        std::vector<llair::Module *> members;
+        std::transform(
+            input_modules.begin(), input_modules.end(),
+            std::back_inserter(members),
+            [](auto &input_module) -> llair::Module * { return input_module.get(); });
+
+        exit_on_err(llair::Archive::write(members, output_file->os()));
+        output_file->keep();
+
+        return 0;
+    }
+
     auto output = std::make_unique<llair::Module>(output_filename, *llair_context);
 
     std::for_each(
@@ -65,39 +121,57 @@ main(int argc, char **argv) {
             linkModules(output.get(), input_module.get());
         });
 
+    // As with a static linker, archives only provide what the modules (and earlier archives) need:
+    std::vector<llvm::StringRef> symbols(required_symbols.begin(), required_symbols.end());
+
+    std::for_each(
+        input_archives.begin(), input_archives.end(),
+        [&exit_on_err, &output, &symbols](auto &input_archive) -> void {
+            exit_on_err(linkArchive(output.get(), *input_archive, symbols));
+        });
+
     auto interfaces = output->getAllInterfacesFromABI();
 
     llvm::StringMap<uint32_t> class_kinds;
 
-    finalizeInterfaces(output.get(), interfaces, [&class_kinds](const Class *klass) -> uint32_t {
+    // Otherwise, interfaces and classes are numbered in the order in which they're found:
+    if (deterministic) {
+        std::stable_sort(
+            interfaces.begin(), interfaces.end(),
+            [](auto lhs, auto rhs) -> bool {
+                return lhs->getType()->getName() < rhs->getType()->getName();
+            });
+
+        std::vector<llvm::StringRef> class_names;
+        std::transform(
+            output->class_begin(), output->class_end(),
+            std::back_inserter(class_names),
+            [](const auto &klass) -> llvm::StringRef { return klass.getName(); });
+
+        std::sort(class_names.begin(), class_names.end());
+
+        std::for_each(
+            class_names.begin(), class_names.end(),
+            [&class_kinds](auto class_name) -> void {
+                class_kinds.insert({ class_name, class_kinds.size() });
+            });
+    }
+
+    exit_on_err(finalizeInterfaces(output.get(), interfaces, [&class_kinds](const Class *klass) -> uint32_t {
         auto it = class_kinds.find(klass->getName());
         if (it == class_kinds.end()) {
             it = class_kinds.insert({ klass->getName(), class_kinds.size() }).first;
         }
 
         return it->second;
-    });
+    }));
 
-    // Write it out:
-    std::error_code                       error_code;
-#if LLVM_VERSION_MAJOR >= 7
-    std::unique_ptr<llvm::ToolOutputFile> output_file(
-        new llvm::ToolOutputFile(output_filename, error_code, llvm::sys::fs::OF_None));
-#else
-    std::unique_ptr<llvm::ToolOutputFile> output_file(
-        new llvm::ToolOutputFile(output_filename, error_code, llvm::sys::fs::F_None));
-#endif
-
-    if (error_code) {
-        llvm::errs() << error_code.message();
-        return 1;
+    if (deterministic) {
+        output->canonicalize();
     }
 
-#if LLVM_VERSION_MAJOR >= 8
-    llvm::WriteBitcodeToFile(*output->getLLModule(), output_file->os());
-#else
-    llvm::WriteBitcodeToFile(output->getLLModule(), output_file->os());
-#endif
+    // Write it out:
+    exit_on_err(writeBitcode(*output, output_file->os()));
     output_file->keep();
 
     return 0;
@@ -13,6 +13,7 @@
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Error.h>
 #include <llvm/Support/FileSystem.h>
@@ -37,6 +38,22 @@ llvm::cl::opt<std::string> output_filename("o", llvm::cl::Required,
                                            llvm::cl::desc("Override output filename"),
                                            llvm::cl::value_desc("filename"));
 
+llvm::cl::opt<unsigned> opt_level("O", llvm::cl::Prefix, llvm::cl::init(3),
+                                  llvm::cl::desc("Optimization level (0 to 3)"),
+                                  llvm::cl::value_desc("level"));
+
+llvm::cl::opt<unsigned> size_level("size-level", llvm::cl::init(1),
+                                   llvm::cl::desc("Optimize for size (1) or minimum size (2), "
+                                                  "at levels 2 and 3"));
+
+llvm::cl::opt<std::string> pipeline("passes",
+                                    llvm::cl::desc("Run these passes rather than the optimization "
+                                                   "level's, e.g. 'function(sroa,instcombine)'"),
+                                    llvm::cl::value_desc("pipeline"));
+
+llvm::cl::opt<bool> partition("partition",
+                              llvm::cl::desc("Optimize each entry point on a thread of its own"));
+
 } // namespace
 
 using namespace llair;
@@ -76,16 +93,27 @@ main(int argc, char **argv) {
 
     llvm::StringMap<uint32_t> class_kinds;
 
-    finalizeInterfaces(output.get(), interfaces, [&class_kinds](const Class *klass) -> uint32_t {
+    exit_on_err(finalizeInterfaces(output.get(), interfaces, [&class_kinds](const Class *klass) -> uint32_t {
         auto it = class_kinds.find(klass->getName());
         if (it == class_kinds.end()) {
             it = class_kinds.insert({ klass->getName(), class_kinds.size() }).first;
         }
 
         return it->second;
-    });
+    }));
+
+    FinalizeOptions finalize_options;
+    finalize_options.opt_level  = opt_level;
+    finalize_options.size_level = size_level;
+    finalize_options.pipeline   = pipeline;
+    finalize_options.partition  = partition;
+
+    // LLVM's own -time-passes:
+    if (llvm::TimePassesIsEnabled) {
+        finalize_options.time_passes = &llvm::errs();
+    }
 
-    auto output_ll = finalizeLibrary(*output);
+    auto output_ll = exit_on_err(finalizeLibrary(*output, finalize_options));
 
     // Write it out:
     std::error_code                       error_code;